@@ -0,0 +1,171 @@
+#include "he_bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define HE_BOUNDS_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace hyperengine {
+	void Aabb::expand(glm::vec3 point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void Aabb::expand(Aabb const& other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	// See: Graphics Gems, Transforming Axis-Aligned Bounding Boxes
+	Aabb Aabb::transformed(glm::mat4 const& matrix) const {
+		if (!valid()) return *this;
+
+		glm::vec3 center = glm::vec3(matrix * glm::vec4(this->center(), 1.0f));
+		glm::vec3 extents = this->extents();
+		glm::vec3 world = glm::abs(glm::vec3(matrix[0])) * extents.x + glm::abs(glm::vec3(matrix[1])) * extents.y + glm::abs(glm::vec3(matrix[2])) * extents.z;
+		return { center - world, center + world };
+	}
+
+	// Slab test, a zero direction component relies on IEEE infinities
+	std::optional<float> Aabb::raycast(Ray const& ray, float maxDistance) const {
+		if (!valid()) return std::nullopt;
+
+		float tmin = 0.0f;
+		float tmax = maxDistance;
+
+		for (int i = 0; i < 3; ++i) {
+			float inverse = 1.0f / ray.direction[i];
+			float t0 = (min[i] - ray.origin[i]) * inverse;
+			float t1 = (max[i] - ray.origin[i]) * inverse;
+			if (t0 > t1) std::swap(t0, t1);
+
+			tmin = std::max(tmin, t0);
+			tmax = std::min(tmax, t1);
+			if (tmin > tmax) return std::nullopt;
+		}
+
+		return tmin;
+	}
+
+	bool Aabb::overlaps(glm::vec3 center, float radius) const {
+		glm::vec3 closest = glm::clamp(center, min, max);
+		glm::vec3 offset = closest - center;
+		float distanceSquared = glm::dot(offset, offset);
+		return distanceSquared <= radius * radius;
+	}
+
+	BoundingSphere BoundingSphere::transformed(glm::mat4 const& matrix) const {
+		if (std::isinf(radius)) return { glm::vec3(matrix * glm::vec4(center, 1.0f)), radius };
+
+		float scale = glm::max(glm::length(glm::vec3(matrix[0])), glm::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+		return { glm::vec3(matrix * glm::vec4(center, 1.0f)), radius * scale };
+	}
+
+	// The sphere is centered on the box, not minimal but tight enough for culling
+	Bounds Bounds::fromPoints(std::span<glm::vec3 const> points) {
+		Bounds bounds;
+		if (points.empty()) return bounds;
+
+		for (glm::vec3 const& point : points)
+			bounds.box.expand(point);
+
+		bounds.sphere.center = bounds.box.center();
+		float radiusSquared = 0.0f;
+		for (glm::vec3 const& point : points) {
+			glm::vec3 offset = point - bounds.sphere.center;
+			float distanceSquared = glm::dot(offset, offset);
+			radiusSquared = std::max(radiusSquared, distanceSquared);
+		}
+
+		bounds.sphere.radius = std::sqrt(radiusSquared);
+		return bounds;
+	}
+
+	// See: Gribb & Hartmann, Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix
+	Frustum Frustum::fromMatrix(glm::mat4 const& viewProjection) {
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; ++i)
+			row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		Frustum frustum;
+		frustum.planes = {
+			row[3] + row[0], row[3] - row[0],
+			row[3] + row[1], row[3] - row[1],
+			row[3] + row[2], row[3] - row[2],
+		};
+
+		for (glm::vec4& plane : frustum.planes)
+			plane /= glm::length(glm::vec3(plane));
+
+		return frustum;
+	}
+
+	Containment Frustum::classify(Aabb const& box) const {
+		glm::vec3 center = box.center();
+		glm::vec3 extents = box.extents();
+		Containment result = Containment::kInside;
+
+		for (glm::vec4 const& plane : planes) {
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+
+			if (distance < -radius) return Containment::kOutside;
+			if (distance < radius) result = Containment::kIntersects;
+		}
+
+		return result;
+	}
+
+	void SphereBatch::clear() {
+		mX.clear();
+		mY.clear();
+		mZ.clear();
+		mRadius.clear();
+	}
+
+	void SphereBatch::push(BoundingSphere const& sphere) {
+		mX.push_back(sphere.center.x);
+		mY.push_back(sphere.center.y);
+		mZ.push_back(sphere.center.z);
+		mRadius.push_back(sphere.radius);
+	}
+
+	void cullSpheres(Frustum const& frustum, SphereBatch const& spheres, std::span<uint8_t> visible) {
+		size_t const count = spheres.size();
+		size_t i = 0;
+
+#ifdef HE_BOUNDS_SSE2
+		// Four spheres against one plane per step
+		for (; i + 4 <= count; i += 4) {
+			__m128 x = _mm_loadu_ps(spheres.mX.data() + i);
+			__m128 y = _mm_loadu_ps(spheres.mY.data() + i);
+			__m128 z = _mm_loadu_ps(spheres.mZ.data() + i);
+			__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.mRadius.data() + i));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+			for (glm::vec4 const& plane : frustum.planes) {
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+				inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negativeRadius));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			visible[i + 0] = (mask >> 0) & 1;
+			visible[i + 1] = (mask >> 1) & 1;
+			visible[i + 2] = (mask >> 2) & 1;
+			visible[i + 3] = (mask >> 3) & 1;
+		}
+#endif
+
+		for (; i < count; ++i) {
+			bool inside = true;
+			for (glm::vec4 const& plane : frustum.planes)
+				inside &= plane.x * spheres.mX[i] + plane.y * spheres.mY[i] + plane.z * spheres.mZ[i] + plane.w > -spheres.mRadius[i];
+			visible[i] = inside;
+		}
+	}
+}
\ No newline at end of file
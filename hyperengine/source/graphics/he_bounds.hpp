@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace hyperengine {
+	struct Ray final {
+		glm::vec3 origin{};
+		glm::vec3 direction{ 0.0f, 0.0f, -1.0f };
+	};
+
+	struct Aabb final {
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+		inline bool valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+		inline glm::vec3 center() const { return (min + max) * 0.5f; }
+		inline glm::vec3 extents() const { return (max - min) * 0.5f; }
+		inline float surfaceArea() const { glm::vec3 d = max - min; return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x); }
+
+		inline bool overlaps(Aabb const& other) const {
+			return min.x <= other.max.x && max.x >= other.min.x
+				&& min.y <= other.max.y && max.y >= other.min.y
+				&& min.z <= other.max.z && max.z >= other.min.z;
+		}
+
+		inline bool contains(Aabb const& other) const {
+			return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+				&& max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+		}
+
+		void expand(glm::vec3 point);
+		void expand(Aabb const& other);
+		Aabb transformed(glm::mat4 const& matrix) const;
+
+		// Entry distance along the ray, nullopt on a miss or past `maxDistance`. Starts inside the box report 0
+		std::optional<float> raycast(Ray const& ray, float maxDistance = std::numeric_limits<float>::infinity()) const;
+		bool overlaps(glm::vec3 center, float radius) const;
+	};
+
+	// The default sphere is infinite so meshes without bounds are never culled
+	struct BoundingSphere final {
+		glm::vec3 center{};
+		float radius = std::numeric_limits<float>::infinity();
+
+		BoundingSphere transformed(glm::mat4 const& matrix) const;
+	};
+
+	struct Bounds final {
+		Aabb box;
+		BoundingSphere sphere;
+
+		static Bounds fromPoints(std::span<glm::vec3 const> points);
+	};
+
+	enum struct Containment : uint8_t {
+		kOutside,
+		kIntersects,
+		kInside,
+	};
+
+	// Inward facing planes, xyz is the normal and w the distance
+	struct Frustum final {
+		std::array<glm::vec4, 6> planes;
+
+		static Frustum fromMatrix(glm::mat4 const& viewProjection);
+
+		// Conservative, boxes near the corners may report intersecting while being outside
+		Containment classify(Aabb const& box) const;
+	};
+
+	// Spheres in structure of arrays layout for batch culling
+	class SphereBatch final {
+	public:
+		void clear();
+		void push(BoundingSphere const& sphere);
+		inline size_t size() const { return mX.size(); }
+	private:
+		friend void cullSpheres(Frustum const& frustum, SphereBatch const& spheres, std::span<uint8_t> visible);
+
+		std::vector<float> mX, mY, mZ, mRadius;
+	};
+
+	// Writes 1 for every sphere intersecting the frustum and 0 otherwise, `visible` must hold `spheres.size()` entries
+	void cullSpheres(Frustum const& frustum, SphereBatch const& spheres, std::span<uint8_t> visible);
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "he_commandlist.hpp"
+
+#include <glad/gl.h>
+
+#include "he_mesh.hpp"
+#include "he_renderqueue.hpp"
+#include "he_shader.hpp"
+#include "he_texture.hpp"
+
+namespace {
+	template<class T>
+	T const& next(std::byte const*& data) {
+		T const& command = *reinterpret_cast<T const*>(data);
+		data += (sizeof(T) + hyperengine::CommandList::kAlignment - 1) & ~(hyperengine::CommandList::kAlignment - 1);
+		return command;
+	}
+}
+
+namespace hyperengine {
+	void CommandList::replay(RenderStateCache& cache) const {
+		std::byte const* data = mData.data();
+		std::byte const* end = data + mData.size();
+
+		while (data < end) {
+			switch (*reinterpret_cast<Type const*>(data)) {
+			case Type::kProgram: {
+				cache.program(*next<Program>(data).program);
+				break;
+			}
+			case Type::kTexture: {
+				auto const& command = next<BindTexture>(data);
+				cache.texture(*command.texture, command.unit);
+				break;
+			}
+			case Type::kUniformBuffer: {
+				auto const& command = next<UniformBuffer>(data);
+				cache.uniformBuffer(command.buffer, command.binding, static_cast<GLintptr>(command.offset), static_cast<GLsizeiptr>(command.size));
+				break;
+			}
+			case Type::kCull: {
+				cache.cull(next<Cull>(data).enabled);
+				break;
+			}
+			case Type::kUniformVec3: {
+				auto const& command = next<UniformVec3>(data);
+				glUniform3fv(command.location, 1, &command.value[0]);
+				break;
+			}
+			case Type::kUniformMat4: {
+				auto const& command = next<UniformMat4>(data);
+				glUniformMatrix4fv(command.location, 1, GL_FALSE, &command.value[0][0]);
+				break;
+			}
+			case Type::kDraw: {
+				auto const& command = next<Draw>(data);
+				cache.mesh(*command.mesh, command.stream);
+				command.mesh->submit();
+				cache.draw();
+				break;
+			}
+			case Type::kDrawInstanced: {
+				auto const& command = next<DrawInstanced>(data);
+				cache.mesh(*command.mesh, command.stream);
+				command.mesh->instanceBuffer(command.buffer, static_cast<GLintptr>(command.offset), command.stream);
+				command.mesh->submit(GL_TRIANGLES, 0, -1, static_cast<GLsizei>(command.instances));
+				cache.draw(command.instances);
+				break;
+			}
+			case Type::kDrawIndirect: {
+				auto const& command = next<DrawIndirect>(data);
+				cache.mesh(*command.mesh, command.stream);
+				command.mesh->instanceBuffer(command.buffer, static_cast<GLintptr>(command.offset), command.stream);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void const*)(uintptr_t)command.commandOffset, static_cast<GLsizei>(command.commandCount), 0);
+				cache.draw(command.instances);
+				break;
+			}
+			}
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "he_mesh.hpp"
+
+namespace hyperengine {
+	class ShaderProgram;
+	class Texture;
+	class RenderStateCache;
+
+	// Draw commands recorded without touching the graphics api, any thread may fill its own list.
+	// Commands are plain structs packed back to back and replayed in recording order on the gl thread
+	class CommandList final {
+	public:
+		enum struct Type : uint8_t {
+			kProgram,
+			kTexture,
+			kUniformBuffer,
+			kCull,
+			kUniformVec3,
+			kUniformMat4,
+			kDraw,
+			kDrawInstanced,
+			kDrawIndirect,
+		};
+
+		struct Program final {
+			Type type = Type::kProgram;
+			ShaderProgram* program;
+		};
+
+		struct BindTexture final {
+			Type type = Type::kTexture;
+			uint32_t unit;
+			Texture* texture;
+		};
+
+		struct UniformBuffer final {
+			Type type = Type::kUniformBuffer;
+			uint32_t binding;
+			uint32_t buffer;
+			int64_t offset;
+			int64_t size;
+		};
+
+		struct Cull final {
+			Type type = Type::kCull;
+			bool enabled;
+		};
+
+		// Applies to the program set last
+		struct UniformVec3 final {
+			Type type = Type::kUniformVec3;
+			int32_t location;
+			glm::vec3 value;
+		};
+
+		struct UniformMat4 final {
+			Type type = Type::kUniformMat4;
+			int32_t location;
+			glm::mat4 value;
+		};
+
+		struct Draw final {
+			Type type = Type::kDraw;
+			VertexStream stream = VertexStream::kFull;
+			Mesh* mesh;
+		};
+
+		// Instance data starts at `offset` in `buffer`
+		struct DrawInstanced final {
+			Type type = Type::kDrawInstanced;
+			VertexStream stream = VertexStream::kFull;
+			uint32_t instances;
+			Mesh* mesh;
+			uint32_t buffer;
+			int64_t offset;
+		};
+
+		// Commands are read from the bound draw indirect buffer, instances are addressed through their base instance
+		struct DrawIndirect final {
+			Type type = Type::kDrawIndirect;
+			VertexStream stream = VertexStream::kFull;
+			uint32_t instances;
+			Mesh* mesh;
+			uint32_t buffer;
+			uint32_t commandCount;
+			int64_t offset;
+			int64_t commandOffset;
+		};
+
+		static constexpr size_t kAlignment = 8;
+
+		template<class T>
+		void push(T const& command) {
+			static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= kAlignment);
+
+			size_t offset = mData.size();
+			mData.resize(offset + ((sizeof(T) + kAlignment - 1) & ~(kAlignment - 1)));
+			std::memcpy(mData.data() + offset, &command, sizeof(T));
+			++mCount;
+		}
+
+		inline void clear() { mData.clear(); mCount = 0; }
+		inline size_t count() const { return mCount; }
+		inline size_t bytes() const { return mData.size(); }
+
+		// Goes through the state cache so redundant changes across lists are still skipped
+		void replay(RenderStateCache& cache) const;
+	private:
+		std::vector<std::byte> mData;
+		size_t mCount = 0;
+	};
+}
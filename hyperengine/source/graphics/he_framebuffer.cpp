@@ -27,9 +27,15 @@ namespace hyperengine {
 
 			for (auto const& texrb : info.attachments) {
 				auto attachment = texrb.attachment;
+				auto layer = texrb.layer;
 
 				std::visit(hyperengine::Visitor{
-					[this, attachment](hyperengine::Texture& v) { glNamedFramebufferTexture(mHandle, attachment, v.handle(), 0); },
+					[this, attachment, layer](hyperengine::Texture& v) {
+						if (layer >= 0)
+							glNamedFramebufferTextureLayer(mHandle, attachment, v.handle(), 0, layer);
+						else
+							glNamedFramebufferTexture(mHandle, attachment, v.handle(), 0);
+					},
 					[this, attachment](hyperengine::Renderbuffer& v) { glNamedFramebufferRenderbuffer(mHandle, attachment, GL_RENDERBUFFER, v.handle()); },
 				}, texrb.source);
 			}
@@ -50,9 +56,15 @@ namespace hyperengine {
 
 			for (auto const& texrb : info.attachments) {
 				auto attachment = texrb.attachment;
+				auto layer = texrb.layer;
 
 				std::visit(hyperengine::Visitor{
-					[attachment](hyperengine::Texture& v) { glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, v.handle(), 0); },
+					[attachment, layer](hyperengine::Texture& v) {
+						if (layer >= 0)
+							glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, v.handle(), 0, layer);
+						else
+							glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, v.handle(), 0);
+					},
 					[attachment](hyperengine::Renderbuffer& v) { glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, v.handle()); },
 				}, texrb.source);
 			}
@@ -16,6 +16,7 @@ namespace hyperengine {
 		struct Attachment final {
 			GLenum attachment;
 			std::variant<std::reference_wrapper<hyperengine::Texture>, std::reference_wrapper<hyperengine::Renderbuffer>> source;
+			GLint layer = -1; // Attach a single layer of an array texture
 		};
 
 		struct CreateInfo final {
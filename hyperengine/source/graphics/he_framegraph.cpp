@@ -0,0 +1,232 @@
+#include "he_framegraph.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "he_gpuprofiler.hpp"
+
+namespace hyperengine {
+	FrameGraph::FrameGraph(CreateInfo const& info) : mPoolFrames(info.poolFrames) {
+	}
+
+	FrameGraph::Resource FrameGraph::create(TextureInfo const& info) {
+		Node& node = mNodes.emplace_back();
+		node.name = info.label;
+		node.info = info;
+		node.info.label = {};
+		return static_cast<Resource>(mNodes.size() - 1);
+	}
+
+	FrameGraph::Resource FrameGraph::import(Texture& texture, glm::ivec2 size, std::string_view label) {
+		Node& node = mNodes.emplace_back();
+		node.name = label;
+		node.info.width = size.x;
+		node.info.height = size.y;
+		node.imported = &texture;
+		return static_cast<Resource>(mNodes.size() - 1);
+	}
+
+	void FrameGraph::pass(PassInfo&& info) {
+		mPasses.push_back({
+			.name = std::string(info.name),
+			.reads = std::move(info.reads),
+			.writes = std::move(info.writes),
+			.attachWrites = info.attachWrites,
+			.culled = false,
+			.execute = std::move(info.execute)
+		});
+	}
+
+	void FrameGraph::output(Resource resource) {
+		mNodes[resource].output = true;
+	}
+
+	Texture& FrameGraph::texture(Resource resource) {
+		Node& node = mNodes[resource];
+		assert(node.imported || node.pooled >= 0);
+		return node.imported ? *node.imported : mPool[node.pooled].texture;
+	}
+
+	glm::ivec2 FrameGraph::size(Resource resource) const {
+		return { mNodes[resource].info.width, mNodes[resource].info.height };
+	}
+
+	// Back to front, a pass survives if a later pass or an output needs something it writes
+	void FrameGraph::cull() {
+		for (Node& node : mNodes)
+			node.needed = node.output;
+
+		for (size_t i = mPasses.size(); i-- > 0;) {
+			Pass& pass = mPasses[i];
+			pass.culled = std::none_of(pass.writes.begin(), pass.writes.end(), [&](Resource resource) { return mNodes[resource].needed; });
+			if (pass.culled) continue;
+
+			for (Resource resource : pass.reads)
+				mNodes[resource].needed = true;
+		}
+	}
+
+	// Walks the surviving passes in order, a transient gets a texture before its first use and returns it after its last
+	void FrameGraph::allocate() {
+		for (uint32_t i = 0; i < mPasses.size(); ++i) {
+			if (mPasses[i].culled) continue;
+
+			for (auto const* list : { &mPasses[i].reads, &mPasses[i].writes }) {
+				for (Resource resource : *list) {
+					mNodes[resource].first = std::min(mNodes[resource].first, i);
+					mNodes[resource].last = std::max(mNodes[resource].last, i);
+				}
+			}
+		}
+
+		for (Node& node : mNodes)
+			if (node.output) node.last = UINT32_MAX;
+
+		for (uint32_t i = 0; i < mPasses.size(); ++i) {
+			if (mPasses[i].culled) continue;
+
+			for (auto const* list : { &mPasses[i].reads, &mPasses[i].writes })
+				for (Resource resource : *list)
+					if (mNodes[resource].first == i && !mNodes[resource].imported && mNodes[resource].pooled < 0)
+						mNodes[resource].pooled = acquire(mNodes[resource]);
+
+			for (auto const* list : { &mPasses[i].reads, &mPasses[i].writes })
+				for (Resource resource : *list)
+					if (mNodes[resource].last == i && mNodes[resource].pooled >= 0)
+						mPool[mNodes[resource].pooled].busy = false;
+		}
+	}
+
+	int32_t FrameGraph::acquire(Node const& node) {
+		++mStats.transients;
+
+		for (size_t i = 0; i < mPool.size(); ++i) {
+			PooledTexture& pooled = mPool[i];
+			if (pooled.busy || pooled.width != node.info.width || pooled.height != node.info.height || pooled.format != node.info.format || pooled.filter != node.info.filter)
+				continue;
+
+			// Every texture left the last frame unused at least once
+			if (pooled.unused != 0) ++mStats.textures;
+			pooled.busy = true;
+			pooled.unused = 0;
+			return static_cast<int32_t>(i);
+		}
+
+		using enum Texture::WrapMode;
+
+		mPool.push_back({
+			.width = node.info.width,
+			.height = node.info.height,
+			.format = node.info.format,
+			.filter = node.info.filter,
+			.texture = {{
+				.width = node.info.width,
+				.height = node.info.height,
+				.format = node.info.format,
+				.minFilter = node.info.filter,
+				.magFilter = node.info.filter,
+				.wrap = kClampEdge,
+				.label = node.name
+			}},
+			.busy = true
+		});
+
+		++mStats.textures;
+		return static_cast<int32_t>(mPool.size() - 1);
+	}
+
+	// Framebuffers are cached by attachment, pooled textures keep their handles from frame to frame.
+	// The size is part of the key so an imported texture recreated on resize never hits a stale framebuffer
+	void FrameGraph::bind(Pass const& pass) {
+		mAttachments.clear();
+		for (Resource resource : pass.writes) {
+			mAttachments.push_back(texture(resource).handle());
+			mAttachments.push_back(static_cast<GLuint>(mNodes[resource].info.width));
+			mAttachments.push_back(static_cast<GLuint>(mNodes[resource].info.height));
+		}
+
+		auto it = std::find_if(mFramebuffers.begin(), mFramebuffers.end(), [&](CachedFramebuffer const& cached) { return cached.attachments == mAttachments; });
+
+		if (it == mFramebuffers.end()) {
+			std::vector<Framebuffer::Attachment> attachments;
+			attachments.reserve(pass.writes.size());
+
+			GLenum color = GL_COLOR_ATTACHMENT0;
+			for (Resource resource : pass.writes) {
+				PixelFormat format = mNodes[resource].info.format;
+				GLenum attachment = pixelFormatHasStencil(format) ? GL_DEPTH_STENCIL_ATTACHMENT : pixelFormatIsDepth(format) ? GL_DEPTH_ATTACHMENT : color++;
+				attachments.push_back(Framebuffer::Attachment(attachment, std::ref(texture(resource))));
+			}
+
+			mFramebuffers.push_back({ .attachments = mAttachments, .framebuffer = {{ .attachments = attachments }} });
+			it = mFramebuffers.end() - 1;
+		}
+
+		it->unused = 0;
+		it->framebuffer.bind();
+
+		glm::ivec2 viewport = size(pass.writes.front());
+		glViewport(0, 0, viewport.x, viewport.y);
+	}
+
+	// Destroys what the last frames did not use, framebuffers of a destroyed texture go with it since its name may be reused
+	void FrameGraph::collect() {
+		for (PooledTexture& pooled : mPool) {
+			if (++pooled.unused <= mPoolFrames) continue;
+
+			GLuint handle = pooled.texture.handle();
+			std::erase_if(mFramebuffers, [&](CachedFramebuffer const& cached) {
+				for (size_t i = 0; i < cached.attachments.size(); i += 3)
+					if (cached.attachments[i] == handle) return true;
+				return false;
+			});
+		}
+
+		std::erase_if(mPool, [&](PooledTexture const& pooled) { return pooled.unused > mPoolFrames; });
+		std::erase_if(mFramebuffers, [&](CachedFramebuffer& cached) { return ++cached.unused > mPoolFrames; });
+
+		mStats.pooled = static_cast<uint32_t>(mPool.size());
+		mStats.pooledBytes = 0;
+		for (PooledTexture const& pooled : mPool)
+			mStats.pooledBytes += static_cast<size_t>(pooled.width) * pooled.height * pixelFormatSize(pooled.format);
+		mStats.framebuffers = static_cast<uint32_t>(mFramebuffers.size());
+	}
+
+	void FrameGraph::execute(GpuProfiler* profiler) {
+		mStats = { .passes = static_cast<uint32_t>(mPasses.size()) };
+
+		cull();
+		allocate();
+
+		mReport.clear();
+		for (Pass& pass : mPasses) {
+			mReport.push_back({ .name = pass.name, .culled = pass.culled });
+
+			if (pass.culled) {
+				++mStats.culled;
+				continue;
+			}
+
+			if (GLAD_GL_KHR_debug)
+				glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, static_cast<GLsizei>(pass.name.size()), pass.name.data());
+
+			if (profiler) profiler->begin(pass.name);
+
+			if (pass.attachWrites && !pass.writes.empty())
+				bind(pass);
+
+			pass.execute(*this);
+
+			if (profiler) profiler->end();
+
+			if (GLAD_GL_KHR_debug)
+				glPopDebugGroup();
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		collect();
+		mPasses.clear();
+		mNodes.clear();
+	}
+}
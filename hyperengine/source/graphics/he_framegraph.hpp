@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "he_framebuffer.hpp"
+#include "he_texture.hpp"
+
+namespace hyperengine {
+	class GpuProfiler;
+
+	// Passes are declared every frame with the resources they read and write, `execute` then culls every pass
+	// no output depends on and runs the rest in declaration order. Transient textures come from a pool, resources
+	// with the same description and lifetimes that do not overlap share one texture
+	class FrameGraph final {
+	public:
+		using Resource = uint32_t;
+
+		struct CreateInfo final {
+			uint32_t poolFrames = 8; // Pooled textures and framebuffers unused for this many frames are destroyed
+		};
+
+		struct TextureInfo final {
+			GLsizei width = 0, height = 0;
+			PixelFormat format = PixelFormat::kRgba8;
+			Texture::FilterMode filter = Texture::FilterMode::kLinear;
+			std::string_view label;
+		};
+
+		struct PassInfo final {
+			std::string_view name;
+			std::vector<Resource> reads;
+			std::vector<Resource> writes;
+			bool attachWrites = true; // Binds a framebuffer with every written texture attached and sets the viewport
+			std::function<void(FrameGraph&)> execute;
+		};
+
+		struct PassReport final {
+			std::string name;
+			bool culled;
+		};
+
+		struct Stats final {
+			uint32_t passes = 0;
+			uint32_t culled = 0;
+			uint32_t transients = 0;
+			uint32_t textures = 0; // Pooled textures backing this frame's transients
+			uint32_t pooled = 0;
+			size_t pooledBytes = 0;
+			uint32_t framebuffers = 0;
+		};
+
+		FrameGraph() : FrameGraph(CreateInfo{}) {}
+		FrameGraph(CreateInfo const& info);
+
+		Resource create(TextureInfo const& info);
+		// The texture outlives the graph and is never shared with transients
+		Resource import(Texture& texture, glm::ivec2 size, std::string_view label);
+		void pass(PassInfo&& info);
+		// Keeps the resource and every pass it depends on
+		void output(Resource resource);
+
+		// Valid inside `execute` callbacks of passes that read or write the resource
+		Texture& texture(Resource resource);
+		glm::ivec2 size(Resource resource) const;
+
+		// Culls, allocates and runs the declared passes, the graph is empty afterwards. Passes are timed by `profiler` under their name
+		void execute(GpuProfiler* profiler = nullptr);
+
+		inline Stats const& stats() const { return mStats; }
+		// Passes of the last `execute` in declaration order
+		inline std::span<PassReport const> report() const { return mReport; }
+	private:
+		struct Node final {
+			std::string name;
+			TextureInfo info;
+			Texture* imported = nullptr;
+			int32_t pooled = -1;
+			uint32_t first = UINT32_MAX;
+			uint32_t last = 0;
+			bool output = false;
+			bool needed = false;
+		};
+
+		struct Pass final {
+			std::string name;
+			std::vector<Resource> reads;
+			std::vector<Resource> writes;
+			bool attachWrites;
+			bool culled;
+			std::function<void(FrameGraph&)> execute;
+		};
+
+		struct PooledTexture final {
+			GLsizei width, height;
+			PixelFormat format;
+			Texture::FilterMode filter;
+			Texture texture;
+			uint32_t unused = 0;
+			bool busy = false;
+		};
+
+		struct CachedFramebuffer final {
+			std::vector<GLuint> attachments; // Handle, width and height of every attachment
+			Framebuffer framebuffer;
+			uint32_t unused = 0;
+		};
+
+		void cull();
+		void allocate();
+		int32_t acquire(Node const& node);
+		void bind(Pass const& pass);
+		void collect();
+
+		std::vector<Node> mNodes;
+		std::vector<Pass> mPasses;
+		std::vector<PooledTexture> mPool;
+		std::vector<CachedFramebuffer> mFramebuffers;
+		std::vector<GLuint> mAttachments;
+		std::vector<PassReport> mReport;
+		Stats mStats;
+		uint32_t mPoolFrames = 8;
+	};
+}
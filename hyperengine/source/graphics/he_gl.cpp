@@ -91,6 +91,9 @@ namespace hyperengine {
 				static_assert(GL_TEXTURE_MAX_ANISOTROPY == GL_TEXTURE_MAX_ANISOTROPY_EXT);
 				glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &gInfo.maxAnisotropy);
 			}
+
+			if (GLAD_GL_ARB_get_program_binary)
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &gInfo.programBinaryFormats);
 		}
 
 		return gInfo;
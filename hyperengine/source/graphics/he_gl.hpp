@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include <string>
 #include <string_view>
 
 namespace hyperengine {
@@ -10,6 +11,7 @@ namespace hyperengine {
 		std::string version;
 		std::string glslVersion;
 		float maxAnisotropy = 0.0f;
+		int programBinaryFormats = 0;
 	};
 
 	std::string_view glConstantToString(GLuint val);
@@ -0,0 +1,87 @@
+#include "he_governor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace hyperengine {
+	QualityGovernor::QualityGovernor(CreateInfo const& info) {
+		mTarget = std::max(info.target, 0.1f);
+		mStep = std::max(info.step, 0.01f);
+		mMinScale = std::clamp(info.minScale, mStep, 1.0f);
+		mMaxScale = std::clamp(info.maxScale, mMinScale, 1.0f);
+		mScaleUp = info.scaleUp;
+		mQualityUp = std::min(info.qualityUp, info.scaleUp);
+		mLevels = std::max(info.levels, 1u);
+		mCooldown = info.cooldown;
+		mPatience = info.patience;
+		mSmoothing = std::clamp(info.smoothing, 0.01f, 1.0f);
+		mScale = mMaxScale;
+	}
+
+	void QualityGovernor::update(float cpuMilliseconds, float gpuMilliseconds) {
+		mStats.cpu = mStats.cpu > 0.0f ? mStats.cpu + (cpuMilliseconds - mStats.cpu) * mSmoothing : cpuMilliseconds;
+		if (gpuMilliseconds > 0.0f)
+			mStats.gpu = mStats.gpu > 0.0f ? mStats.gpu + (gpuMilliseconds - mStats.gpu) * mSmoothing : gpuMilliseconds;
+
+		mStats.cpuBound = mStats.cpu > mTarget && mStats.cpu > mStats.gpu;
+		if (mStats.gpu <= 0.0f) return;
+
+		if (mWait > 0) {
+			--mWait;
+			return;
+		}
+
+		if (mStats.gpu > mTarget && !mStats.cpuBound) {
+			if (mScale > mMinScale) {
+				// Cost follows the pixel count, the square root of the ratio is the scale expected to meet the target
+				float scale = std::clamp(mScale * std::sqrt(mTarget / mStats.gpu), mScale - 4.0f * mStep, mScale - mStep);
+				mScale = std::clamp(std::round(scale / mStep) * mStep, mMinScale, mMaxScale);
+				++mStats.scaleChanges;
+				change();
+			}
+			else if (mLevel + 1 < mLevels && ++mHeld >= mPatience) {
+				++mLevel;
+				++mStats.levelChanges;
+				change();
+			}
+			return;
+		}
+
+		if (mStats.gpu < mTarget * mScaleUp && mScale < mMaxScale) {
+			mScale = std::min(std::round((mScale + mStep) / mStep) * mStep, mMaxScale);
+			++mStats.scaleChanges;
+			change();
+			return;
+		}
+
+		if (mLevel > 0 && mScale >= mMaxScale && mStats.gpu < mTarget * mQualityUp) {
+			if (++mHeld >= mPatience) {
+				--mLevel;
+				++mStats.levelChanges;
+				change();
+			}
+			return;
+		}
+
+		mHeld = 0;
+	}
+
+	void QualityGovernor::target(float milliseconds) {
+		mTarget = std::max(milliseconds, 0.1f);
+		mHeld = 0;
+	}
+
+	void QualityGovernor::reset() {
+		mScale = mMaxScale;
+		mLevel = 0;
+		mWait = 0;
+		mHeld = 0;
+		mStats = {};
+	}
+
+	// The averages still hold frames of the previous setting, they get time to settle before the next decision
+	void QualityGovernor::change() {
+		mWait = mCooldown;
+		mHeld = 0;
+	}
+}
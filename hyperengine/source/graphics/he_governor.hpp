@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hyperengine {
+	// Holds the gpu frame time under a target by trading render resolution first and shader quality second.
+	// The scale moves in steps once the smoothed time leaves a band below the target, the quality level only
+	// changes after the scale sat at its limit for a while so the two do not chase each other
+	class QualityGovernor final {
+	public:
+		struct CreateInfo final {
+			float target = 1000.0f / 60.0f; // Milliseconds
+			float minScale = 0.5f;
+			float maxScale = 1.0f;
+			float step = 0.05f; // Scales are multiples of this
+			float scaleUp = 0.85f; // Fraction of the target the gpu time has to fall under before the scale rises
+			float qualityUp = 0.7f; // Same for raising quality, lower so the level is not dropped again right away
+			uint32_t levels = 2; // Level 0 is full quality
+			uint32_t cooldown = 15; // Frames between changes, gpu timings are read back a few frames late
+			uint32_t patience = 60; // Frames at a scale limit before the level changes
+			float smoothing = 0.2f; // Weight of a new sample in the moving averages
+		};
+
+		struct Stats final {
+			float cpu = 0.0f; // Smoothed milliseconds
+			float gpu = 0.0f;
+			bool cpuBound = false; // Lowering the resolution would not help, the scale is left alone
+			uint32_t scaleChanges = 0;
+			uint32_t levelChanges = 0;
+		};
+
+		QualityGovernor() : QualityGovernor(CreateInfo{}) {}
+		QualityGovernor(CreateInfo const& info);
+
+		// Once per frame with the cpu time of the frame and the newest gpu time read back, zero until one arrived
+		void update(float cpuMilliseconds, float gpuMilliseconds);
+		void target(float milliseconds);
+		// Back to full scale and quality
+		void reset();
+
+		inline float target() const { return mTarget; }
+		inline float scale() const { return mScale; }
+		inline uint32_t level() const { return mLevel; }
+		inline Stats const& stats() const { return mStats; }
+	private:
+		void change();
+
+		float mTarget = 0.0f;
+		float mMinScale = 0.0f;
+		float mMaxScale = 0.0f;
+		float mStep = 0.0f;
+		float mScaleUp = 0.0f;
+		float mQualityUp = 0.0f;
+		uint32_t mLevels = 0;
+		uint32_t mCooldown = 0;
+		uint32_t mPatience = 0;
+		float mSmoothing = 0.0f;
+
+		float mScale = 1.0f;
+		uint32_t mLevel = 0;
+		uint32_t mWait = 0;
+		uint32_t mHeld = 0;
+		Stats mStats;
+	};
+}
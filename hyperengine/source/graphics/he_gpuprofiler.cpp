@@ -0,0 +1,171 @@
+#include "he_gpuprofiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+namespace hyperengine {
+	GpuProfiler::GpuProfiler(CreateInfo const& info) : mHistory(std::max(info.history, 1u)) {
+		mFrames.resize(std::max(info.latency, 1u));
+
+		for (Frame& frame : mFrames) {
+			frame.queries.resize(std::max(info.scopes, 1u) * 2);
+			glGenQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+			frame.records.reserve(info.scopes);
+		}
+	}
+
+	GpuProfiler& GpuProfiler::operator=(GpuProfiler&& other) noexcept {
+		std::swap(mFrames, other.mFrames);
+		std::swap(mTimings, other.mTimings);
+		std::swap(mOpen, other.mOpen);
+		std::swap(mScratch, other.mScratch);
+		std::swap(mFrame, other.mFrame);
+		std::swap(mHistory, other.mHistory);
+		std::swap(mDropped, other.mDropped);
+		std::swap(mFrameTime, other.mFrameTime);
+		return *this;
+	}
+
+	GpuProfiler::~GpuProfiler() noexcept {
+		for (Frame& frame : mFrames)
+			glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+	}
+
+	void GpuProfiler::beginFrame() {
+		if (mFrames.empty()) return;
+
+		mFrame = (mFrame + 1) % static_cast<uint32_t>(mFrames.size());
+		collect(mFrames[mFrame]);
+		mOpen.clear();
+	}
+
+	void GpuProfiler::begin(std::string_view name) {
+		if (mFrames.empty()) return;
+
+		Frame& frame = mFrames[mFrame];
+		if (frame.records.size() * 2 >= frame.queries.size()) {
+			mOpen.push_back(-1);
+			return;
+		}
+
+		Record& record = frame.records.emplace_back(timing(name), static_cast<uint32_t>(frame.records.size() * 2));
+		glQueryCounter(frame.queries[record.query], GL_TIMESTAMP);
+		frame.last = record.query;
+		mOpen.push_back(static_cast<int32_t>(frame.records.size() - 1));
+	}
+
+	void GpuProfiler::end() {
+		if (mOpen.empty()) return;
+
+		int32_t open = mOpen.back();
+		mOpen.pop_back();
+		if (open < 0) return;
+
+		Frame& frame = mFrames[mFrame];
+		Record& record = frame.records[open];
+		glQueryCounter(frame.queries[record.query + 1], GL_TIMESTAMP);
+		record.ended = true;
+		frame.last = record.query + 1;
+	}
+
+	void GpuProfiler::budget(std::string_view name, float milliseconds) {
+		mTimings[timing(name)].budget = milliseconds;
+	}
+
+	uint32_t GpuProfiler::timing(std::string_view name) {
+		for (size_t i = 0; i < mTimings.size(); ++i)
+			if (mTimings[i].name == name) return static_cast<uint32_t>(i);
+
+		Timing& timing = mTimings.emplace_back();
+		timing.name = name;
+		timing.samples.reserve(mHistory);
+		return static_cast<uint32_t>(mTimings.size() - 1);
+	}
+
+	// Queries finish in issue order, once the one issued last is available the whole frame is
+	void GpuProfiler::collect(Frame& frame) {
+		if (frame.records.empty()) return;
+
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(frame.queries[frame.last], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (!available) {
+			++mDropped;
+			frame.records.clear();
+			return;
+		}
+
+		// Records are in begin order, one starting before the furthest end so far is nested
+		GLuint64 covered = 0;
+		GLuint64 total = 0;
+
+		for (Record const& record : frame.records) {
+			// Left open, its end timestamp was never issued
+			if (!record.ended) continue;
+
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.queries[record.query], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[record.query + 1], GL_QUERY_RESULT, &end);
+
+			if (begin >= covered) total += end - begin;
+			covered = std::max(covered, end);
+
+			Timing& timing = mTimings[record.timing];
+			float milliseconds = static_cast<float>(static_cast<double>(end - begin) / 1e6);
+
+			if (timing.samples.size() < mHistory)
+				timing.samples.push_back(milliseconds);
+			else
+				timing.samples[timing.head] = milliseconds;
+
+			timing.head = (timing.head + 1) % mHistory;
+			timing.last = milliseconds;
+		}
+
+		mFrameTime = static_cast<float>(static_cast<double>(total) / 1e6);
+
+		for (Record const& record : frame.records)
+			if (record.ended) summarize(mTimings[record.timing]);
+
+		frame.records.clear();
+	}
+
+	void GpuProfiler::summarize(Timing& timing) {
+		mScratch.assign(timing.samples.begin(), timing.samples.end());
+
+		double total = 0.0;
+		for (float sample : mScratch) total += sample;
+		timing.mean = static_cast<float>(total / mScratch.size());
+
+		auto median = mScratch.begin() + mScratch.size() / 2;
+		std::nth_element(mScratch.begin(), median, mScratch.end());
+		timing.median = *median;
+
+		auto p95 = mScratch.begin() + mScratch.size() * 95 / 100;
+		std::nth_element(mScratch.begin(), p95, mScratch.end());
+		timing.p95 = *p95;
+
+		timing.max = *std::max_element(mScratch.begin(), mScratch.end());
+	}
+
+	bool GpuProfiler::exportCsv(char const* path) const {
+		std::ofstream file(path, std::ofstream::out | std::ofstream::trunc);
+		if (!file) return false;
+
+		file << "scope,budget_ms,samples,mean_ms,median_ms,p95_ms,max_ms\n";
+		for (Timing const& timing : mTimings)
+			file << timing.name << ',' << timing.budget << ',' << timing.samples.size() << ',' << timing.mean << ',' << timing.median << ',' << timing.p95 << ',' << timing.max << '\n';
+
+		// Oldest first
+		file << "\nscope,sample,ms\n";
+		for (Timing const& timing : mTimings) {
+			size_t count = timing.samples.size();
+			size_t first = count < mHistory ? 0 : timing.head;
+
+			for (size_t i = 0; i < count; ++i)
+				file << timing.name << ',' << i << ',' << timing.samples[(first + i) % count] << '\n';
+		}
+
+		return static_cast<bool>(file);
+	}
+}
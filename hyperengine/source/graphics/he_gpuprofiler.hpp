@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <glad/gl.h>
+
+namespace hyperengine {
+	// Timestamp queries around named scopes. A frame's queries are read `latency` frames later and only if the gpu
+	// already finished them, the cpu never waits. Late frames are dropped instead
+	class GpuProfiler final {
+	public:
+		struct CreateInfo final {
+			uint32_t latency = 4; // Frames between issuing and reading back
+			uint32_t scopes = 32; // Per frame, scopes past this are not measured
+			uint32_t history = 240; // Samples kept per scope
+		};
+
+		struct Timing final {
+			std::string name;
+			float budget = 0.0f; // Milliseconds, zero without a budget
+			float last = 0.0f;
+			float mean = 0.0f;
+			float median = 0.0f;
+			float p95 = 0.0f;
+			float max = 0.0f;
+			std::vector<float> samples; // Ring of the last `history` samples
+			uint32_t head = 0;
+
+			inline bool overBudget() const { return budget > 0.0f && p95 > budget; }
+		};
+
+		constexpr GpuProfiler() noexcept = default;
+		GpuProfiler(CreateInfo const& info);
+		GpuProfiler(GpuProfiler const&) = delete;
+		GpuProfiler& operator=(GpuProfiler const&) = delete;
+		inline GpuProfiler(GpuProfiler&& other) noexcept { *this = std::move(other); }
+		GpuProfiler& operator=(GpuProfiler&& other) noexcept;
+		~GpuProfiler() noexcept;
+
+		// Reads back the oldest frame and starts recording a new one
+		void beginFrame();
+		// Scopes may nest
+		void begin(std::string_view name);
+		void end();
+
+		void budget(std::string_view name, float milliseconds);
+		inline std::span<Timing const> timings() const { return mTimings; }
+		inline uint64_t dropped() const { return mDropped; }
+		// Milliseconds over the outermost scopes of the newest frame read back, nested scopes are not counted twice
+		inline float frameTime() const { return mFrameTime; }
+		// One row per scope with its budget and statistics, then every sample
+		bool exportCsv(char const* path) const;
+	private:
+		struct Record final {
+			uint32_t timing;
+			uint32_t query; // Begin timestamp, the end timestamp follows it
+			bool ended = false;
+		};
+
+		struct Frame final {
+			std::vector<GLuint> queries;
+			std::vector<Record> records;
+			uint32_t last = 0; // Query issued last, nested scopes end out of record order
+		};
+
+		uint32_t timing(std::string_view name);
+		void collect(Frame& frame);
+		void summarize(Timing& timing);
+
+		std::vector<Frame> mFrames;
+		std::vector<Timing> mTimings;
+		std::vector<int32_t> mOpen; // Records of unfinished scopes, -1 for scopes past the limit
+		std::vector<float> mScratch;
+		uint32_t mFrame = 0;
+		uint32_t mHistory = 0;
+		uint64_t mDropped = 0;
+		float mFrameTime = 0.0f;
+	};
+}
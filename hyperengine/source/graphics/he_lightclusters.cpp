@@ -0,0 +1,318 @@
+#include "he_lightclusters.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "he_jobs.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define HE_CLUSTERS_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace {
+	constexpr GLenum kFormats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	constexpr char const* kLabels[3] = { "Light Data", "Light Grid", "Light Indices" };
+}
+
+namespace hyperengine {
+	LightClusters::LightClusters(CreateInfo const& info) {
+		// Tiles and lights are stored as 16 bit
+		mGrid = glm::max(info.grid, glm::uvec3(1));
+		mGrid.x = std::min(mGrid.x, 256u);
+		mGrid.y = std::min(mGrid.y, 256u);
+		mMaxLights = std::min(info.maxLights, 1u << 16);
+		mMaxIndices = info.maxIndices;
+
+		mSliceDepth.resize(mGrid.z + 1);
+		mBounds.resize(mGrid.x * mGrid.y * mGrid.z);
+		mSlices.resize(mGrid.z);
+
+		if (GLAD_GL_ARB_direct_state_access) {
+			glCreateBuffers(3, mBuffers);
+			glCreateTextures(GL_TEXTURE_BUFFER, 3, mTextures);
+		}
+		else {
+			glGenBuffers(3, mBuffers);
+			glGenTextures(3, mTextures);
+		}
+
+		upload();
+
+		for (int i = 0; i < 3; ++i) {
+			if (GLAD_GL_ARB_direct_state_access) {
+				glTextureBuffer(mTextures[i], kFormats[i], mBuffers[i]);
+			}
+			else {
+				glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+				glTexBuffer(GL_TEXTURE_BUFFER, kFormats[i], mBuffers[i]);
+				glBindTexture(GL_TEXTURE_BUFFER, 0);
+			}
+
+			if (GLAD_GL_KHR_debug) {
+				glObjectLabel(GL_BUFFER, mBuffers[i], -1, kLabels[i]);
+				glObjectLabel(GL_TEXTURE, mTextures[i], -1, kLabels[i]);
+			}
+		}
+	}
+
+	LightClusters& LightClusters::operator=(LightClusters&& other) noexcept {
+		std::swap(mBuffers, other.mBuffers);
+		std::swap(mTextures, other.mTextures);
+		std::swap(mGrid, other.mGrid);
+		std::swap(mMaxLights, other.mMaxLights);
+		std::swap(mMaxIndices, other.mMaxIndices);
+		std::swap(mFit, other.mFit);
+		std::swap(mTan, other.mTan);
+		std::swap(mScale, other.mScale);
+		std::swap(mSliceDepth, other.mSliceDepth);
+		std::swap(mBounds, other.mBounds);
+		std::swap(mSpheres, other.mSpheres);
+		std::swap(mVisible, other.mVisible);
+		std::swap(mData, other.mData);
+		std::swap(mX, other.mX);
+		std::swap(mY, other.mY);
+		std::swap(mDepth, other.mDepth);
+		std::swap(mRadius, other.mRadius);
+		std::swap(mSlices, other.mSlices);
+		std::swap(mCells, other.mCells);
+		std::swap(mIndices, other.mIndices);
+		std::swap(mStats, other.mStats);
+		return *this;
+	}
+
+	LightClusters::~LightClusters() noexcept {
+		if (!mTextures[0]) return;
+
+		glDeleteTextures(3, mTextures);
+		glDeleteBuffers(3, mBuffers);
+	}
+
+	// Cluster boxes only depend on the projection, they are refitted when it changes
+	void LightClusters::fitBounds(View const& view) {
+		mScale.x = static_cast<float>(mGrid.x) / static_cast<float>(std::max(view.size.x, 1));
+		mScale.y = static_cast<float>(mGrid.y) / static_cast<float>(std::max(view.size.y, 1));
+
+		glm::vec4 fit(view.fov, view.aspect, view.zNear, view.zFar);
+		if (fit == mFit) return;
+		mFit = fit;
+
+		mTan.y = std::tan(view.fov * 0.5f);
+		mTan.x = mTan.y * view.aspect;
+
+		// slice = log(depth) * scale.z + scale.w
+		float logRatio = std::log(view.zFar / view.zNear);
+		mScale.z = static_cast<float>(mGrid.z) / logRatio;
+		mScale.w = -static_cast<float>(mGrid.z) * std::log(view.zNear) / logRatio;
+
+		for (uint32_t z = 0; z <= mGrid.z; ++z)
+			mSliceDepth[z] = view.zNear * std::pow(view.zFar / view.zNear, static_cast<float>(z) / static_cast<float>(mGrid.z));
+
+		glm::vec2 tiles(mGrid.x, mGrid.y);
+		for (uint32_t z = 0; z < mGrid.z; ++z) {
+			float sliceNear = mSliceDepth[z];
+			float sliceFar = mSliceDepth[z + 1];
+
+			for (uint32_t y = 0; y < mGrid.y; ++y) {
+				for (uint32_t x = 0; x < mGrid.x; ++x) {
+					glm::vec2 lo = (glm::vec2(x, y) / tiles * 2.0f - 1.0f) * mTan;
+					glm::vec2 hi = (glm::vec2(x + 1, y + 1) / tiles * 2.0f - 1.0f) * mTan;
+
+					Aabb& box = mBounds[(z * mGrid.y + y) * mGrid.x + x];
+					box.min = glm::vec3(glm::min(lo * sliceNear, lo * sliceFar), sliceNear);
+					box.max = glm::vec3(glm::max(hi * sliceNear, hi * sliceFar), sliceFar);
+				}
+			}
+		}
+	}
+
+	void LightClusters::build(std::span<Light const> lights, View const& view, JobSystem* jobs) {
+		fitBounds(view);
+		mStats = { .lights = static_cast<uint32_t>(lights.size()) };
+
+		mSpheres.clear();
+		for (Light const& light : lights)
+			mSpheres.push({ light.position, light.range });
+
+		mVisible.resize(lights.size());
+		glm::mat4 projection = glm::perspective(view.fov, view.aspect, view.zNear, view.zFar);
+		cullSpheres(Frustum::fromMatrix(projection * view.view), mSpheres, mVisible);
+
+		mData.clear();
+		mX.clear();
+		mY.clear();
+		mDepth.clear();
+		mRadius.clear();
+
+		for (size_t i = 0; i < lights.size() && mX.size() < mMaxLights; ++i) {
+			if (!mVisible[i]) continue;
+
+			Light const& light = lights[i];
+			glm::vec3 center = glm::vec3(view.view * glm::vec4(light.position, 1.0f));
+			mX.push_back(center.x);
+			mY.push_back(center.y);
+			mDepth.push_back(-center.z);
+			mRadius.push_back(light.range);
+
+			mData.push_back(glm::vec4(light.position, light.range));
+			mData.push_back(glm::vec4(light.color, light.cosInner));
+			mData.push_back(glm::vec4(glm::normalize(light.direction), light.cosOuter));
+		}
+
+		mStats.visible = static_cast<uint32_t>(mX.size());
+
+		if (jobs)
+			jobs->parallelFor(mGrid.z, [&](uint32_t slice) { binSlice(slice); });
+		else
+			for (uint32_t slice = 0; slice < mGrid.z; ++slice) binSlice(slice);
+
+		// Slices are concatenated front to back, references past the limit are dropped
+		uint32_t tiles = mGrid.x * mGrid.y;
+		mCells.resize(static_cast<size_t>(tiles) * mGrid.z);
+		mIndices.clear();
+
+		for (uint32_t z = 0; z < mGrid.z; ++z) {
+			Slice const& slice = mSlices[z];
+			uint32_t offset = 0;
+
+			for (uint32_t tile = 0; tile < tiles; ++tile) {
+				uint32_t count = slice.counts[tile];
+				uint32_t first = static_cast<uint32_t>(mIndices.size());
+				uint32_t kept = std::min(count, mMaxIndices - first);
+
+				mIndices.insert(mIndices.end(), slice.indices.begin() + offset, slice.indices.begin() + offset + kept);
+				mCells[z * tiles + tile] = { first, kept };
+
+				mStats.maxPerCluster = std::max(mStats.maxPerCluster, count);
+				mStats.dropped += count - kept;
+				offset += count;
+			}
+		}
+
+		mStats.indices = static_cast<uint32_t>(mIndices.size());
+	}
+
+	// Lights overlapping the slice in depth are found four at a time,
+	// each is then tested against the clusters under its screen rectangle
+	void LightClusters::binSlice(uint32_t z) {
+		Slice& slice = mSlices[z];
+		float const sliceNear = mSliceDepth[z];
+		float const sliceFar = mSliceDepth[z + 1];
+		size_t const count = mDepth.size();
+		size_t i = 0;
+
+		slice.candidates.clear();
+
+#ifdef HE_CLUSTERS_SSE2
+		__m128 const nearDepth = _mm_set1_ps(sliceNear);
+		__m128 const farDepth = _mm_set1_ps(sliceFar);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 depth = _mm_loadu_ps(mDepth.data() + i);
+			__m128 radius = _mm_loadu_ps(mRadius.data() + i);
+			__m128 overlap = _mm_and_ps(_mm_cmplt_ps(_mm_sub_ps(depth, radius), farDepth), _mm_cmpgt_ps(_mm_add_ps(depth, radius), nearDepth));
+
+			for (unsigned mask = static_cast<unsigned>(_mm_movemask_ps(overlap)); mask; mask &= mask - 1)
+				slice.candidates.push_back(static_cast<uint32_t>(i + std::countr_zero(mask)));
+		}
+#endif
+
+		for (; i < count; ++i)
+			if (mDepth[i] - mRadius[i] < sliceFar && mDepth[i] + mRadius[i] > sliceNear)
+				slice.candidates.push_back(static_cast<uint32_t>(i));
+
+		glm::vec2 const tiles(mGrid.x, mGrid.y);
+		glm::ivec2 const lastTile(mGrid.x - 1, mGrid.y - 1);
+		slice.pairs.clear();
+
+		for (uint32_t light : slice.candidates) {
+			glm::vec3 center(mX[light], mY[light], mDepth[light]);
+			float radius = mRadius[light];
+
+			// The screen rectangle of the sphere over the part of the slice it covers
+			float a = std::max(sliceNear, center.z - radius);
+			float b = std::min(sliceFar, center.z + radius);
+			glm::vec2 lo = glm::vec2(center) - radius;
+			glm::vec2 hi = glm::vec2(center) + radius;
+			lo = glm::min(lo / a, lo / b);
+			hi = glm::max(hi / a, hi / b);
+
+			glm::ivec2 first = glm::ivec2(glm::floor((lo / mTan + 1.0f) * 0.5f * tiles));
+			glm::ivec2 last = glm::ivec2(glm::floor((hi / mTan + 1.0f) * 0.5f * tiles));
+			if (last.x < 0 || last.y < 0 || first.x > lastTile.x || first.y > lastTile.y) continue;
+
+			first = glm::max(first, glm::ivec2(0));
+			last = glm::min(last, lastTile);
+
+			for (int y = first.y; y <= last.y; ++y) {
+				for (int x = first.x; x <= last.x; ++x) {
+					uint32_t tile = static_cast<uint32_t>(y) * mGrid.x + static_cast<uint32_t>(x);
+					Aabb const& box = mBounds[z * mGrid.x * mGrid.y + tile];
+
+					glm::vec3 offset = center - glm::clamp(center, box.min, box.max);
+					if (glm::dot(offset, offset) <= radius * radius)
+						slice.pairs.push_back({ static_cast<uint16_t>(tile), static_cast<uint16_t>(light) });
+				}
+			}
+		}
+
+		// Counting sort by tile, the lights of a cluster stay in submission order
+		slice.counts.assign(mGrid.x * mGrid.y, 0);
+		for (auto [tile, light] : slice.pairs)
+			++slice.counts[tile];
+
+		slice.offsets.resize(slice.counts.size());
+		uint32_t offset = 0;
+		for (size_t tile = 0; tile < slice.counts.size(); ++tile) {
+			slice.offsets[tile] = offset;
+			offset += slice.counts[tile];
+		}
+
+		slice.indices.resize(slice.pairs.size());
+		for (auto [tile, light] : slice.pairs)
+			slice.indices[slice.offsets[tile]++] = light;
+	}
+
+	// Buffers are orphaned every frame so the driver never waits on reads of the last frame
+	void LightClusters::upload() {
+		GLsizeiptr const capacities[3] = {
+			static_cast<GLsizeiptr>(mMaxLights * 3 * sizeof(glm::vec4)),
+			static_cast<GLsizeiptr>(mBounds.size() * sizeof(glm::uvec2)),
+			static_cast<GLsizeiptr>(mMaxIndices * sizeof(uint16_t)),
+		};
+
+		void const* data[3] = { mData.data(), mCells.data(), mIndices.data() };
+		GLsizeiptr const sizes[3] = {
+			static_cast<GLsizeiptr>(mData.size() * sizeof(glm::vec4)),
+			static_cast<GLsizeiptr>(mCells.size() * sizeof(glm::uvec2)),
+			static_cast<GLsizeiptr>(mIndices.size() * sizeof(uint16_t)),
+		};
+
+		for (int i = 0; i < 3; ++i) {
+			if (GLAD_GL_ARB_direct_state_access) {
+				glNamedBufferData(mBuffers[i], capacities[i], nullptr, GL_STREAM_DRAW);
+				if (sizes[i] > 0) glNamedBufferSubData(mBuffers[i], 0, sizes[i], data[i]);
+			}
+			else {
+				glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[i]);
+				glBufferData(GL_TEXTURE_BUFFER, capacities[i], nullptr, GL_STREAM_DRAW);
+				if (sizes[i] > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+				glBindBuffer(GL_TEXTURE_BUFFER, 0);
+			}
+		}
+	}
+
+	void LightClusters::bind(GLuint unit) const {
+		for (GLuint i = 0; i < 3; ++i) {
+			if (GLAD_GL_ARB_direct_state_access) {
+				glBindTextureUnit(unit + i, mTextures[i]);
+			}
+			else {
+				glActiveTexture(GL_TEXTURE0 + unit + i);
+				glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+			}
+		}
+	}
+}
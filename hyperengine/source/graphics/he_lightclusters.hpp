@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "he_bounds.hpp"
+
+namespace hyperengine {
+	class JobSystem;
+
+	// Light data, grid and indices sit on three units from here, above any unit a material is handed
+	inline constexpr GLuint kLightClusterUnit = 13;
+
+	// Point and spot lights binned into froxels, screen tiles cut into exponential depth slices. Built on the cpu every frame
+	// and read through texture buffers by `_clusteredLights` in common.glsl, a fragment only walks the lights of its cluster
+	class LightClusters final {
+	public:
+		struct CreateInfo final {
+			glm::uvec3 grid = { 16, 9, 24 };
+			uint32_t maxLights = 4096; // Visible lights past this are ignored
+			uint32_t maxIndices = 1 << 18; // Light references over every cluster, references past this are dropped
+		};
+
+		// Point lights keep the default cone, which covers every direction
+		struct Light final {
+			glm::vec3 position;
+			float range;
+			glm::vec3 color;
+			glm::vec3 direction = { 0.0f, 0.0f, -1.0f };
+			float cosInner = -1.0f;
+			float cosOuter = -2.0f;
+		};
+
+		struct View final {
+			glm::mat4 view;
+			float fov; // Vertical, in radians
+			float aspect;
+			float zNear;
+			float zFar;
+			glm::ivec2 size; // Viewport in pixels
+		};
+
+		struct Stats final {
+			uint32_t lights = 0;
+			uint32_t visible = 0;
+			uint32_t indices = 0;
+			uint32_t maxPerCluster = 0;
+			uint32_t dropped = 0;
+		};
+
+		constexpr LightClusters() noexcept = default;
+		LightClusters(CreateInfo const& info);
+		LightClusters(LightClusters const&) = delete;
+		LightClusters& operator=(LightClusters const&) = delete;
+		inline LightClusters(LightClusters&& other) noexcept { *this = std::move(other); }
+		LightClusters& operator=(LightClusters&& other) noexcept;
+		~LightClusters() noexcept;
+
+		// Slices are binned in parallel when `jobs` is given
+		void build(std::span<Light const> lights, View const& view, JobSystem* jobs);
+		void upload();
+		// Light data, grid and indices go to three consecutive units from `unit`
+		void bind(GLuint unit) const;
+
+		// Cluster counts and the light count, `gClusterGrid` in common.glsl
+		inline glm::uvec4 grid() const { return { mGrid, mStats.visible }; }
+		// Pixel to tile and view depth to slice factors, `gClusterScale` in common.glsl
+		inline glm::vec4 scale() const { return mScale; }
+		inline Stats const& stats() const { return mStats; }
+	private:
+		struct Slice final {
+			std::vector<uint32_t> candidates;
+			std::vector<std::pair<uint16_t, uint16_t>> pairs; // Tile and light
+			std::vector<uint32_t> counts;
+			std::vector<uint32_t> offsets;
+			std::vector<uint16_t> indices;
+		};
+
+		void fitBounds(View const& view);
+		void binSlice(uint32_t slice);
+
+		GLuint mBuffers[3]{};
+		GLuint mTextures[3]{};
+		glm::uvec3 mGrid{};
+		uint32_t mMaxLights = 0;
+		uint32_t mMaxIndices = 0;
+
+		glm::vec4 mFit{}; // Fov, aspect, near and far the bounds were fitted for
+		glm::vec2 mTan{};
+		glm::vec4 mScale{};
+		std::vector<float> mSliceDepth; // Slice boundaries, one more than slices
+		std::vector<Aabb> mBounds; // View space with positive depth along z
+
+		SphereBatch mSpheres;
+		std::vector<uint8_t> mVisible;
+		std::vector<glm::vec4> mData;
+		std::vector<float> mX, mY, mDepth, mRadius;
+		std::vector<Slice> mSlices;
+		std::vector<glm::uvec2> mCells;
+		std::vector<uint16_t> mIndices;
+		Stats mStats;
+	};
+}
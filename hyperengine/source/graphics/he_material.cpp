@@ -0,0 +1,114 @@
+#include "he_material.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+#include "he_util.hpp"
+
+namespace hyperengine {
+	Material::Material(CreateInfo const& info) : mOrigin(info.origin) {
+		shader(info.shader);
+	}
+
+	void Material::shader(std::shared_ptr<ShaderProgram> shader) {
+		mShader = std::move(shader);
+		mData.clear();
+		mTextures.fill(nullptr);
+		mPendingParameters.clear();
+		mPendingTextures.clear();
+		mHashValid = false;
+		update();
+	}
+
+	void Material::texture(size_t unit, std::shared_ptr<Texture> texture) {
+		if (unit >= kMaxTextures) return;
+
+		mTextures[unit] = std::move(texture);
+		mHashValid = false;
+	}
+
+	void Material::texture(std::string_view name, std::shared_ptr<Texture> texture) {
+		mPendingTextures.push_back({ std::string(name), std::move(texture) });
+		update();
+	}
+
+	void Material::parameter(std::string_view name, std::span<float const> values) {
+		PendingParameter pending{ .name = std::string(name), .values = {}, .count = std::min(values.size(), size_t(4)) };
+		std::copy_n(values.begin(), pending.count, pending.values.begin());
+		mPendingParameters.push_back(std::move(pending));
+		update();
+	}
+
+	std::span<uint8_t> Material::editData() {
+		mHashValid = false;
+		return mData;
+	}
+
+	bool Material::writeParameter(std::string_view name, std::span<float const> values) {
+		auto it = mShader->materialInfo().find(name);
+		if (it == mShader->materialInfo().end() || it->second.offset < 0) {
+			spdlog::warn("Material parameter {} is not declared by {}", name, mShader->origin());
+			return false;
+		}
+
+		using enum ShaderProgram::UniformType;
+		size_t count = 0;
+		switch (it->second.type) {
+			case kFloat: count = 1; break;
+			case kVec2f: count = 2; break;
+			case kVec3f: count = 3; break;
+			case kVec4f: count = 4; break;
+			default:
+				spdlog::warn("Unsupported uniform type");
+				return false;
+		}
+
+		count = std::min(count, values.size());
+		std::memcpy(mData.data() + it->second.offset, values.data(), count * sizeof(float));
+		return true;
+	}
+
+	void Material::update() {
+		if (!mShader || !mShader->ready()) return;
+
+		size_t size = static_cast<size_t>(mShader->materialAllocationSize());
+		if (mData.size() != size) {
+			mData.resize(size);
+			mHashValid = false;
+		}
+
+		for (PendingParameter const& pending : mPendingParameters)
+			writeParameter(pending.name, std::span(pending.values.data(), pending.count));
+
+		for (PendingTexture& pending : mPendingTextures) {
+			auto it = mShader->opaqueAssignments().find(pending.name);
+			if (it != mShader->opaqueAssignments().end())
+				texture(static_cast<size_t>(it->second), std::move(pending.texture));
+		}
+
+		if (!mPendingParameters.empty() || !mPendingTextures.empty()) mHashValid = false;
+		mPendingParameters.clear();
+		mPendingTextures.clear();
+	}
+
+	// Hashes the contents rather than the identity so identical materials can share draws
+	// The shader is part of it, passes drawing every material with one program still take its cull state
+	uint64_t Material::hash() const {
+		if (mHashValid) return mHash;
+
+		mHash = fnv1a({ reinterpret_cast<char const*>(mData.data()), mData.size() });
+		mHash = (mHash * 0x100000001b3ull) ^ reinterpret_cast<uintptr_t>(mShader.get());
+		for (auto const& texture : mTextures)
+			mHash = (mHash * 0x100000001b3ull) ^ (texture ? texture->handle() : 0);
+
+		mHashValid = true;
+		return mHash;
+	}
+
+	std::shared_ptr<Material> Material::clone() const {
+		auto copy = std::make_shared<Material>(*this);
+		copy->mOrigin.clear();
+		return copy;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "he_shader.hpp"
+#include "he_texture.hpp"
+
+namespace hyperengine {
+	// Shader, parameter block and texture bindings. Materials are shared by reference, users copy a shared
+	// material with `clone` before changing it so an override never leaks into the other users
+	class Material final {
+	public:
+		static constexpr size_t kMaxTextures = 8;
+
+		struct CreateInfo final {
+			std::shared_ptr<ShaderProgram> shader;
+			std::string_view origin;
+		};
+
+		Material() = default;
+		Material(CreateInfo const& info);
+
+		inline std::shared_ptr<ShaderProgram> const& shader() const { return mShader; }
+		// File the material was loaded from, empty for overrides and materials made in the editor
+		inline std::string const& origin() const { return mOrigin; }
+		inline std::span<uint8_t const> data() const { return mData; }
+		inline std::shared_ptr<Texture> const& texture(size_t unit) const { return mTextures[unit]; }
+
+		// Clears parameters and textures
+		void shader(std::shared_ptr<ShaderProgram> shader);
+		void texture(size_t unit, std::shared_ptr<Texture> texture);
+		// Parameters and textures set by name are kept until the shader is ready and its layout is known
+		void texture(std::string_view name, std::shared_ptr<Texture> texture);
+		void parameter(std::string_view name, std::span<float const> values);
+		// For editing in place, valid until the next `update`
+		std::span<uint8_t> editData();
+
+		// Follows the shader layout, which is unknown while compiling and can change when it's reloaded
+		void update();
+		uint64_t hash() const;
+		std::shared_ptr<Material> clone() const;
+	private:
+		struct PendingParameter final {
+			std::string name;
+			std::array<float, 4> values;
+			size_t count;
+		};
+
+		struct PendingTexture final {
+			std::string name;
+			std::shared_ptr<Texture> texture;
+		};
+
+		bool writeParameter(std::string_view name, std::span<float const> values);
+
+		std::shared_ptr<ShaderProgram> mShader;
+		std::string mOrigin;
+		std::vector<uint8_t> mData;
+		std::array<std::shared_ptr<Texture>, kMaxTextures> mTextures;
+		std::vector<PendingParameter> mPendingParameters;
+		std::vector<PendingTexture> mPendingTextures;
+		mutable uint64_t mHash = 0;
+		mutable bool mHashValid = false;
+	};
+}
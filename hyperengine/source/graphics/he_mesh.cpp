@@ -1,7 +1,24 @@
 #include "he_mesh.hpp"
 
+#include "he_meshpool.hpp"
+
 namespace hyperengine {
-	Mesh::Mesh(CreateInfo const& info) {
+	Mesh::Mesh(CreateInfo const& info) : mOccluder(info.occluder), mBounds(info.bounds) {
+		if (info.pool) {
+			if (auto range = info.pool->allocate(info)) {
+				mPool = info.pool;
+				mVao = mPool->vao();
+				mPositionVao = info.positions.empty() ? 0 : mPool->vao(VertexStream::kPosition);
+				mBaseVertex = range->baseVertex;
+				mFirstElement = range->firstElement;
+				mVertexCount = range->vertexCount;
+				mCount = range->elementCount;
+				mType = GL_UNSIGNED_INT;
+				mOrigin = std::string(info.origin);
+				return;
+			}
+		}
+
 		if (GLAD_GL_ARB_direct_state_access) {
 			glCreateVertexArrays(1, &mVao);
 
@@ -27,6 +44,18 @@ namespace hyperengine {
 					glVertexArrayAttribBinding(mVao, static_cast<GLuint>(i), bindingIndex);
 				}
 			}
+
+			if (info.positions.size_bytes() > 0) {
+				glCreateVertexArrays(1, &mPositionVao);
+				glCreateBuffers(1, &mPositionVbo);
+				glNamedBufferStorage(mPositionVbo, info.positions.size_bytes(), info.positions.data(), 0);
+				glVertexArrayVertexBuffer(mPositionVao, bindingIndex, mPositionVbo, 0, sizeof(float) * 3);
+				if (mEbo) glVertexArrayElementBuffer(mPositionVao, mEbo);
+
+				glEnableVertexArrayAttrib(mPositionVao, 0);
+				glVertexArrayAttribFormat(mPositionVao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+				glVertexArrayAttribBinding(mPositionVao, 0, bindingIndex);
+			}
 		}
 		else {
 			// Push state
@@ -61,6 +90,19 @@ namespace hyperengine {
 				}
 			}
 
+			if (info.positions.size_bytes() > 0) {
+				glGenVertexArrays(1, &mPositionVao);
+				glBindVertexArray(mPositionVao);
+
+				glGenBuffers(1, &mPositionVbo);
+				glBindBuffer(GL_ARRAY_BUFFER, mPositionVbo);
+				glBufferData(GL_ARRAY_BUFFER, info.positions.size_bytes(), info.positions.data(), GL_STATIC_DRAW);
+				if (mEbo) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+
+				glEnableVertexAttribArray(0);
+				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, nullptr);
+			}
+
 			// Pop state
 			glBindVertexArray(static_cast<GLuint>(prevVao));
 			glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(prevVbo));
@@ -101,34 +143,107 @@ namespace hyperengine {
 		std::swap(mVao, other.mVao);
 		std::swap(mVbo, other.mVbo);
 		std::swap(mEbo, other.mEbo);
+		std::swap(mPositionVao, other.mPositionVao);
+		std::swap(mPositionVbo, other.mPositionVbo);
 		std::swap(mCount, other.mCount);
 		std::swap(mType, other.mType);
+		std::swap(mInstanced, other.mInstanced);
 		std::swap(mOrigin, other.mOrigin);
+		std::swap(mPool, other.mPool);
+		std::swap(mOccluder, other.mOccluder);
+		std::swap(mBounds, other.mBounds);
+		std::swap(mBaseVertex, other.mBaseVertex);
+		std::swap(mFirstElement, other.mFirstElement);
+		std::swap(mVertexCount, other.mVertexCount);
 		return *this;
 	}
 
 	Mesh::~Mesh() noexcept {
+		if (mPool) {
+			mPool->free({ .baseVertex = mBaseVertex, .vertexCount = mVertexCount, .firstElement = mFirstElement, .elementCount = mCount });
+			return;
+		}
+
 		if (mVbo)
 			glDeleteBuffers(1, &mVbo);
 		if (mEbo)
 			glDeleteBuffers(1, &mEbo);
 		if (mVao)
 			glDeleteVertexArrays(1, &mVao);
+		if (mPositionVbo)
+			glDeleteBuffers(1, &mPositionVbo);
+		if (mPositionVao)
+			glDeleteVertexArrays(1, &mPositionVao);
 	}
 
-	void Mesh::draw(GLenum mode, GLint first, GLsizei count) {
+	void Mesh::bind(VertexStream stream) {
+		glBindVertexArray(vao(stream));
+	}
+
+	void Mesh::instanceBuffer(GLuint buffer, GLintptr offset, VertexStream stream) {
+		constexpr GLuint bindingIndex = 1;
+		constexpr GLsizei stride = sizeof(float) * 16;
+		constexpr GLuint columnSize = sizeof(float) * 4;
+
+		GLuint vao = this->vao(stream);
+		bool& instanced = mInstanced[vao == mVao ? 0 : 1];
+
+		if (GLAD_GL_ARB_direct_state_access) {
+			if (!instanced) {
+				for (GLuint i = 0; i < 4; ++i) {
+					glEnableVertexArrayAttrib(vao, kInstanceAttribute + i);
+					glVertexArrayAttribFormat(vao, kInstanceAttribute + i, 4, GL_FLOAT, GL_FALSE, i * columnSize);
+					glVertexArrayAttribBinding(vao, kInstanceAttribute + i, bindingIndex);
+				}
+
+				glVertexArrayBindingDivisor(vao, bindingIndex, 1);
+				instanced = true;
+			}
+
+			glVertexArrayVertexBuffer(vao, bindingIndex, buffer, offset, stride);
+		}
+		else {
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+			for (GLuint i = 0; i < 4; ++i) {
+				if (!instanced) {
+					glEnableVertexAttribArray(kInstanceAttribute + i);
+					glVertexAttribDivisor(kInstanceAttribute + i, 1);
+				}
+
+				glVertexAttribPointer(kInstanceAttribute + i, 4, GL_FLOAT, GL_FALSE, stride, (void const*)(uintptr_t)(offset + i * columnSize));
+			}
+
+			instanced = true;
+		}
+	}
+
+	void Mesh::submit(GLenum mode, GLint first, GLsizei count, GLsizei instances) {
 		if (count == -1) count = mCount;
 
-		glBindVertexArray(mVao);
-		if (mEbo == 0)
-			glDrawArrays(mode, first, count);
+		if (mEbo == 0 && !mPool) {
+			if (instances == 1)
+				glDrawArrays(mode, first, count);
+			else
+				glDrawArraysInstanced(mode, first, count, instances);
+		}
 		else {
 			int stride;
 			if (mType == GL_UNSIGNED_BYTE) stride = 1;
 			else if (mType == GL_UNSIGNED_SHORT) stride = 2;
 			else stride = 4;
 
-			glDrawElements(mode, count, mType, (void const*)(uintptr_t)(first * stride));
+			void const* offset = (void const*)(uintptr_t)((mFirstElement + first) * stride);
+
+			if (instances == 1)
+				glDrawElementsBaseVertex(mode, count, mType, offset, mBaseVertex);
+			else
+				glDrawElementsInstancedBaseVertex(mode, count, mType, offset, instances, mBaseVertex);
 		}
 	}
+
+	void Mesh::draw(GLenum mode, GLint first, GLsizei count) {
+		bind();
+		submit(mode, first, count);
+	}
 }
\ No newline at end of file
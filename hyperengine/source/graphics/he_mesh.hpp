@@ -1,13 +1,39 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <span>
 #include <glad/gl.h>
 
+#include "he_bounds.hpp"
+
 namespace hyperengine {
+	class MeshPool;
+	struct Occluder;
+
+	// Depth only draws read positions from their own tightly packed buffer, a quarter of the full vertex
+	enum struct VertexStream : uint8_t {
+		kFull,
+		kPosition,
+	};
+
+	// Layout mandated by glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand final {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
 	class Mesh final {
 	public:
+		// A per instance mat4 occupies this location and the three after it
+		static constexpr GLuint kInstanceAttribute = 4;
+
 		struct Attribute final {
 			GLint size;
 			GLenum type;
@@ -20,10 +46,24 @@ namespace hyperengine {
 			std::span<const std::byte> elements;
 			size_t elementStride = 0;
 			std::span<const Attribute> attributes;
+			// Tightly packed vec3 copy of attribute 0, meshes without one draw depth from the full stream
+			std::span<const std::byte> positions;
 			std::string_view origin;
+			Bounds bounds;
+			// Sub allocate from shared buffers, falls back to owned buffers if the pool can't take the mesh
+			std::shared_ptr<MeshPool> pool;
+			// Simplified geometry for the occlusion buffer, meshes without one never occlude
+			std::shared_ptr<Occluder const> occluder;
 		};
 
 		inline std::string const& origin() const { return mOrigin; }
+		inline GLuint vao(VertexStream stream = VertexStream::kFull) const { return stream == VertexStream::kPosition && mPositionVao ? mPositionVao : mVao; }
+		inline Bounds const& bounds() const { return mBounds; }
+		inline bool pooled() const { return mPool != nullptr; }
+		inline Occluder const* occluder() const { return mOccluder.get(); }
+		inline DrawElementsIndirectCommand indirectCommand(GLuint instances, GLuint baseInstance) const {
+			return { static_cast<GLuint>(mCount), instances, mFirstElement, mBaseVertex, baseInstance };
+		}
 
 		constexpr Mesh() noexcept = default;
 		Mesh(CreateInfo const& info);
@@ -33,11 +73,24 @@ namespace hyperengine {
 		Mesh& operator=(Mesh&& other) noexcept;
 		~Mesh() noexcept;
 
+		void bind(VertexStream stream = VertexStream::kFull);
+		// Sources the instance transforms from `buffer` starting at `offset`, assumes the mesh is bound with the same stream
+		void instanceBuffer(GLuint buffer, GLintptr offset, VertexStream stream = VertexStream::kFull);
+		// Issues the draw call, assumes the mesh is bound
+		void submit(GLenum mode = GL_TRIANGLES, GLint first = 0, GLsizei count = -1, GLsizei instances = 1);
 		void draw(GLenum mode = GL_TRIANGLES, GLint first = 0, GLsizei count = -1);
 	private:
 		std::string mOrigin;
+		std::shared_ptr<MeshPool> mPool;
+		std::shared_ptr<Occluder const> mOccluder;
+		Bounds mBounds;
 		GLuint mVao = 0, mVbo = 0, mEbo = 0;
+		GLuint mPositionVao = 0, mPositionVbo = 0;
+		GLint mBaseVertex = 0;
+		GLuint mFirstElement = 0;
+		GLsizei mVertexCount = 0;
 		GLsizei mCount = 0;
 		GLenum mType = 0;
+		std::array<bool, 2> mInstanced{}; // Per stream
 	};
 }
\ No newline at end of file
@@ -0,0 +1,329 @@
+#include "he_meshpool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	constexpr GLsizei kPositionSize = sizeof(float) * 3;
+
+	GLuint createBuffer(GLsizeiptr size) {
+		GLuint buffer;
+
+		if (GLAD_GL_ARB_direct_state_access) {
+			glCreateBuffers(1, &buffer);
+			glNamedBufferData(buffer, size, nullptr, GL_STATIC_DRAW);
+		}
+		else {
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+
+		return buffer;
+	}
+
+	// Replaces `buffer` with one of `size` bytes that starts with the first `used` bytes of the old one
+	void resizeBuffer(GLuint& buffer, GLsizeiptr used, GLsizeiptr size) {
+		GLuint grown = createBuffer(size);
+
+		if (buffer && used > 0) {
+			if (GLAD_GL_ARB_direct_state_access) {
+				glCopyNamedBufferSubData(buffer, grown, 0, 0, used);
+			}
+			else {
+				glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+				glBindBuffer(GL_COPY_READ_BUFFER, 0);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+		}
+
+		if (buffer) glDeleteBuffers(1, &buffer);
+		buffer = grown;
+	}
+
+	void uploadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, void const* data) {
+		if (GLAD_GL_ARB_direct_state_access) {
+			glNamedBufferSubData(buffer, offset, size, data);
+		}
+		else {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+	}
+}
+
+namespace hyperengine {
+	MeshPool::FreeList::FreeList(GLsizei capacity) : mCapacity(capacity) {
+		if (capacity > 0) mBlocks.push_back({ 0, capacity });
+	}
+
+	std::optional<GLsizei> MeshPool::FreeList::allocate(GLsizei size) {
+		for (auto it = mBlocks.begin(); it != mBlocks.end(); ++it) {
+			if (it->size < size) continue;
+
+			GLsizei offset = it->offset;
+			it->offset += size;
+			it->size -= size;
+			if (it->size == 0) mBlocks.erase(it);
+			return offset;
+		}
+
+		return std::nullopt;
+	}
+
+	void MeshPool::FreeList::free(GLsizei offset, GLsizei size) {
+		auto it = std::lower_bound(mBlocks.begin(), mBlocks.end(), offset, [](Block const& block, GLsizei value) { return block.offset < value; });
+		it = mBlocks.insert(it, { offset, size });
+
+		auto next = it + 1;
+		if (next != mBlocks.end() && it->offset + it->size == next->offset) {
+			it->size += next->size;
+			mBlocks.erase(next);
+		}
+
+		if (it != mBlocks.begin()) {
+			auto prev = it - 1;
+			if (prev->offset + prev->size == it->offset) {
+				prev->size += it->size;
+				mBlocks.erase(it);
+			}
+		}
+	}
+
+	void MeshPool::FreeList::grow(GLsizei capacity) {
+		GLsizei previous = mCapacity;
+		mCapacity = capacity;
+		free(previous, capacity - previous);
+	}
+
+	MeshPool::MeshPool(CreateInfo const& info) : mVertices(info.vertexCapacity), mElements(info.elementCapacity) {
+		if (GLAD_GL_ARB_direct_state_access) {
+			glCreateVertexArrays(1, &mVao);
+			glCreateVertexArrays(1, &mPositionVao);
+		}
+		else {
+			glGenVertexArrays(1, &mVao);
+			glGenVertexArrays(1, &mPositionVao);
+		}
+
+		mLabel = std::string(info.label);
+		if (GLAD_GL_KHR_debug && !mLabel.empty()) {
+			if (!GLAD_GL_ARB_direct_state_access) {
+				// Names from glGen* only become objects once bound
+				GLint prevVao;
+				glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prevVao);
+				glBindVertexArray(mVao);
+				glBindVertexArray(mPositionVao);
+				glBindVertexArray(static_cast<GLuint>(prevVao));
+			}
+
+			glObjectLabel(GL_VERTEX_ARRAY, mVao, static_cast<GLsizei>(mLabel.size()), mLabel.data());
+
+			std::string positionLabel = mLabel + " positions";
+			glObjectLabel(GL_VERTEX_ARRAY, mPositionVao, static_cast<GLsizei>(positionLabel.size()), positionLabel.data());
+		}
+	}
+
+	MeshPool& MeshPool::operator=(MeshPool&& other) noexcept {
+		std::swap(mLabel, other.mLabel);
+		std::swap(mAttributes, other.mAttributes);
+		std::swap(mVertices, other.mVertices);
+		std::swap(mElements, other.mElements);
+		std::swap(mVao, other.mVao);
+		std::swap(mVbo, other.mVbo);
+		std::swap(mEbo, other.mEbo);
+		std::swap(mPositionVao, other.mPositionVao);
+		std::swap(mPositionVbo, other.mPositionVbo);
+		std::swap(mPositionCapacity, other.mPositionCapacity);
+		std::swap(mVertexStride, other.mVertexStride);
+		std::swap(mPositions, other.mPositions);
+		return *this;
+	}
+
+	MeshPool::~MeshPool() noexcept {
+		if (mVbo)
+			glDeleteBuffers(1, &mVbo);
+		if (mEbo)
+			glDeleteBuffers(1, &mEbo);
+		if (mVao)
+			glDeleteVertexArrays(1, &mVao);
+		if (mPositionVbo)
+			glDeleteBuffers(1, &mPositionVbo);
+		if (mPositionVao)
+			glDeleteVertexArrays(1, &mPositionVao);
+	}
+
+	bool MeshPool::compatible(Mesh::CreateInfo const& info) const {
+		if (info.vertexStride != mVertexStride) return false;
+		if (info.positions.empty() == mPositions) return false;
+		if (info.attributes.size() != mAttributes.size()) return false;
+
+		for (size_t i = 0; i < mAttributes.size(); ++i) {
+			auto const& a = info.attributes[i];
+			auto const& b = mAttributes[i];
+			if (a.size != b.size || a.type != b.type || a.offset != b.offset) return false;
+		}
+
+		return true;
+	}
+
+	// Creates or grows `buffer` until `required` more units fit, existing ranges keep their offsets
+	void MeshPool::reserve(GLuint& buffer, FreeList& list, GLsizei required, GLsizei unitSize) {
+		GLsizei capacity = std::max(list.capacity(), 1);
+
+		if (!buffer) {
+			while (capacity < required) capacity *= 2;
+			if (capacity != list.capacity()) list.grow(capacity);
+			buffer = createBuffer(static_cast<GLsizeiptr>(capacity) * unitSize);
+			return;
+		}
+
+		while (capacity - list.capacity() < required) capacity *= 2;
+
+		resizeBuffer(buffer, static_cast<GLsizeiptr>(list.capacity()) * unitSize, static_cast<GLsizeiptr>(capacity) * unitSize);
+		list.grow(capacity);
+	}
+
+	// Points the VAO at the current buffers
+	void MeshPool::attach() {
+		constexpr GLuint bindingIndex = 0;
+
+		if (GLAD_GL_ARB_direct_state_access) {
+			glVertexArrayVertexBuffer(mVao, bindingIndex, mVbo, 0, mVertexStride);
+			glVertexArrayElementBuffer(mVao, mEbo);
+
+			for (size_t i = 0; i < mAttributes.size(); ++i) {
+				auto const& attribute = mAttributes[i];
+				glEnableVertexArrayAttrib(mVao, static_cast<GLuint>(i));
+				glVertexArrayAttribFormat(mVao, static_cast<GLuint>(i), attribute.size, attribute.type, GL_FALSE, attribute.offset);
+				glVertexArrayAttribBinding(mVao, static_cast<GLuint>(i), bindingIndex);
+			}
+
+			if (mPositions) {
+				glVertexArrayVertexBuffer(mPositionVao, bindingIndex, mPositionVbo, 0, kPositionSize);
+				glVertexArrayElementBuffer(mPositionVao, mEbo);
+				glEnableVertexArrayAttrib(mPositionVao, 0);
+				glVertexArrayAttribFormat(mPositionVao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+				glVertexArrayAttribBinding(mPositionVao, 0, bindingIndex);
+			}
+		}
+		else {
+			// Push state
+			GLint prevVao;
+			GLint prevVbo;
+			glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prevVao);
+			glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &prevVbo);
+			//
+
+			glBindVertexArray(mVao);
+			glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+
+			for (size_t i = 0; i < mAttributes.size(); ++i) {
+				auto const& attribute = mAttributes[i];
+				glEnableVertexAttribArray(static_cast<GLuint>(i));
+				glVertexAttribPointer(static_cast<GLuint>(i), attribute.size, attribute.type, GL_FALSE, mVertexStride, (void const*)(uintptr_t)attribute.offset);
+			}
+
+			if (mPositions) {
+				glBindVertexArray(mPositionVao);
+				glBindBuffer(GL_ARRAY_BUFFER, mPositionVbo);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+				glEnableVertexAttribArray(0);
+				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kPositionSize, nullptr);
+			}
+
+			// Pop state
+			glBindVertexArray(static_cast<GLuint>(prevVao));
+			glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(prevVbo));
+			//
+		}
+	}
+
+	std::optional<MeshPool::Range> MeshPool::allocate(Mesh::CreateInfo const& info) {
+		if (info.elements.size_bytes() == 0 || info.vertices.size_bytes() == 0 || info.vertexStride == 0) return std::nullopt;
+
+		if (mAttributes.empty()) {
+			mVertexStride = info.vertexStride;
+			mAttributes.assign(info.attributes.begin(), info.attributes.end());
+			mPositions = !info.positions.empty();
+		}
+		else if (!compatible(info)) return std::nullopt;
+
+		Range range;
+		range.vertexCount = static_cast<GLsizei>(info.vertices.size_bytes() / info.vertexStride);
+		range.elementCount = static_cast<GLsizei>(info.elements.size_bytes() / info.elementStride);
+
+		bool grown = false;
+
+		if (!mVbo) {
+			reserve(mVbo, mVertices, range.vertexCount, mVertexStride);
+			grown = true;
+		}
+
+		auto vertexOffset = mVertices.allocate(range.vertexCount);
+		if (!vertexOffset.has_value()) {
+			reserve(mVbo, mVertices, range.vertexCount, mVertexStride);
+			vertexOffset = mVertices.allocate(range.vertexCount);
+			grown = true;
+		}
+
+		if (mPositions && mPositionCapacity != mVertices.capacity()) {
+			resizeBuffer(mPositionVbo, static_cast<GLsizeiptr>(mPositionCapacity) * kPositionSize, static_cast<GLsizeiptr>(mVertices.capacity()) * kPositionSize);
+			mPositionCapacity = mVertices.capacity();
+			grown = true;
+		}
+
+		if (!mEbo) {
+			reserve(mEbo, mElements, range.elementCount, sizeof(GLuint));
+			grown = true;
+		}
+
+		auto elementOffset = mElements.allocate(range.elementCount);
+		if (!elementOffset.has_value()) {
+			reserve(mEbo, mElements, range.elementCount, sizeof(GLuint));
+			elementOffset = mElements.allocate(range.elementCount);
+			grown = true;
+		}
+
+		if (grown) attach();
+
+		range.baseVertex = vertexOffset.value();
+		range.firstElement = static_cast<GLuint>(elementOffset.value());
+
+		// Widen elements so every mesh in the pool shares one index type
+		std::vector<GLuint> elements(range.elementCount);
+		for (GLsizei i = 0; i < range.elementCount; ++i) {
+			std::byte const* element = info.elements.data() + i * info.elementStride;
+
+			switch (info.elementStride) {
+			case 1:
+				elements[i] = static_cast<GLuint>(*reinterpret_cast<uint8_t const*>(element));
+				break;
+			case 2: {
+				uint16_t value;
+				memcpy(&value, element, sizeof(value));
+				elements[i] = value;
+				break;
+			}
+			default:
+				memcpy(&elements[i], element, sizeof(GLuint));
+			}
+		}
+
+		uploadBuffer(mVbo, static_cast<GLintptr>(range.baseVertex) * mVertexStride, info.vertices.size_bytes(), info.vertices.data());
+		uploadBuffer(mEbo, static_cast<GLintptr>(range.firstElement) * sizeof(GLuint), elements.size() * sizeof(GLuint), elements.data());
+		if (mPositions) uploadBuffer(mPositionVbo, static_cast<GLintptr>(range.baseVertex) * kPositionSize, info.positions.size_bytes(), info.positions.data());
+
+		return range;
+	}
+
+	void MeshPool::free(Range const& range) {
+		mVertices.free(range.baseVertex, range.vertexCount);
+		mElements.free(static_cast<GLsizei>(range.firstElement), range.elementCount);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glad/gl.h>
+
+#include "he_mesh.hpp"
+
+namespace hyperengine {
+	// Vertex and element storage shared by meshes with a common vertex layout, all drawn through one VAO
+	// The layout is taken from the first allocation, elements are always stored as 32 bit.
+	// Position streams live in a second buffer indexed like the first, with a VAO that shares the elements
+	class MeshPool final {
+	public:
+		struct CreateInfo final {
+			GLsizei vertexCapacity = 1 << 16;
+			GLsizei elementCapacity = 1 << 18;
+			std::string_view label;
+		};
+
+		struct Range final {
+			GLint baseVertex = 0;
+			GLsizei vertexCount = 0;
+			GLuint firstElement = 0;
+			GLsizei elementCount = 0;
+		};
+
+		constexpr MeshPool() noexcept = default;
+		MeshPool(CreateInfo const& info);
+		MeshPool(MeshPool const&) = delete;
+		MeshPool& operator=(MeshPool const&) = delete;
+		inline MeshPool(MeshPool&& other) noexcept { *this = std::move(other); }
+		MeshPool& operator=(MeshPool&& other) noexcept;
+		~MeshPool() noexcept;
+
+		inline GLuint vao(VertexStream stream = VertexStream::kFull) const { return stream == VertexStream::kPosition && mPositions ? mPositionVao : mVao; }
+
+		// Returns nullopt if the mesh is not indexed or its layout differs from the pool
+		std::optional<Range> allocate(Mesh::CreateInfo const& info);
+		void free(Range const& range);
+	private:
+		// First fit allocator over a linear range, adjacent free blocks are merged
+		class FreeList final {
+		public:
+			FreeList() = default;
+			FreeList(GLsizei capacity);
+			std::optional<GLsizei> allocate(GLsizei size);
+			void free(GLsizei offset, GLsizei size);
+			void grow(GLsizei capacity);
+			inline GLsizei capacity() const { return mCapacity; }
+		private:
+			struct Block final {
+				GLsizei offset;
+				GLsizei size;
+			};
+
+			std::vector<Block> mBlocks;
+			GLsizei mCapacity = 0;
+		};
+
+		bool compatible(Mesh::CreateInfo const& info) const;
+		void reserve(GLuint& buffer, FreeList& list, GLsizei required, GLsizei unitSize);
+		void attach();
+
+		std::string mLabel;
+		std::vector<Mesh::Attribute> mAttributes;
+		FreeList mVertices;
+		FreeList mElements;
+		GLuint mVao = 0, mVbo = 0, mEbo = 0;
+		GLuint mPositionVao = 0, mPositionVbo = 0;
+		GLsizei mPositionCapacity = 0; // Vertices the position buffer holds, follows the vertex list
+		GLsizei mVertexStride = 0;
+		bool mPositions = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,339 @@
+#include "he_occlusion.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "he_jobs.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define HE_OCCLUSION_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace {
+	constexpr int kBandHeight = 8;
+
+	// Triangles are clipped to the near plane and a guard band, keeps edge functions precise for huge triangles
+	constexpr float kGuardBand = 2.0f;
+	std::array<glm::vec4, 5> const kClipPlanes = {
+		glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+		glm::vec4(1.0f, 0.0f, 0.0f, kGuardBand),
+		glm::vec4(-1.0f, 0.0f, 0.0f, kGuardBand),
+		glm::vec4(0.0f, 1.0f, 0.0f, kGuardBand),
+		glm::vec4(0.0f, -1.0f, 0.0f, kGuardBand),
+	};
+
+	constexpr size_t kMaxClipVertices = 3 + std::tuple_size_v<decltype(kClipPlanes)>;
+
+	// Edge function `a * x + b * y + c`, positive inside a counter clockwise triangle
+	struct Edge final {
+		float a, b, c;
+
+		Edge(glm::vec3 from, glm::vec3 to) : a(from.y - to.y), b(to.x - from.x), c(-(a * from.x + b * from.y)) {}
+	};
+}
+
+namespace hyperengine {
+	std::shared_ptr<Occluder const> Occluder::fromTriangles(std::span<glm::vec3 const> positions, std::span<uint32_t const> indices) {
+		if (indices.size() / 3 > kTriangleBudget || indices.empty()) return nullptr;
+
+		// Sort positions so duplicates are adjacent
+		std::vector<uint32_t> order(positions.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+			glm::vec3 const& a = positions[lhs];
+			glm::vec3 const& b = positions[rhs];
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			return a.z < b.z;
+		});
+
+		auto occluder = std::make_shared<Occluder>();
+		std::vector<uint32_t> remap(positions.size());
+
+		for (uint32_t i : order) {
+			if (occluder->positions.empty() || occluder->positions.back() != positions[i])
+				occluder->positions.push_back(positions[i]);
+			remap[i] = static_cast<uint32_t>(occluder->positions.size() - 1);
+		}
+
+		occluder->indices.reserve(indices.size());
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			uint32_t a = remap[indices[i + 0]];
+			uint32_t b = remap[indices[i + 1]];
+			uint32_t c = remap[indices[i + 2]];
+			if (a == b || b == c || c == a) continue;
+
+			occluder->indices.insert(occluder->indices.end(), { a, b, c });
+		}
+
+		return occluder;
+	}
+
+	OcclusionBuffer::OcclusionBuffer(CreateInfo const& info) {
+		// Rows are processed four pixels at a time
+		mWidth = std::max((info.width + 3) & ~3, 4);
+		mHeight = std::max(info.height, 1);
+
+		glm::ivec2 size(mWidth, mHeight);
+		while (true) {
+			mLevelSizes.push_back(size);
+			mLevels.emplace_back(static_cast<size_t>(size.x) * size.y, 1.0f);
+			if (size.x == 1 && size.y == 1) break;
+			size = glm::max((size + 1) / 2, glm::ivec2(1));
+		}
+	}
+
+	void OcclusionBuffer::begin(glm::mat4 const& viewProjection) {
+		mViewProjection = viewProjection;
+		mTriangles.clear();
+		mStats = {};
+		std::fill(mLevels[0].begin(), mLevels[0].end(), 1.0f);
+	}
+
+	void OcclusionBuffer::addOccluder(Occluder const& occluder, glm::mat4 const& transform) {
+		glm::mat4 matrix = mViewProjection * transform;
+
+		mClip.resize(occluder.positions.size());
+		for (size_t i = 0; i < occluder.positions.size(); ++i)
+			mClip[i] = matrix * glm::vec4(occluder.positions[i], 1.0f);
+
+		for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+			std::array<glm::vec4, 3> triangle = { mClip[occluder.indices[i]], mClip[occluder.indices[i + 1]], mClip[occluder.indices[i + 2]] };
+
+			// Trivially reject triangles outside any one frustum plane
+			bool outside = false;
+			for (int axis = 0; axis < 3 && !outside; ++axis) {
+				outside |= triangle[0][axis] > triangle[0].w && triangle[1][axis] > triangle[1].w && triangle[2][axis] > triangle[2].w;
+				outside |= triangle[0][axis] < -triangle[0].w && triangle[1][axis] < -triangle[1].w && triangle[2][axis] < -triangle[2].w;
+			}
+
+			if (!outside) clipAndAdd(triangle);
+		}
+
+		++mStats.occluders;
+	}
+
+	void OcclusionBuffer::clipAndAdd(std::span<glm::vec4 const> polygon) {
+		std::array<glm::vec4, kMaxClipVertices> buffers[2];
+		size_t count = polygon.size();
+		std::copy(polygon.begin(), polygon.end(), buffers[0].begin());
+
+		// Sutherland-Hodgman, one plane at a time
+		int current = 0;
+		for (glm::vec4 const& plane : kClipPlanes) {
+			auto const& input = buffers[current];
+			auto& output = buffers[current ^ 1];
+			size_t outputCount = 0;
+
+			for (size_t i = 0; i < count; ++i) {
+				glm::vec4 const& a = input[i];
+				glm::vec4 const& b = input[(i + 1) % count];
+				float da = glm::dot(plane, a);
+				float db = glm::dot(plane, b);
+
+				if (da >= 0.0f) output[outputCount++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f)) output[outputCount++] = a + (b - a) * (da / (da - db));
+			}
+
+			count = outputCount;
+			current ^= 1;
+			if (count < 3) return;
+		}
+
+		std::array<glm::vec3, kMaxClipVertices> window;
+		for (size_t i = 0; i < count; ++i) {
+			glm::vec4 const& clip = buffers[current][i];
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			window[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * mWidth, (ndc.y * 0.5f + 0.5f) * mHeight, ndc.z * 0.5f + 0.5f);
+		}
+
+		for (size_t i = 1; i + 1 < count; ++i) {
+			Triangle triangle{ .vertices = { window[0], window[i], window[i + 1] } };
+			glm::vec3* v = triangle.vertices;
+
+			// Both windings are drawn, occluders are not back face culled
+			float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+			if (std::abs(area) < 1e-6f) continue;
+			if (area < 0.0f) std::swap(v[1], v[2]);
+
+			triangle.minX = std::max(static_cast<int>(std::floor(std::min({ v[0].x, v[1].x, v[2].x }))), 0);
+			triangle.maxX = std::min(static_cast<int>(std::ceil(std::max({ v[0].x, v[1].x, v[2].x }))), mWidth - 1);
+			triangle.minY = std::max(static_cast<int>(std::floor(std::min({ v[0].y, v[1].y, v[2].y }))), 0);
+			triangle.maxY = std::min(static_cast<int>(std::ceil(std::max({ v[0].y, v[1].y, v[2].y }))), mHeight - 1);
+			if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) continue;
+
+			mTriangles.push_back(triangle);
+			++mStats.triangles;
+		}
+	}
+
+	void OcclusionBuffer::rasterize(JobSystem* jobs) {
+		int bands = (mHeight + kBandHeight - 1) / kBandHeight;
+
+		if (jobs)
+			jobs->parallelFor(static_cast<uint32_t>(bands), [this](uint32_t band) { rasterizeBand(static_cast<int>(band)); });
+		else
+			for (int band = 0; band < bands; ++band) rasterizeBand(band);
+
+		buildPyramid();
+	}
+
+	// Every band owns its rows, no synchronization is needed between jobs
+	void OcclusionBuffer::rasterizeBand(int band) {
+		int bandMinY = band * kBandHeight;
+		int bandMaxY = std::min(bandMinY + kBandHeight, mHeight) - 1;
+		float* depth = mLevels[0].data();
+
+		for (Triangle const& triangle : mTriangles) {
+			if (triangle.maxY < bandMinY || triangle.minY > bandMaxY) continue;
+
+			glm::vec3 const* v = triangle.vertices;
+			Edge edges[3] = { Edge(v[1], v[2]), Edge(v[2], v[0]), Edge(v[0], v[1]) };
+
+			// Depth is affine in window space, interpolated with the barycentrics
+			float area = edges[2].a * v[2].x + edges[2].b * v[2].y + edges[2].c;
+			float zA = (edges[0].a * v[0].z + edges[1].a * v[1].z + edges[2].a * v[2].z) / area;
+			float zB = (edges[0].b * v[0].z + edges[1].b * v[1].z + edges[2].b * v[2].z) / area;
+			float zC = (edges[0].c * v[0].z + edges[1].c * v[1].z + edges[2].c * v[2].z) / area;
+
+			int minY = std::max(triangle.minY, bandMinY);
+			int maxY = std::min(triangle.maxY, bandMaxY);
+			int minX = triangle.minX & ~3;
+
+			for (int y = minY; y <= maxY; ++y) {
+				float py = static_cast<float>(y) + 0.5f;
+				float* row = depth + static_cast<size_t>(y) * mWidth;
+				int x = minX;
+
+#ifdef HE_OCCLUSION_SSE2
+				__m128 const offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+				__m128 const zero = _mm_setzero_ps();
+				__m128 rowEdges[3];
+				for (int i = 0; i < 3; ++i)
+					rowEdges[i] = _mm_set1_ps(edges[i].b * py + edges[i].c);
+				__m128 rowDepth = _mm_set1_ps(zB * py + zC);
+
+				for (; x <= triangle.maxX; x += 4) {
+					__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+					__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[0].a), px), rowEdges[0]), zero);
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[1].a), px), rowEdges[1]), zero));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[2].a), px), rowEdges[2]), zero));
+					if (_mm_movemask_ps(inside) == 0) continue;
+
+					__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), rowDepth);
+					__m128 previous = _mm_loadu_ps(row + x);
+					__m128 nearest = _mm_min_ps(previous, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+				}
+#endif
+
+				for (; x <= triangle.maxX; ++x) {
+					float px = static_cast<float>(x) + 0.5f;
+					bool inside = true;
+					for (Edge const& edge : edges)
+						inside &= edge.a * px + edge.b * py + edge.c >= 0.0f;
+					if (!inside) continue;
+
+					float z = zA * px + zB * py + zC;
+					row[x] = std::min(row[x], z);
+				}
+			}
+		}
+	}
+
+	void OcclusionBuffer::buildPyramid() {
+		for (size_t level = 1; level < mLevels.size(); ++level) {
+			glm::ivec2 size = mLevelSizes[level];
+			glm::ivec2 source = mLevelSizes[level - 1];
+			std::vector<float> const& input = mLevels[level - 1];
+			std::vector<float>& output = mLevels[level];
+
+			for (int y = 0; y < size.y; ++y) {
+				int y0 = std::min(y * 2, source.y - 1) * source.x;
+				int y1 = std::min(y * 2 + 1, source.y - 1) * source.x;
+
+				for (int x = 0; x < size.x; ++x) {
+					int x0 = std::min(x * 2, source.x - 1);
+					int x1 = std::min(x * 2 + 1, source.x - 1);
+					output[y * size.x + x] = std::max(std::max(input[y0 + x0], input[y0 + x1]), std::max(input[y1 + x0], input[y1 + x1]));
+				}
+			}
+		}
+	}
+
+	bool OcclusionBuffer::visible(Aabb const& box) const {
+		if (!box.valid()) return true;
+
+		glm::vec2 minWindow(std::numeric_limits<float>::max());
+		glm::vec2 maxWindow(std::numeric_limits<float>::lowest());
+		float nearest = 1.0f;
+
+		for (int i = 0; i < 8; ++i) {
+			glm::vec3 corner(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+			glm::vec4 clip = mViewProjection * glm::vec4(corner, 1.0f);
+
+			// Boxes crossing the near plane are never occluded
+			if (clip.w <= 0.0f || clip.z < -clip.w) return true;
+
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			glm::vec2 window((ndc.x * 0.5f + 0.5f) * mWidth, (ndc.y * 0.5f + 0.5f) * mHeight);
+			minWindow = glm::min(minWindow, window);
+			maxWindow = glm::max(maxWindow, window);
+			nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+		}
+
+		if (maxWindow.x < 0.0f || maxWindow.y < 0.0f || minWindow.x >= mWidth || minWindow.y >= mHeight) return false;
+
+		int x0 = std::clamp(static_cast<int>(minWindow.x), 0, mWidth - 1);
+		int x1 = std::clamp(static_cast<int>(maxWindow.x), 0, mWidth - 1);
+		int y0 = std::clamp(static_cast<int>(minWindow.y), 0, mHeight - 1);
+		int y1 = std::clamp(static_cast<int>(maxWindow.y), 0, mHeight - 1);
+
+		// Coarsest level where the box covers at most 4x4 texels
+		size_t level = 0;
+		while ((x1 - x0 >= 4 || y1 - y0 >= 4) && level + 1 < mLevels.size()) {
+			x0 >>= 1; x1 >>= 1;
+			y0 >>= 1; y1 >>= 1;
+			++level;
+		}
+
+		std::vector<float> const& depth = mLevels[level];
+		int stride = mLevelSizes[level].x;
+
+		for (int y = y0; y <= y1; ++y)
+			for (int x = x0; x <= x1; ++x)
+				if (depth[y * stride + x] >= nearest) return true;
+
+		return false;
+	}
+
+	void OcclusionBuffer::countTests(size_t tests, size_t occluded) {
+		mStats.tests += tests;
+		mStats.occluded += occluded;
+	}
+
+	void OcclusionBuffer::debugImage(std::vector<uint32_t>& pixels) const {
+		std::vector<float> const& depth = mLevels[0];
+		pixels.resize(depth.size());
+
+		float nearest = 1.0f;
+		float farthest = 0.0f;
+		for (float d : depth) {
+			if (d >= 1.0f) continue;
+			nearest = std::min(nearest, d);
+			farthest = std::max(farthest, d);
+		}
+
+		float range = std::max(farthest - nearest, 1e-6f);
+		for (size_t i = 0; i < depth.size(); ++i) {
+			uint32_t gray = 0;
+			if (depth[i] < 1.0f)
+				gray = 64 + static_cast<uint32_t>(191.0f * (1.0f - (depth[i] - nearest) / range));
+			pixels[i] = 0xFF000000u | gray << 16 | gray << 8 | gray;
+		}
+	}
+}
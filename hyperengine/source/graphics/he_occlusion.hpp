@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "he_bounds.hpp"
+
+namespace hyperengine {
+	class JobSystem;
+
+	// Position only triangles rasterized into the occlusion buffer, built at import for meshes cheap enough to occlude
+	struct Occluder final {
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+
+		static constexpr size_t kTriangleBudget = 1024;
+
+		// Welds vertices split by normals or uvs, nullptr if the mesh is over the triangle budget
+		static std::shared_ptr<Occluder const> fromTriangles(std::span<glm::vec3 const> positions, std::span<uint32_t const> indices);
+	};
+
+	// Low resolution depth buffer of the largest occluders with a max depth pyramid for testing boxes
+	// Depth is window space, 0 near and 1 far. Rows are rasterized in bands, one band per job
+	class OcclusionBuffer final {
+	public:
+		struct CreateInfo final {
+			int width = 256;
+			int height = 128;
+		};
+
+		struct Stats final {
+			size_t occluders = 0;
+			size_t triangles = 0;
+			size_t tests = 0;
+			size_t occluded = 0;
+		};
+
+		OcclusionBuffer() : OcclusionBuffer(CreateInfo{}) {}
+		OcclusionBuffer(CreateInfo const& info);
+
+		inline int width() const { return mWidth; }
+		inline int height() const { return mHeight; }
+		inline Stats const& stats() const { return mStats; }
+
+		// Clears the depth and starts collecting occluders seen through `viewProjection`
+		void begin(glm::mat4 const& viewProjection);
+		void addOccluder(Occluder const& occluder, glm::mat4 const& transform);
+		// Without jobs every band is rasterized on the calling thread
+		void rasterize(JobSystem* jobs = nullptr);
+
+		// False only if the box is certainly behind the occluders, safe to call from several threads
+		bool visible(Aabb const& box) const;
+		// Counts a batch of test results into the stats
+		void countTests(size_t tests, size_t occluded);
+
+		// Grayscale RGBA8 with near in white, pixels without occluders are black
+		void debugImage(std::vector<uint32_t>& pixels) const;
+	private:
+		struct Triangle final {
+			glm::vec3 vertices[3]; // Window space x, y in pixels, z depth
+			int minX, maxX, minY, maxY;
+		};
+
+		void clipAndAdd(std::span<glm::vec4 const> polygon);
+		void rasterizeBand(int band);
+		void buildPyramid();
+
+		int mWidth = 0;
+		int mHeight = 0;
+		glm::mat4 mViewProjection{ 1.0f };
+		std::vector<Triangle> mTriangles;
+		std::vector<glm::vec4> mClip;
+		std::vector<std::vector<float>> mLevels; // Level 0 is the rasterized depth, every other level the max of 2x2
+		std::vector<glm::ivec2> mLevelSizes;
+		Stats mStats;
+	};
+}
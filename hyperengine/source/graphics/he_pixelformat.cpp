@@ -10,6 +10,12 @@ namespace hyperengine {
 		case kRgba8: return GL_RGBA8;
 		case kD24: return GL_DEPTH_COMPONENT24;
 		case kRgba32f: return GL_RGBA32F;
+		case kRgba16f: return GL_RGBA16F;
+		case kR11G11B10f: return GL_R11F_G11F_B10F;
+		case kRgb10A2: return GL_RGB10_A2;
+		case kSrgba8: return GL_SRGB8_ALPHA8;
+		case kD32f: return GL_DEPTH_COMPONENT32F;
+		case kD24S8: return GL_DEPTH24_STENCIL8;
 		default: std::unreachable();
 		}
 	}
@@ -17,18 +23,69 @@ namespace hyperengine {
 	GLenum pixelFormatToFormat(PixelFormat format) {
 		switch (format) {
 		case kRgba32f:
+		case kRgba16f:
+		case kRgb10A2:
+		case kSrgba8:
 		case kRgba8: return GL_RGBA;
+		case kR11G11B10f: return GL_RGB;
+		case kD32f:
 		case kD24: return GL_DEPTH_COMPONENT;
+		case kD24S8: return GL_DEPTH_STENCIL;
 		default: std::unreachable();
 		}
 	}
 
 	GLenum pixelFormatToType(PixelFormat format) {
 		switch (format) {
+		case kSrgba8:
 		case kRgba8: return GL_UNSIGNED_BYTE;
+		case kRgba16f: return GL_HALF_FLOAT;
+		case kR11G11B10f: return GL_UNSIGNED_INT_10F_11F_11F_REV;
+		case kRgb10A2: return GL_UNSIGNED_INT_2_10_10_10_REV;
+		case kD24S8: return GL_UNSIGNED_INT_24_8;
 		case kRgba32f:
+		case kD32f:
 		case kD24: return GL_FLOAT;
 		default: std::unreachable();
 		}
 	}
-}
\ No newline at end of file
+
+	char const* pixelFormatName(PixelFormat format) {
+		switch (format) {
+		case kRgba8: return "RGBA8";
+		case kD24: return "D24";
+		case kRgba32f: return "RGBA32F";
+		case kRgba16f: return "RGBA16F";
+		case kR11G11B10f: return "R11G11B10F";
+		case kRgb10A2: return "RGB10A2";
+		case kSrgba8: return "SRGB8_A8";
+		case kD32f: return "D32F";
+		case kD24S8: return "D24S8";
+		default: std::unreachable();
+		}
+	}
+
+	// What the format occupies once stored, D24 is padded to four bytes by every driver
+	size_t pixelFormatSize(PixelFormat format) {
+		switch (format) {
+		case kRgba32f: return 16;
+		case kRgba16f: return 8;
+		case kRgba8:
+		case kR11G11B10f:
+		case kRgb10A2:
+		case kSrgba8:
+		case kD24:
+		case kD32f:
+		case kD24S8: return 4;
+		default: std::unreachable();
+		}
+	}
+
+	bool pixelFormatIsDepth(PixelFormat format) {
+		return format == kD24 || format == kD32f || format == kD24S8;
+	}
+
+	bool pixelFormatHasStencil(PixelFormat format) {
+		return format == kD24S8;
+	}
+}
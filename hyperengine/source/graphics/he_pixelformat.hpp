@@ -1,15 +1,27 @@
 #pragma once
 
+#include <cstddef>
 #include <glad/gl.h>
 
 namespace hyperengine {
 	enum struct PixelFormat {
 		kRgba8,
 		kD24,
-		kRgba32f
+		kRgba32f,
+		kRgba16f,
+		kR11G11B10f, // Unsigned HDR without alpha, a quarter of kRgba32f
+		kRgb10A2,
+		kSrgba8,
+		kD32f,
+		kD24S8
 	};
 
 	GLenum pixelFormatToInternalFormat(PixelFormat format);
 	GLenum pixelFormatToFormat(PixelFormat format);
 	GLenum pixelFormatToType(PixelFormat format);
-}
\ No newline at end of file
+	char const* pixelFormatName(PixelFormat format);
+	// Bytes per pixel
+	size_t pixelFormatSize(PixelFormat format);
+	bool pixelFormatIsDepth(PixelFormat format);
+	bool pixelFormatHasStencil(PixelFormat format);
+}
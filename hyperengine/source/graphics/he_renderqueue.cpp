@@ -0,0 +1,157 @@
+#include "he_renderqueue.hpp"
+
+#include <algorithm>
+
+#include "he_mesh.hpp"
+#include "he_shader.hpp"
+#include "he_texture.hpp"
+
+namespace {
+	template<class Key>
+	uint32_t denseId(std::unordered_map<Key, uint32_t>& ids, Key key, uint32_t limit) {
+		auto [it, inserted] = ids.try_emplace(key, static_cast<uint32_t>(ids.size()));
+		// Past the limit ids alias, sorting degrades but submission stays correct
+		return it->second & (limit - 1);
+	}
+}
+
+namespace hyperengine {
+	uint64_t RenderQueue::makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t mesh, float depth) {
+		constexpr uint32_t kDepthMax = (1u << 20) - 1;
+		uint32_t quantized = static_cast<uint32_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(kDepthMax));
+
+		return static_cast<uint64_t>(pass) << 60
+			| static_cast<uint64_t>(program & 0xFFF) << 48
+			| static_cast<uint64_t>(material & 0xFFFF) << 32
+			| static_cast<uint64_t>(mesh & 0xFFF) << 20
+			| static_cast<uint64_t>(quantized);
+	}
+
+	uint32_t RenderQueue::programId(void const* program) {
+		return denseId(mProgramIds, program, 1u << 12);
+	}
+
+	uint32_t RenderQueue::materialId(uint64_t materialHash) {
+		return denseId(mMaterialIds, materialHash, 1u << 16);
+	}
+
+	uint32_t RenderQueue::meshId(void const* mesh) {
+		return denseId(mMeshIds, mesh, 1u << 12);
+	}
+
+	void RenderQueue::clear() {
+		mItems.clear();
+		mProgramIds.clear();
+		mMaterialIds.clear();
+		mMeshIds.clear();
+	}
+
+	void RenderQueue::push(uint64_t key, uint32_t index) {
+		mItems.push_back({ key, index });
+	}
+
+	// LSD radix sort, 8 bits per pass, passes where every key shares the byte are skipped
+	void RenderQueue::sort() {
+		mScratch.resize(mItems.size());
+
+		std::vector<Item>* src = &mItems;
+		std::vector<Item>* dst = &mScratch;
+
+		for (int shift = 0; shift < 64; shift += 8) {
+			std::array<size_t, 256> counts{};
+
+			for (Item const& item : *src)
+				++counts[(item.key >> shift) & 0xFF];
+
+			if (std::find(counts.begin(), counts.end(), src->size()) != counts.end()) continue;
+
+			size_t offset = 0;
+			for (size_t& count : counts) {
+				size_t current = count;
+				count = offset;
+				offset += current;
+			}
+
+			for (Item const& item : *src)
+				(*dst)[counts[(item.key >> shift) & 0xFF]++] = item;
+
+			std::swap(src, dst);
+		}
+
+		if (src != &mItems) mItems.swap(mScratch);
+	}
+
+	std::span<RenderQueue::Item const> RenderQueue::range(RenderPass pass) const {
+		uint64_t const lower = static_cast<uint64_t>(pass) << 60;
+		uint64_t const upper = lower + (1ull << 60);
+
+		auto first = std::lower_bound(mItems.begin(), mItems.end(), lower, [](Item const& item, uint64_t key) { return item.key < key; });
+		auto last = std::lower_bound(first, mItems.end(), upper, [](Item const& item, uint64_t key) { return item.key < key; });
+		return { first, last };
+	}
+
+	void RenderStateCache::reset() {
+		mProgram = 0;
+		mVao = 0;
+		mTextures.fill(0);
+		mBuffers.fill(0);
+		mBufferOffsets.fill(0);
+		mCull = true;
+		ShaderProgram::invalidateBinding();
+	}
+
+	void RenderStateCache::resetStats() {
+		mStats = {};
+	}
+
+	void RenderStateCache::program(ShaderProgram& program) {
+		++mStats.programs.requested;
+		if (mProgram == program.handle()) return;
+
+		++mStats.programs.applied;
+		mProgram = program.handle();
+		program.bind();
+	}
+
+	void RenderStateCache::texture(Texture& texture, GLuint unit) {
+		++mStats.textures.requested;
+		if (unit < kMaxTextureUnits && mTextures[unit] == texture.handle()) return;
+
+		++mStats.textures.applied;
+		if (unit < kMaxTextureUnits) mTextures[unit] = texture.handle();
+		texture.bind(unit);
+	}
+
+	// Every offset holds a single block, so buffer and offset identify the range
+	void RenderStateCache::uniformBuffer(GLuint buffer, GLuint binding, GLintptr offset, GLsizeiptr size) {
+		++mStats.buffers.requested;
+		if (binding < kMaxBufferBindings && mBuffers[binding] == buffer && mBufferOffsets[binding] == offset) return;
+
+		++mStats.buffers.applied;
+		if (binding < kMaxBufferBindings) {
+			mBuffers[binding] = buffer;
+			mBufferOffsets[binding] = offset;
+		}
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+	}
+
+	void RenderStateCache::mesh(Mesh& mesh, VertexStream stream) {
+		++mStats.meshes.requested;
+		// Pooled meshes share a VAO
+		if (mVao == mesh.vao(stream)) return;
+
+		++mStats.meshes.applied;
+		mVao = mesh.vao(stream);
+		mesh.bind(stream);
+	}
+
+	void RenderStateCache::cull(bool enabled) {
+		++mStats.cullToggles.requested;
+		if (mCull == enabled) return;
+
+		++mStats.cullToggles.applied;
+		mCull = enabled;
+		if (enabled) glEnable(GL_CULL_FACE);
+		else glDisable(GL_CULL_FACE);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include <glad/gl.h>
+
+#include "he_mesh.hpp"
+
+namespace hyperengine {
+	class ShaderProgram;
+	class Texture;
+
+	// Must match `SHADOW_CASCADES` in common.glsl
+	inline constexpr size_t kShadowCascades = 4;
+
+	// Every shadow cascade is its own pass so cascades can be submitted independently.
+	// The depth prepass lays down camera depth so the opaque pass only shades visible fragments
+	enum struct RenderPass : uint8_t {
+		kShadow0,
+		kShadow1,
+		kShadow2,
+		kShadow3,
+		kDepth,
+		kOpaque,
+		kCount,
+	};
+
+	static_assert(static_cast<size_t>(RenderPass::kDepth) == kShadowCascades);
+
+	inline constexpr RenderPass shadowPass(size_t cascade) {
+		return static_cast<RenderPass>(static_cast<size_t>(RenderPass::kShadow0) + cascade);
+	}
+
+	// Draw items sorted by a 64 bit key, most significant first:
+	// pass (4) | program (12) | material (16) | mesh (12) | depth (20)
+	class RenderQueue final {
+	public:
+		struct Item final {
+			uint64_t key;
+			uint32_t index;
+		};
+
+		static uint64_t makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t mesh, float depth);
+
+		// Dense per frame ids, keeps the key fields small no matter the pointer values
+		uint32_t programId(void const* program);
+		uint32_t materialId(uint64_t materialHash);
+		uint32_t meshId(void const* mesh);
+
+		void clear();
+		void push(uint64_t key, uint32_t index);
+		void sort();
+
+		std::span<Item const> range(RenderPass pass) const;
+		inline std::span<Item const> items() const { return mItems; }
+	private:
+		std::vector<Item> mItems;
+		std::vector<Item> mScratch;
+		std::unordered_map<void const*, uint32_t> mProgramIds;
+		std::unordered_map<uint64_t, uint32_t> mMaterialIds;
+		std::unordered_map<void const*, uint32_t> mMeshIds;
+	};
+
+	// Applies GL state only when it differs from what was last set
+	class RenderStateCache final {
+	public:
+		struct Counter final {
+			uint32_t requested = 0;
+			uint32_t applied = 0;
+		};
+
+		struct Stats final {
+			Counter programs;
+			Counter textures;
+			Counter buffers;
+			Counter meshes;
+			Counter cullToggles;
+			uint32_t draws = 0;
+			uint32_t instances = 0;
+		};
+
+		// Forget all tracked state, call at the start of every pass, assumes face culling is enabled
+		void reset();
+		void resetStats();
+
+		void program(ShaderProgram& program);
+		void texture(Texture& texture, GLuint unit);
+		void uniformBuffer(GLuint buffer, GLuint binding, GLintptr offset, GLsizeiptr size);
+		void mesh(Mesh& mesh, VertexStream stream = VertexStream::kFull);
+		void cull(bool enabled);
+		inline void draw(uint32_t instances = 1) { ++mStats.draws; mStats.instances += instances; }
+
+		inline Stats const& stats() const { return mStats; }
+	private:
+		static constexpr size_t kMaxTextureUnits = 16;
+		static constexpr size_t kMaxBufferBindings = 8;
+
+		Stats mStats;
+		GLuint mProgram = 0;
+		GLuint mVao = 0;
+		std::array<GLuint, kMaxTextureUnits> mTextures{};
+		std::array<GLuint, kMaxBufferBindings> mBuffers{};
+		std::array<GLintptr, kMaxBufferBindings> mBufferOffsets{};
+		bool mCull = true;
+	};
+}
\ No newline at end of file
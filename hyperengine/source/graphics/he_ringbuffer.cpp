@@ -0,0 +1,141 @@
+#include "he_ringbuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace {
+	// Keeps every region start valid for any uniform buffer offset alignment seen in practice
+	constexpr GLsizeiptr kRegionGranularity = 256;
+}
+
+namespace hyperengine {
+	RingBuffer::RingBuffer(CreateInfo const& info) : mLabel(info.label) {
+		mRegionSize = std::max<GLsizeiptr>((info.regionSize + kRegionGranularity - 1) / kRegionGranularity * kRegionGranularity, kRegionGranularity);
+		mRegionCount = std::clamp(info.regions, 1u, kMaxRegions);
+		create();
+	}
+
+	RingBuffer& RingBuffer::operator=(RingBuffer&& other) noexcept {
+		std::swap(mLabel, other.mLabel);
+		std::swap(mHandle, other.mHandle);
+		std::swap(mRegionSize, other.mRegionSize);
+		std::swap(mRegionCount, other.mRegionCount);
+		std::swap(mRegion, other.mRegion);
+		std::swap(mHead, other.mHead);
+		std::swap(mFlushed, other.mFlushed);
+		std::swap(mUsed, other.mUsed);
+		std::swap(mMapped, other.mMapped);
+		std::swap(mStaging, other.mStaging);
+		std::swap(mFences, other.mFences);
+		return *this;
+	}
+
+	RingBuffer::~RingBuffer() noexcept {
+		destroy();
+	}
+
+	void RingBuffer::create() {
+		GLsizeiptr size = mRegionSize * mRegionCount;
+
+		if (GLAD_GL_ARB_buffer_storage) {
+			constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+			if (GLAD_GL_ARB_direct_state_access) {
+				glCreateBuffers(1, &mHandle);
+				glNamedBufferStorage(mHandle, size, nullptr, flags);
+				mMapped = static_cast<std::byte*>(glMapNamedBufferRange(mHandle, 0, size, flags));
+			}
+			else {
+				glGenBuffers(1, &mHandle);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, mHandle);
+				glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+				mMapped = static_cast<std::byte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+		}
+		else {
+			glGenBuffers(1, &mHandle);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, mHandle);
+			glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+
+		if (!mMapped)
+			mStaging.resize(static_cast<size_t>(mRegionSize));
+
+		if (GLAD_GL_KHR_debug && !mLabel.empty())
+			glObjectLabel(GL_BUFFER, mHandle, static_cast<GLsizei>(mLabel.size()), mLabel.data());
+
+		mRegion = 0;
+		mHead = 0;
+		mFlushed = 0;
+	}
+
+	void RingBuffer::destroy() noexcept {
+		for (GLsync& fence : mFences) {
+			if (fence) glDeleteSync(fence);
+			fence = nullptr;
+		}
+
+		// Deleting the buffer also unmaps it, the driver keeps the storage alive for draws still reading it
+		if (mHandle)
+			glDeleteBuffers(1, &mHandle);
+
+		mHandle = 0;
+		mMapped = nullptr;
+		mStaging.clear();
+	}
+
+	void RingBuffer::begin(GLsizeiptr reserve) {
+		if (reserve > mRegionSize) {
+			destroy();
+			mRegionSize = std::max((reserve + kRegionGranularity - 1) / kRegionGranularity * kRegionGranularity, mRegionSize * 2);
+			create();
+		}
+
+		if (GLsync& fence = mFences[mRegion]) {
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX) == GL_TIMEOUT_EXPIRED) {}
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+
+		mHead = mRegion * mRegionSize;
+		mFlushed = mHead;
+	}
+
+	RingBuffer::Allocation RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+		GLintptr regionStart = mRegion * mRegionSize;
+		GLintptr offset = (mHead + alignment - 1) / alignment * alignment;
+		assert(offset + size <= regionStart + mRegionSize && "Ring buffer region overflow, reserve more in begin");
+
+		mHead = offset + size;
+		std::byte* pointer = mMapped ? mMapped + offset : mStaging.data() + (offset - regionStart);
+		return { offset, pointer };
+	}
+
+	GLintptr RingBuffer::write(void const* data, GLsizeiptr size, GLsizeiptr alignment) {
+		Allocation allocation = allocate(size, alignment);
+		std::copy_n(static_cast<std::byte const*>(data), size, static_cast<std::byte*>(allocation.pointer));
+		return allocation.offset;
+	}
+
+	void RingBuffer::flush() {
+		// Coherent mappings are visible to every command issued after the write
+		if (mMapped || mHead == mFlushed) return;
+
+		GLintptr regionStart = mRegion * mRegionSize;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mHandle);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, mFlushed, mHead - mFlushed, mStaging.data() + (mFlushed - regionStart));
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mFlushed = mHead;
+	}
+
+	void RingBuffer::end() {
+		flush();
+
+		mUsed = mHead - mRegion * mRegionSize;
+		mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mRegion = (mRegion + 1) % mRegionCount;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <glad/gl.h>
+
+namespace hyperengine {
+	// Transient per frame data, one region per frame in flight. A region is fenced once its frame is submitted
+	// and only rewritten after the gpu passed the fence. Persistently mapped with ARB_buffer_storage,
+	// otherwise writes are staged and uploaded on `flush`
+	class RingBuffer final {
+	public:
+		static constexpr uint32_t kMaxRegions = 4;
+
+		struct CreateInfo final {
+			GLsizeiptr regionSize = 1 << 20;
+			uint32_t regions = 3;
+			std::string_view label;
+		};
+
+		struct Allocation final {
+			GLintptr offset;
+			void* pointer;
+		};
+
+		constexpr RingBuffer() noexcept = default;
+		RingBuffer(CreateInfo const& info);
+		RingBuffer(RingBuffer const&) = delete;
+		RingBuffer& operator=(RingBuffer const&) = delete;
+		inline RingBuffer(RingBuffer&& other) noexcept { *this = std::move(other); }
+		RingBuffer& operator=(RingBuffer&& other) noexcept;
+		~RingBuffer() noexcept;
+
+		inline GLuint handle() const { return mHandle; }
+		inline bool persistent() const { return mMapped != nullptr; }
+		inline GLsizeiptr regionSize() const { return mRegionSize; }
+		// Bytes written during the last finished frame
+		inline GLsizeiptr used() const { return mUsed; }
+
+		// Waits until the gpu is done with the next region, regions grow if `reserve` bytes would not fit
+		void begin(GLsizeiptr reserve);
+		// Space is only checked against what `begin` reserved
+		Allocation allocate(GLsizeiptr size, GLsizeiptr alignment);
+		GLintptr write(void const* data, GLsizeiptr size, GLsizeiptr alignment);
+		// Makes the writes visible to the gpu, call before the first command reading them
+		void flush();
+		// Fences the region, call after the last command reading it
+		void end();
+	private:
+		void create();
+		void destroy() noexcept;
+
+		std::string mLabel;
+		GLuint mHandle = 0;
+		GLsizeiptr mRegionSize = 0;
+		uint32_t mRegionCount = 0;
+		uint32_t mRegion = 0;
+		GLintptr mHead = 0;
+		GLintptr mFlushed = 0;
+		GLsizeiptr mUsed = 0;
+		std::byte* mMapped = nullptr;
+		std::vector<std::byte> mStaging;
+		std::array<GLsync, kMaxRegions> mFences{};
+	};
+}
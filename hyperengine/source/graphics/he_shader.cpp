@@ -1,20 +1,30 @@
 #include "he_shader.hpp"
 
-#include <regex>
+#include <algorithm>
+#include <cstring>
+#include <format>
 #include <spdlog/spdlog.h>
 #include <debug_trap.h>
 #include <glm/gtc/type_ptr.hpp>
 
-#define STB_INCLUDE_IMPLEMENTATION
-#define STB_INCLUDE_LINE_GLSL
-#include <stb_include.h>
+#include "he_lightclusters.hpp"
+#include "he_shadercache.hpp"
+#include "he_shaderpreprocessor.hpp"
 
 namespace {
-	GLuint makeShader(GLenum type, GLchar const* string, GLint length, std::vector<std::string>& errors) {
+	GLuint gBoundProgram = 0;
+
+	constexpr hyperengine::UniformName kTransformName = "uTransform";
+	constexpr hyperengine::UniformName kSkyColorName = "uSkyColor";
+
+	GLuint makeShader(GLenum type, GLchar const* string, GLint length) {
 		GLuint shader = glCreateShader(type);
 		glShaderSource(shader, 1, &string, &length);
 		glCompileShader(shader);
+		return shader;
+	}
 
+	void readShaderLog(GLuint shader, std::vector<std::string>& errors) {
 		GLint param;
 		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &param);
 
@@ -24,49 +34,177 @@ namespace {
 			glGetShaderInfoLog(shader, param, nullptr, error.data());
 			errors.push_back(error);
 		}
-
-		return shader;
 	}
+
+	struct Writer final {
+		std::vector<char>& data;
+
+		void raw(void const* ptr, size_t size) {
+			char const* bytes = static_cast<char const*>(ptr);
+			data.insert(data.end(), bytes, bytes + size);
+		}
+
+		template<class T>
+		void value(T const& v) { raw(&v, sizeof(T)); }
+
+		void string(std::string_view str) {
+			value(static_cast<uint32_t>(str.size()));
+			raw(str.data(), str.size());
+		}
+	};
+
+	struct Reader final {
+		std::vector<char> const& data;
+		size_t cursor = 0;
+		bool good = true;
+
+		void raw(void* ptr, size_t size) {
+			if (!good || cursor + size > data.size()) {
+				good = false;
+				return;
+			}
+
+			std::memcpy(ptr, data.data() + cursor, size);
+			cursor += size;
+		}
+
+		template<class T>
+		T value() { T v{}; raw(&v, sizeof(T)); return v; }
+
+		std::string string() {
+			uint32_t size = value<uint32_t>();
+			if (!good || cursor + size > data.size()) {
+				good = false;
+				return {};
+			}
+
+			std::string str;
+			str.resize(size);
+			raw(str.data(), str.size());
+			return str;
+		}
+	};
 }
 
 namespace hyperengine {
 	ShaderProgram::ShaderProgram(CreateInfo const& info) {
-		std::string source = std::string(info.source);
+		mSource = std::string(info.source);
+		mOrigin = std::string(info.origin);
 
-		// Match engine pragmas
-		{
-			std::regex regex("@(\\w+)\\s+(\\w+)\\s*=\\s*(\\w+)");
+		PreprocessedShader preprocessed = preprocessShader(mSource);
+		mErrors = std::move(preprocessed.errors);
 
-			for (std::sregex_iterator i = std::sregex_iterator(source.begin(), source.end(), regex); i != std::sregex_iterator(); ++i) {
-				std::smatch match = *i;
+		// Apply engine pragmas
+		for (auto const& pragma : preprocessed.pragmas) {
+			if (pragma.name == "property" && pragma.key == "cull")
+				mCull = pragma.value != "0";
 
-				if (match[1] == "property" && match[2] == "cull")
-					mCull = std::stoi(match[3]);
+			if (pragma.name == "property" && pragma.key == "occluder")
+				mOccluder = pragma.value != "0";
 
-				if (match[1] == "edithint")
-					mEditHints[match[2]] = match[3];
+			if (pragma.name == "edithint")
+				mEditHints[pragma.key] = pragma.value;
+
+			if (pragma.name == "variant") {
+				auto it = std::find(kVariantNames.begin(), kVariantNames.end(), pragma.key);
+				if (it != kVariantNames.end())
+					mVariantsDeclared |= 1 << static_cast<int>(it - kVariantNames.begin());
+				else
+					spdlog::warn("{}: Unknown shader variant {}", info.origin, pragma.key);
 			}
-			source = std::regex_replace(source, regex, "// ENGINE PRAGMA APPLIED // $&");
 		}
 
-		char error[256];
-		char* vertSource = stb_include_string(source.data(), (char*)"#version 330 core\n#define VERT", (char*)"./shaders", nullptr, error);
-		char* fragSource = stb_include_string(source.data(), (char*)"#version 330 core\n#define FRAG", (char*)"./shaders", nullptr, error);
+		// Variants the shader never declared would only produce duplicate programs
+		mVariant = info.variant & mVariantsDeclared;
+
+		std::string defines;
+		for (size_t i = 0; i < kVariantNames.size(); ++i) {
+			if (mVariant & (1 << i))
+				defines += std::format("\n#define {}", kVariantNames[i]);
+		}
+
+		std::string vertSource = preprocessed.emit("#version 330 core\n#define VERT" + defines);
+		std::string fragSource = preprocessed.emit("#version 330 core\n#define FRAG" + defines);
+
+		mCacheable = shadercache::supported();
+		mCacheKey = mCacheable ? shadercache::key(vertSource, fragSource) : 0;
+
+		// Try restoring a previously linked binary, any mismatch falls back to a full compile
+		if (mCacheable) {
+			if (auto entry = shadercache::load(mCacheKey)) {
+				mHandle = glCreateProgram();
+				glProgramBinary(mHandle, entry->format, entry->binary.data(), static_cast<GLsizei>(entry->binary.size()));
+
+				GLint linked;
+				glGetProgramiv(mHandle, GL_LINK_STATUS, &linked);
+
+				if (linked == GL_TRUE && deserializeReflection(entry->reflection)) {
+					GLint state;
+					glGetIntegerv(GL_CURRENT_PROGRAM, &state);
+					glUseProgram(mHandle);
+					applyBindings();
+					glUseProgram(static_cast<GLuint>(state));
+					mReady = true;
+					return;
+				}
 
-		GLuint vert = makeShader(GL_VERTEX_SHADER, vertSource, static_cast<int>(strlen(vertSource)), mErrors);
-		GLuint frag = makeShader(GL_FRAGMENT_SHADER, fragSource, static_cast<int>(strlen(fragSource)), mErrors);
+				glDeleteProgram(mHandle);
+				mHandle = 0;
+				mUniforms.clear();
+				mMaterialInfo.clear();
+				mOpaqueAssignments.clear();
+				mMaterialAllocationSize = 0;
+			}
+		}
 
-		free(vertSource);
-		free(fragSource);
+		// Submit only, no state is queried here so the driver is free to compile in the background
+		mVert = makeShader(GL_VERTEX_SHADER, vertSource.data(), static_cast<int>(vertSource.size()));
+		mFrag = makeShader(GL_FRAGMENT_SHADER, fragSource.data(), static_cast<int>(fragSource.size()));
 
 		mHandle = glCreateProgram();
-		glAttachShader(mHandle, vert);
-		glAttachShader(mHandle, frag);
+		if (mCacheable) glProgramParameteri(mHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glAttachShader(mHandle, mVert);
+		glAttachShader(mHandle, mFrag);
 		glLinkProgram(mHandle);
-		glDetachShader(mHandle, vert);
-		glDetachShader(mHandle, frag);
-		glDeleteShader(vert);
-		glDeleteShader(frag);
+	}
+
+	bool ShaderProgram::poll() {
+		if (mReady || mFailed) return true;
+		if (!mHandle) return false;
+
+		if (GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile) {
+			static_assert(GL_COMPLETION_STATUS_KHR == GL_COMPLETION_STATUS_ARB);
+
+			GLint complete;
+			glGetProgramiv(mHandle, GL_COMPLETION_STATUS_KHR, &complete);
+			if (complete == GL_FALSE) return false;
+		}
+
+		finalize();
+		return true;
+	}
+
+	void ShaderProgram::wait() {
+		if (!mReady && !mFailed && mHandle) finalize();
+	}
+
+	void ShaderProgram::waitVariants() {
+		wait();
+
+		for (auto& [mask, program] : mVariants)
+			program->wait();
+	}
+
+	void ShaderProgram::finalize() {
+		readShaderLog(mVert, mErrors);
+		readShaderLog(mFrag, mErrors);
+
+		glDetachShader(mHandle, mVert);
+		glDetachShader(mHandle, mFrag);
+		glDeleteShader(mVert);
+		glDeleteShader(mFrag);
+		mVert = 0;
+		mFrag = 0;
 
 		GLint param;
 		glGetProgramiv(mHandle, GL_INFO_LOG_LENGTH, &param);
@@ -83,11 +221,42 @@ namespace hyperengine {
 				spdlog::error("{}", error);
 		}
 
+		// Nothing to reflect or bind, ready stays false so draws keep using the fallback
+		GLint linked;
+		glGetProgramiv(mHandle, GL_LINK_STATUS, &linked);
+		if (linked != GL_TRUE) {
+			spdlog::error("{}: Shader program failed to link", mOrigin);
+			mFailed = true;
+			return;
+		}
+
 		GLint state;
 		glGetIntegerv(GL_CURRENT_PROGRAM, &state);
 		glUseProgram(mHandle);
+		reflect();
+		resolveHandles();
+		applyBindings();
+		glUseProgram(static_cast<GLuint>(state));
+
+		// Only clean programs are cached, warnings should show up again on the next run
+		if (mCacheable && mErrors.empty()) {
+			GLint length;
+			glGetProgramiv(mHandle, GL_PROGRAM_BINARY_LENGTH, &length);
+
+			if (length > 0) {
+				shadercache::Entry entry;
+				entry.binary.resize(length);
+				glGetProgramBinary(mHandle, length, nullptr, &entry.format, entry.binary.data());
+				entry.reflection = serializeReflection();
+				shadercache::store(mCacheKey, entry);
+			}
+		}
+
+		mReady = true;
+	}
 
-		// Read all uniforms ahead of time, no need to constantly look these up every frame
+	// Read all uniforms ahead of time, no need to constantly look these up every frame
+	void ShaderProgram::reflect() {
 		GLuint uniformCount;
 		glGetProgramiv(mHandle, GL_ACTIVE_UNIFORMS, reinterpret_cast<GLint*>(&uniformCount));
 
@@ -118,8 +287,7 @@ namespace hyperengine {
 					mUniforms.insert(std::make_pair(std::string(uniformName.get(), length), Uniform(location, UniformType(type), offset, blockIndex)));
 
 					// Automatically assign opaques
-					if (type == GL_SAMPLER_2D) {
-						glUniform1i(location, opaqueAssignment);
+					if (type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_ARRAY) {
 						mOpaqueAssignments[std::string(uniformName.get(), length)] = opaqueAssignment;
 						++opaqueAssignment;
 					}
@@ -127,77 +295,154 @@ namespace hyperengine {
 			}
 		}
 
-		GLuint blockCount;
-		glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_BLOCKS, reinterpret_cast<GLint*>(&blockCount));
+		GLuint blockIndex = glGetUniformBlockIndex(mHandle, "Material");
 
-		if (blockCount != 0) {
-			GLint maxNameLength;
-			glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxNameLength);
-			std::unique_ptr<char[]> blockName = std::make_unique<char[]>(maxNameLength);
+		if (blockIndex != GL_INVALID_INDEX) {
+			GLuint i = blockIndex;
+
+			GLint memorySize;
+			glGetActiveUniformBlockiv(mHandle, i, GL_UNIFORM_BLOCK_DATA_SIZE, &memorySize);
+			mMaterialAllocationSize = memorySize;
+
+			GLuint activeUniformCount;
+			glGetActiveUniformBlockiv(mHandle, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, reinterpret_cast<GLint*>(&activeUniformCount));
+
+			std::vector<GLuint> activeUniforms;
+			activeUniforms.resize(activeUniformCount);
+			glGetActiveUniformBlockiv(mHandle, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, (GLint*)activeUniforms.data());
 
+			GLint uniformMaxNameLength;
+			glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformMaxNameLength);
+			std::unique_ptr<char[]> uniformName = std::make_unique<char[]>(uniformMaxNameLength);
 
-			for (GLuint i = 0; i < blockCount; ++i) {
+			for (GLuint iUniform = 0; iUniform < activeUniformCount; ++iUniform) {
 				GLsizei length;
-				
-				glGetActiveUniformBlockName(mHandle, i, maxNameLength, &length, blockName.get());
+				GLsizei count;
+				GLenum type;
+				glGetActiveUniform(mHandle, activeUniforms[iUniform], uniformMaxNameLength, &length, &count, &type, uniformName.get());
 
-				if (std::string_view(blockName.get()) == "EngineData") {
-					glUniformBlockBinding(mHandle, i, 0);
-				}
+				GLint offset;
+				glGetActiveUniformsiv(mHandle, 1, &activeUniforms[iUniform], GL_UNIFORM_OFFSET, &offset);
+
+				mMaterialInfo[std::string(uniformName.get(), length)] = { .location = 0, .type = UniformType(type), .offset = offset, .blockIndex = -1 };
+			}
+		}
+	}
+
+	// Engine builtins are looked up once here so draws never touch a name
+	void ShaderProgram::resolveHandles() {
+		mUniformsByHash.clear();
+		for (auto const& entry : mUniforms)
+			mUniformsByHash.try_emplace(fnv1a(entry.first), &entry);
 
-				if (std::string_view(blockName.get()) == "Material") {
-					glUniformBlockBinding(mHandle, i, 1);
+		mTransformHandle = uniformHandle<glm::mat4>(kTransformName);
+		mSkyColorHandle = uniformHandle<glm::vec3>(kSkyColorName);
+	}
 
-					GLint memorySize;
-					glGetActiveUniformBlockiv(mHandle, i, GL_UNIFORM_BLOCK_DATA_SIZE, &memorySize);
-					mMaterialAllocationSize = memorySize;
+	// Sampler units and block bindings are program state, these are lost when a binary is reloaded
+	void ShaderProgram::applyBindings() {
+		for (auto const& [name, unit] : mOpaqueAssignments)
+			glUniform1i(getUniformLocation(name), unit);
 
-					GLuint activeUniformCount;
-					glGetActiveUniformBlockiv(mHandle, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, reinterpret_cast<GLint*>(&activeUniformCount));
+		// Buffer samplers are not reflected, the cluster buffers keep fixed units for every program
+		constexpr char const* kLightBuffers[] = { "tLightData", "tLightGrid", "tLightIndices" };
+		for (GLuint i = 0; i < 3; ++i) {
+			GLint location = glGetUniformLocation(mHandle, kLightBuffers[i]);
+			if (location != -1) glUniform1i(location, static_cast<GLint>(kLightClusterUnit + i));
+		}
 
-					std::vector<GLuint> activeUniforms;
-					activeUniforms.resize(activeUniformCount);
-					glGetActiveUniformBlockiv(mHandle, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, (GLint*)activeUniforms.data());
+		GLuint engineDataIndex = glGetUniformBlockIndex(mHandle, "EngineData");
+		if (engineDataIndex != GL_INVALID_INDEX) glUniformBlockBinding(mHandle, engineDataIndex, 0);
 
-					GLint uniformMaxNameLength;
-					glGetProgramiv(mHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformMaxNameLength);
-					std::unique_ptr<char[]> uniformName = std::make_unique<char[]>(uniformMaxNameLength);
+		GLuint materialIndex = glGetUniformBlockIndex(mHandle, "Material");
+		if (materialIndex != GL_INVALID_INDEX) glUniformBlockBinding(mHandle, materialIndex, 1);
+	}
 
-					for (GLuint iUniform = 0; iUniform < activeUniformCount; ++iUniform) {
-						GLsizei length;
-						GLsizei count;
-						GLenum type;
-						glGetActiveUniform(mHandle, activeUniforms[iUniform], uniformMaxNameLength, &length, &count, &type, uniformName.get());
+	std::vector<char> ShaderProgram::serializeReflection() const {
+		std::vector<char> data;
+		Writer writer{ data };
 
-						GLint offset;
-						glGetActiveUniformsiv(mHandle, 1, &activeUniforms[iUniform], GL_UNIFORM_OFFSET, &offset);
+		writer.value(static_cast<uint32_t>(mUniforms.size()));
+		for (auto const& [name, uniform] : mUniforms) {
+			writer.string(name);
+			writer.value(uniform);
+		}
 
+		writer.value(static_cast<uint32_t>(mMaterialInfo.size()));
+		for (auto const& [name, uniform] : mMaterialInfo) {
+			writer.string(name);
+			writer.value(uniform);
+		}
 
-						mMaterialInfo[std::string(uniformName.get(), length)] = { .location = 0, .type = UniformType(type), .offset = offset, .blockIndex = -1 };
-					}
-				}
-			}
+		writer.value(static_cast<uint32_t>(mOpaqueAssignments.size()));
+		for (auto const& [name, unit] : mOpaqueAssignments) {
+			writer.string(name);
+			writer.value(unit);
 		}
 
-		glUseProgram(static_cast<GLuint>(state));
-		mOrigin = std::string(info.origin);
+		writer.value(mMaterialAllocationSize);
+		return data;
+	}
+
+	bool ShaderProgram::deserializeReflection(std::vector<char> const& data) {
+		Reader reader{ data };
+
+		for (uint32_t i = 0, count = reader.value<uint32_t>(); reader.good && i < count; ++i) {
+			std::string name = reader.string();
+			mUniforms[std::move(name)] = reader.value<Uniform>();
+		}
+
+		for (uint32_t i = 0, count = reader.value<uint32_t>(); reader.good && i < count; ++i) {
+			std::string name = reader.string();
+			mMaterialInfo[std::move(name)] = reader.value<Uniform>();
+		}
+
+		for (uint32_t i = 0, count = reader.value<uint32_t>(); reader.good && i < count; ++i) {
+			std::string name = reader.string();
+			mOpaqueAssignments[std::move(name)] = reader.value<int>();
+		}
+
+		mMaterialAllocationSize = reader.value<int>();
+		if (!reader.good || reader.cursor != data.size()) return false;
+
+		resolveHandles();
+		return true;
 	}
 
 	ShaderProgram& ShaderProgram::operator=(ShaderProgram&& other) noexcept {
 		std::swap(mOrigin, other.mOrigin);
+		std::swap(mSource, other.mSource);
 		std::swap(mHandle, other.mHandle);
 		std::swap(mUniforms, other.mUniforms);
+		std::swap(mUniformsByHash, other.mUniformsByHash);
+		std::swap(mTransformHandle, other.mTransformHandle);
+		std::swap(mSkyColorHandle, other.mSkyColorHandle);
 		std::swap(mErrors, other.mErrors);
 		std::swap(mCull, other.mCull);
+		std::swap(mOccluder, other.mOccluder);
 		std::swap(mOpaqueAssignments, other.mOpaqueAssignments);
 		std::swap(mMaterialInfo, other.mMaterialInfo);
 		std::swap(mMaterialAllocationSize, other.mMaterialAllocationSize);
 		std::swap(mEditHints, other.mEditHints);
+		std::swap(mCacheKey, other.mCacheKey);
+		std::swap(mVert, other.mVert);
+		std::swap(mFrag, other.mFrag);
+		std::swap(mCacheable, other.mCacheable);
+		std::swap(mReady, other.mReady);
+		std::swap(mFailed, other.mFailed);
+		std::swap(mVariants, other.mVariants);
+		std::swap(mVariant, other.mVariant);
+		std::swap(mVariantsDeclared, other.mVariantsDeclared);
+		std::swap(mVariantAdopted, other.mVariantAdopted);
 		return *this;
 	}
 
 	ShaderProgram::~ShaderProgram() noexcept {
+		if (mVert) glDeleteShader(mVert);
+		if (mFrag) glDeleteShader(mFrag);
+
 		if (mHandle) {
+			if (gBoundProgram == mHandle) gBoundProgram = 0;
 			glDeleteProgram(mHandle);
 		}
 	}
@@ -245,6 +490,48 @@ namespace hyperengine {
 	}
 
 	void ShaderProgram::bind() {
+		if (gBoundProgram == mHandle) return;
+		glUseProgram(mHandle);
+		gBoundProgram = mHandle;
+	}
+
+	void ShaderProgram::invalidateBinding() {
+		gBoundProgram = 0;
+	}
+
+	ShaderProgram& ShaderProgram::variant(VariantMask mask) {
+		mask &= mVariantsDeclared;
+		if (mask == mVariant) return *this;
+
+		std::unique_ptr<ShaderProgram>& slot = mVariants[mask];
+		if (!slot) slot = std::make_unique<ShaderProgram>(CreateInfo{ .source = mSource, .origin = mOrigin, .variant = mask });
+		if (!slot->poll() || slot->failed() || !mReady) return *this;
+
+		if (!slot->mVariantAdopted) {
+			slot->adoptAssignments(*this);
+			slot->mVariantAdopted = true;
+		}
+
+		return *slot;
+	}
+
+	// Callers bind textures using the units of the base program, so variants must agree on them
+	// Samplers only the variant declares are moved above every unit of the base
+	void ShaderProgram::adoptAssignments(ShaderProgram const& base) {
+		GLint state;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &state);
 		glUseProgram(mHandle);
+
+		int nextUnit = 0;
+		for (auto const& [name, unit] : base.mOpaqueAssignments)
+			nextUnit = std::max(nextUnit, unit + 1);
+
+		for (auto& [name, unit] : mOpaqueAssignments) {
+			auto it = base.mOpaqueAssignments.find(name);
+			unit = it == base.mOpaqueAssignments.end() ? nextUnit++ : it->second;
+			glUniform1i(getUniformLocation(name), unit);
+		}
+
+		glUseProgram(static_cast<GLuint>(state));
 	}
 }
\ No newline at end of file
@@ -1,23 +1,58 @@
 #pragma once
 
+#include <array>
+#include <memory>
 #include <unordered_map>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <cstdint>
 #include <vector>
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
+#include "../he_util.hpp"
+
 namespace hyperengine {
+	// Uniform name hashed at compile time, eg: `constexpr UniformName kTime = "uTime";`
+	struct UniformName final {
+		uint64_t hash;
+		std::string_view name;
+
+		constexpr UniformName(char const* str) : hash(fnv1a(str)), name(str) {}
+	};
+
+	// Location resolved once per program, setters taking a handle do no lookups
+	template<class T>
+	struct UniformHandle final {
+		GLint location = -1;
+		inline explicit operator bool() const { return location != -1; }
+	};
+
 	class ShaderProgram final {
 	public:
+		// Permutation keys, a shader opts into each with `@variant NAME`
+		using VariantMask = uint32_t;
+		static constexpr VariantMask kVariantFast = 1 << 0;
+		static constexpr VariantMask kVariantShadows = 1 << 1;
+		static constexpr VariantMask kVariantAlphaTest = 1 << 2;
+		static constexpr VariantMask kVariantInstancing = 1 << 3;
+		static constexpr VariantMask kVariantTextureArrays = 1 << 4;
+		static constexpr VariantMask kVariantDefault = kVariantShadows | kVariantAlphaTest;
+		static constexpr std::array<std::string_view, 5> kVariantNames = { "FAST", "SHADOWS", "ALPHA_TEST", "INSTANCING", "TEXTURE_ARRAYS" };
+
 		struct CreateInfo final {
 			std::string_view source;
 			std::string_view origin;
+			VariantMask variant = kVariantDefault;
 		};
 
 		enum struct UniformType : GLenum {
+			kInt = GL_INT,
 			kSampler2D = GL_SAMPLER_2D,
+			kSampler2DArray = GL_SAMPLER_2D_ARRAY,
+			kSamplerBuffer = GL_SAMPLER_BUFFER,
+			kUnsignedSamplerBuffer = GL_UNSIGNED_INT_SAMPLER_BUFFER,
 			kFloat = GL_FLOAT,
 			kVec2f = GL_FLOAT_VEC2,
 			kVec3f = GL_FLOAT_VEC3,
@@ -43,7 +78,13 @@ namespace hyperengine {
 		~ShaderProgram() noexcept;
 
 		inline std::string const& origin() const { return mOrigin; }
+		inline bool ready() const { return mReady; }
+		// Linking failed, the program never becomes ready and draws should use a fallback
+		inline bool failed() const { return mFailed; }
+		inline VariantMask variants() const { return mVariantsDeclared; }
+		inline VariantMask variantMask() const { return mVariant; }
 		inline bool cull() const { return mCull; }
+		inline bool occluder() const { return mOccluder; }
 		inline GLuint handle() const { return mHandle; }
 		inline std::vector<std::string> const& errors() const { return mErrors; }
 		inline auto const& opaqueAssignments() const { return mOpaqueAssignments; };
@@ -61,8 +102,42 @@ namespace hyperengine {
 		void uniform4f(std::string_view name, glm::vec4 const& v0);
 		void uniformMat4f(std::string_view name, glm::mat4 const& v0);
 
+		// Skips the call if this program is known to be bound already
 		void bind();
+		// Forget the bound program, call when something else may have changed it
+		static void invalidateBinding();
+
+		template<class T>
+		UniformHandle<T> uniformHandle(UniformName name) const;
+		inline UniformHandle<glm::mat4> transformHandle() const { return mTransformHandle; }
+		inline UniformHandle<glm::vec3> skyColorHandle() const { return mSkyColorHandle; }
+
+		// These expect the program to be bound
+		inline void uniform(UniformHandle<int> handle, int v0) { glUniform1i(handle.location, v0); }
+		inline void uniform(UniformHandle<float> handle, float v0) { glUniform1f(handle.location, v0); }
+		inline void uniform(UniformHandle<glm::vec2> handle, glm::vec2 const& v0) { glUniform2fv(handle.location, 1, &v0[0]); }
+		inline void uniform(UniformHandle<glm::vec3> handle, glm::vec3 const& v0) { glUniform3fv(handle.location, 1, &v0[0]); }
+		inline void uniform(UniformHandle<glm::vec4> handle, glm::vec4 const& v0) { glUniform4fv(handle.location, 1, &v0[0]); }
+		inline void uniform(UniformHandle<glm::mat4> handle, glm::mat4 const& v0) { glUniformMatrix4fv(handle.location, 1, GL_FALSE, &v0[0][0]); }
+
+		// Returns the permutation for the mask, compiling it on first use
+		// Until the permutation is ready this program is returned instead
+		ShaderProgram& variant(VariantMask mask);
+
+		// Compilation is submitted on construction and only finished once the driver reports completion
+		bool poll();
+		void wait();
+		// Also finishes every permutation requested so far
+		void waitVariants();
 	private:
+		void finalize();
+		void adoptAssignments(ShaderProgram const& base);
+		void resolveHandles();
+		void reflect();
+		void applyBindings();
+		std::vector<char> serializeReflection() const;
+		bool deserializeReflection(std::vector<char> const& data);
+
 		struct Hash final {
 			using hash_type = std::hash<std::string_view>;
 			using is_transparent = void;
@@ -71,14 +146,68 @@ namespace hyperengine {
 			std::size_t operator()(std::string const& str) const { return hash_type{}(str); }
 		};
 
+		// Keys are already fnv1a hashes, values point into mUniforms so colliding names can be told apart
+		struct IdentityHash final {
+			std::size_t operator()(uint64_t hash) const { return static_cast<std::size_t>(hash); }
+		};
+
 		std::string mOrigin;
+		std::string mSource;
 		GLuint mHandle = 0;
 		std::unordered_map<std::string, Uniform, Hash, std::equal_to<>> mUniforms;
+		std::unordered_map<uint64_t, decltype(mUniforms)::value_type const*, IdentityHash> mUniformsByHash;
 		std::unordered_map<std::string, Uniform, Hash, std::equal_to<>> mMaterialInfo;
 		std::unordered_map<std::string, int, Hash, std::equal_to<>> mOpaqueAssignments;
 		std::unordered_map<std::string, std::string, Hash, std::equal_to<>> mEditHints;
+		std::unordered_map<VariantMask, std::unique_ptr<ShaderProgram>> mVariants;
 		std::vector<std::string> mErrors;
+		UniformHandle<glm::mat4> mTransformHandle;
+		UniformHandle<glm::vec3> mSkyColorHandle;
+		uint64_t mCacheKey = 0;
+		GLuint mVert = 0;
+		GLuint mFrag = 0;
 		int mMaterialAllocationSize = 0;
+		VariantMask mVariant = 0;
+		VariantMask mVariantsDeclared = 0;
 		bool mCull = true;
+		bool mOccluder = true;
+		bool mVariantAdopted = false;
+		bool mCacheable = false;
+		bool mReady = false;
+		bool mFailed = false;
 	};
+
+	template<class T>
+	inline constexpr ShaderProgram::UniformType kUniformTypeOf = static_cast<ShaderProgram::UniformType>(0);
+	template<> inline constexpr ShaderProgram::UniformType kUniformTypeOf<int> = ShaderProgram::UniformType::kInt;
+	template<> inline constexpr ShaderProgram::UniformType kUniformTypeOf<float> = ShaderProgram::UniformType::kFloat;
+	template<> inline constexpr ShaderProgram::UniformType kUniformTypeOf<glm::vec2> = ShaderProgram::UniformType::kVec2f;
+	template<> inline constexpr ShaderProgram::UniformType kUniformTypeOf<glm::vec3> = ShaderProgram::UniformType::kVec3f;
+	template<> inline constexpr ShaderProgram::UniformType kUniformTypeOf<glm::vec4> = ShaderProgram::UniformType::kVec4f;
+	template<> inline constexpr ShaderProgram::UniformType kUniformTypeOf<glm::mat4> = ShaderProgram::UniformType::kMat4f;
+
+	template<class T>
+	constexpr bool acceptsUniformType(ShaderProgram::UniformType type) { return type == kUniformTypeOf<T>; }
+
+	// Samplers are set through integers as well
+	template<>
+	constexpr bool acceptsUniformType<int>(ShaderProgram::UniformType type) {
+		using enum ShaderProgram::UniformType;
+		return type == kInt || type == kSampler2D || type == kSampler2DArray || type == kSamplerBuffer || type == kUnsignedSamplerBuffer;
+	}
+
+	// Returns an invalid handle if the uniform is missing or declared with a different type
+	template<class T>
+	UniformHandle<T> ShaderProgram::uniformHandle(UniformName name) const {
+		Uniform const* uniform = nullptr;
+
+		// A different name with the same hash only costs a string lookup
+		if (auto it = mUniformsByHash.find(name.hash); it != mUniformsByHash.end() && it->second->first == name.name)
+			uniform = &it->second->second;
+		else if (auto named = mUniforms.find(name.name); named != mUniforms.end())
+			uniform = &named->second;
+
+		if (!uniform || !acceptsUniformType<T>(uniform->type)) return {};
+		return { uniform->location };
+	}
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "he_shadercache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <system_error>
+
+#include <spdlog/spdlog.h>
+
+#include "he_gl.hpp"
+#include "../he_io.hpp"
+#include "../he_util.hpp"
+
+namespace {
+	// Bump whenever the reflection layout or the preprocessor output changes
+	constexpr uint32_t kVersion = 1;
+	constexpr uint32_t kMagic = 'H' | 'E' << 8 | 'S' << 16 | 'C' << 24;
+	constexpr char const* kDirectory = "./cache/shaders";
+
+	struct Header final {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;
+		uint32_t binarySize;
+		uint32_t reflectionSize;
+		uint32_t reserved;
+	};
+
+	std::string pathOf(uint64_t key) {
+		return std::format("{}/{:016x}.bin", kDirectory, key);
+	}
+}
+
+namespace hyperengine::shadercache {
+	bool supported() {
+		return GLAD_GL_ARB_get_program_binary && glContextInfo().programBinaryFormats > 0;
+	}
+
+	uint64_t key(std::string_view vertSource, std::string_view fragSource) {
+		GlContextInfo const& info = glContextInfo();
+
+		uint64_t hash = fnv1a(std::string_view(reinterpret_cast<char const*>(&kVersion), sizeof(kVersion)));
+		hash = fnv1a(info.vendor, hash);
+		hash = fnv1a(info.renderer, hash);
+		hash = fnv1a(info.version, hash);
+		hash = fnv1a(vertSource, hash);
+		hash = fnv1a(fragSource, hash);
+		return hash;
+	}
+
+	std::optional<Entry> load(uint64_t key) {
+		auto file = readFileBinary(pathOf(key).c_str());
+		if (!file.has_value()) return std::nullopt;
+
+		std::vector<char> const& data = file.value();
+		if (data.size() < sizeof(Header)) return std::nullopt;
+
+		Header header;
+		std::memcpy(&header, data.data(), sizeof(Header));
+
+		if (header.magic != kMagic || header.version != kVersion || header.key != key) return std::nullopt;
+		if (data.size() != sizeof(Header) + header.binarySize + header.reflectionSize) return std::nullopt;
+
+		char const* binary = data.data() + sizeof(Header);
+		char const* reflection = binary + header.binarySize;
+
+		Entry entry;
+		entry.format = header.format;
+		entry.binary.assign(binary, binary + header.binarySize);
+		entry.reflection.assign(reflection, reflection + header.reflectionSize);
+		return entry;
+	}
+
+	void store(uint64_t key, Entry const& entry) {
+		std::error_code ec;
+		std::filesystem::create_directories(kDirectory, ec);
+
+		if (ec) {
+			spdlog::warn("Failed to create shader cache directory: {}", ec.message());
+			return;
+		}
+
+		Header header{};
+		header.magic = kMagic;
+		header.version = kVersion;
+		header.key = key;
+		header.format = entry.format;
+		header.binarySize = static_cast<uint32_t>(entry.binary.size());
+		header.reflectionSize = static_cast<uint32_t>(entry.reflection.size());
+
+		std::vector<char> data(sizeof(Header) + entry.binary.size() + entry.reflection.size());
+		std::memcpy(data.data(), &header, sizeof(Header));
+		std::memcpy(data.data() + sizeof(Header), entry.binary.data(), entry.binary.size());
+		std::memcpy(data.data() + sizeof(Header) + entry.binary.size(), entry.reflection.data(), entry.reflection.size());
+
+		writeFile(pathOf(key).c_str(), data.data(), data.size());
+	}
+
+	void clear() {
+		std::error_code ec;
+		std::filesystem::remove_all(kDirectory, ec);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <glad/gl.h>
+
+// On disk cache of linked program binaries
+// Keyed on the fully preprocessed stage sources and the driver identity
+namespace hyperengine::shadercache {
+	struct Entry final {
+		GLenum format = 0;
+		std::vector<char> binary;
+		std::vector<char> reflection;
+	};
+
+	bool supported();
+	uint64_t key(std::string_view vertSource, std::string_view fragSource);
+	std::optional<Entry> load(uint64_t key);
+	void store(uint64_t key, Entry const& entry);
+	void clear();
+}
\ No newline at end of file
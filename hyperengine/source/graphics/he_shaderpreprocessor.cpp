@@ -0,0 +1,161 @@
+#include "he_shaderpreprocessor.hpp"
+
+#include <format>
+
+#include "../he_io.hpp"
+#include "../he_util.hpp"
+
+namespace {
+	constexpr int kMaxIncludeDepth = 32;
+
+	hyperengine::UnorderedStringMap<std::string> gIncludeCache;
+
+	std::string const* loadInclude(std::string const& path) {
+		auto it = gIncludeCache.find(path);
+		if (it != gIncludeCache.end()) return &it->second;
+
+		auto file = hyperengine::readFileString(path.c_str());
+		if (!file.has_value()) return nullptr;
+
+		return &gIncludeCache.emplace(path, std::move(file.value())).first->second;
+	}
+
+	bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	bool isWord(char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+
+	void skipBlank(std::string_view& str) {
+		while (!str.empty() && isBlank(str.front())) str.remove_prefix(1);
+	}
+
+	std::string_view nextWord(std::string_view& str) {
+		skipBlank(str);
+		size_t length = 0;
+		while (length < str.size() && isWord(str[length])) ++length;
+		std::string_view word = str.substr(0, length);
+		str.remove_prefix(length);
+		return word;
+	}
+
+	// Returns true if `str` starts with the directive `name` as a whole word
+	bool consumeDirective(std::string_view& str, std::string_view name) {
+		if (!str.starts_with(name)) return false;
+		if (str.size() > name.size() && !isBlank(str[name.size()])) return false;
+		str.remove_prefix(name.size());
+		return true;
+	}
+
+	struct Context final {
+		hyperengine::PreprocessedShader& result;
+		std::string_view directory;
+		int fileCount = 0;
+	};
+
+	void process(Context& ctx, std::string_view text, int fileIndex, int depth) {
+		int lineNumber = 1;
+		size_t cursor = 0;
+
+		while (cursor < text.size()) {
+			size_t end = text.find('\n', cursor);
+			bool newline = end != std::string_view::npos;
+			if (!newline) end = text.size();
+
+			std::string_view line = text.substr(cursor, end - cursor);
+			cursor = newline ? end + 1 : end;
+
+			std::string_view statement = line;
+			skipBlank(statement);
+
+			if (statement.starts_with('#')) {
+				std::string_view directive = statement.substr(1);
+				skipBlank(directive);
+
+				if (consumeDirective(directive, "include")) {
+					skipBlank(directive);
+					size_t close = directive.find('"', 1);
+
+					if (directive.starts_with('"') && close != std::string_view::npos) {
+						std::string path = std::format("{}/{}", ctx.directory, directive.substr(1, close - 1));
+						std::string const* include = depth < kMaxIncludeDepth ? loadInclude(path) : nullptr;
+
+						if (include) {
+							int includeIndex = ++ctx.fileCount;
+							ctx.result.chunks.back() += std::format("#line 1 {}\n", includeIndex);
+							process(ctx, *include, includeIndex, depth + 1);
+							ctx.result.chunks.back() += std::format("\n#line {} {}\n", lineNumber + 1, fileIndex);
+							++lineNumber;
+							continue;
+						}
+
+						if (depth >= kMaxIncludeDepth)
+							ctx.result.errors.push_back(std::format("Error: include depth exceeded at '{}'", path));
+						else
+							ctx.result.errors.push_back(std::format("Error: couldn't load '{}'", path));
+					}
+				}
+				else if (consumeDirective(directive, "inject")) {
+					ctx.result.chunks.emplace_back(std::format("\n#line {} {}\n", lineNumber + 1, fileIndex));
+					++lineNumber;
+					continue;
+				}
+			}
+			else if (statement.starts_with('@')) {
+				std::string_view rest = statement.substr(1);
+				hyperengine::ShaderPragma pragma;
+				pragma.name = nextWord(rest);
+				pragma.key = nextWord(rest);
+
+				skipBlank(rest);
+				if (rest.starts_with('=')) {
+					rest.remove_prefix(1);
+					pragma.value = nextWord(rest);
+				}
+
+				if (!pragma.name.empty() && !pragma.key.empty()) {
+					ctx.result.pragmas.push_back(std::move(pragma));
+					ctx.result.chunks.back() += "// ENGINE PRAGMA APPLIED // ";
+				}
+			}
+
+			std::string& out = ctx.result.chunks.back();
+			out += line;
+			if (newline) out += '\n';
+			++lineNumber;
+		}
+	}
+}
+
+namespace hyperengine {
+	std::string PreprocessedShader::emit(std::string_view inject) const {
+		size_t size = 0;
+		for (auto const& chunk : chunks)
+			size += chunk.size() + inject.size();
+
+		std::string source;
+		source.reserve(size);
+
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			if (i != 0) source += inject;
+			source += chunks[i];
+		}
+
+		return source;
+	}
+
+	PreprocessedShader preprocessShader(std::string_view source, std::string_view includeDirectory) {
+		PreprocessedShader result;
+		result.chunks.emplace_back();
+
+		Context ctx{ .result = result, .directory = includeDirectory };
+		process(ctx, source, 0, 0);
+		return result;
+	}
+
+	void clearShaderIncludeCache() {
+		gIncludeCache.clear();
+	}
+}
\ No newline at end of file
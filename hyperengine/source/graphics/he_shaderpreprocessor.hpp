@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hyperengine {
+	// `@name key` or `@name key = value`
+	struct ShaderPragma final {
+		std::string name;
+		std::string key;
+		std::string value;
+	};
+
+	struct PreprocessedShader final {
+		// Fully included source split at each `#inject`
+		std::vector<std::string> chunks;
+		std::vector<ShaderPragma> pragmas;
+		std::vector<std::string> errors;
+
+		// Builds a stage source by placing `inject` at each `#inject`
+		std::string emit(std::string_view inject) const;
+	};
+
+	// Single pass over the source, resolves `#include` from an in memory cache and collects `@` pragmas
+	PreprocessedShader preprocessShader(std::string_view source, std::string_view includeDirectory = "./shaders");
+	void clearShaderIncludeCache();
+}
\ No newline at end of file
@@ -131,6 +131,22 @@ namespace hyperengine {
 		}
 	}
 
+	void Texture::download(PixelFormat format, std::span<std::byte> pixels) {
+		if (GLAD_GL_ARB_direct_state_access) {
+			glGetTextureImage(mHandle, 0, pixelFormatToFormat(format), pixelFormatToType(format), static_cast<GLsizei>(pixels.size()), pixels.data());
+		}
+		else {
+			// save state
+			GLuint param = getBindingState(mTarget);
+
+			glBindTexture(mTarget, mHandle);
+			glGetTexImage(mTarget, 0, pixelFormatToFormat(format), pixelFormatToType(format), pixels.data());
+
+			// restore state
+			glBindTexture(mTarget, param);
+		}
+	}
+
 	void Texture::bind(GLuint unit) {
 		if (GLAD_GL_ARB_direct_state_access) {
 			glBindTextureUnit(unit, mHandle);
@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 #include <glad/gl.h>
+#include <cstddef>
+#include <span>
 #include <utility>
 #include <string>
 #include <string_view>
@@ -59,6 +61,8 @@ namespace hyperengine {
 		inline GLuint handle() const { return mHandle; }
 
 		void upload(UploadInfo const& info);
+		// Reads back the first level of a 2D texture, `pixels` must hold all of it in `format`
+		void download(PixelFormat format, std::span<std::byte> pixels);
 		void bind(GLuint unit);
 	private:
 		std::string mOrigin;
@@ -0,0 +1,161 @@
+#include "he_texturearray.hpp"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <functional>
+#include <string>
+
+#include "he_framebuffer.hpp"
+
+namespace hyperengine {
+	namespace {
+		// Same sampling as textures read from image files
+		Texture makeArray(GLsizei width, GLsizei height, GLsizei layers, PixelFormat format) {
+			using enum Texture::FilterMode;
+			std::string label = std::format("texture array {}x{}", width, height);
+
+			return {{
+					.width = width,
+					.height = height,
+					.depth = layers,
+					.format = format,
+					.minFilter = kLinearMipLinear,
+					.magFilter = kLinear,
+					.wrap = Texture::WrapMode::kRepeat,
+					.label = label
+				}};
+		}
+	}
+
+	TextureArrayPool::TextureArrayPool(CreateInfo const& info) {
+		mInitialLayers = std::max(info.initialLayers, 1);
+		mMaxLayers = std::max(info.maxLayers, mInitialLayers);
+	}
+
+	bool TextureArrayPool::add(std::shared_ptr<Texture> const& texture, GLsizei width, GLsizei height, PixelFormat format, void const* pixels) {
+		if (!texture || !pixels) return false;
+
+		if (auto it = mEntries.find(texture.get()); it != mEntries.end()) {
+			if (!it->second.texture.expired()) return false;
+
+			it->second.array->used[it->second.layer] = 0;
+			mEntries.erase(it);
+		}
+
+		if (!mLimitQueried) {
+			GLint limit = 0;
+			glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &limit);
+			if (limit > 0) mMaxLayers = std::min(mMaxLayers, static_cast<GLsizei>(limit));
+			mInitialLayers = std::min(mInitialLayers, mMaxLayers);
+			mLimitQueried = true;
+		}
+
+		Array* target = nullptr;
+		uint32_t layer = 0;
+
+		for (auto& array : mArrays) {
+			if (array->width != width || array->height != height || array->format != format) continue;
+
+			auto free = std::find(array->used.begin(), array->used.end(), uint8_t(0));
+			GLsizei layers = static_cast<GLsizei>(array->used.size());
+
+			if (free == array->used.end() && layers >= mMaxLayers) continue;
+
+			target = array.get();
+			layer = static_cast<uint32_t>(free - array->used.begin());
+
+			if (free == array->used.end())
+				grow(*array, std::min(layers * 2, mMaxLayers));
+
+			break;
+		}
+
+		if (!target) {
+			mArrays.push_back(std::make_unique<Array>(Array{ width, height, format, makeArray(width, height, mInitialLayers, format), std::vector<uint8_t>(mInitialLayers) }));
+			target = mArrays.back().get();
+		}
+
+		target->used[layer] = 1;
+		target->texture.upload({
+				.zoffset = static_cast<GLint>(layer),
+				.width = width,
+				.height = height,
+				.depth = 1,
+				.format = format,
+				.pixels = pixels,
+				.mips = true
+			});
+
+		mEntries[texture.get()] = { texture, target, layer };
+		return true;
+	}
+
+	TextureArrayPool::Slot TextureArrayPool::find(Texture const* texture) const {
+		auto it = mEntries.find(texture);
+		if (it == mEntries.end() || it->second.texture.expired()) return {};
+		return { &it->second.array->texture, it->second.layer };
+	}
+
+	void TextureArrayPool::collect() {
+		for (auto it = mEntries.begin(); it != mEntries.end();) {
+			if (it->second.texture.expired()) {
+				it->second.array->used[it->second.layer] = 0;
+				it = mEntries.erase(it);
+			}
+			else
+				++it;
+		}
+
+		std::erase_if(mArrays, [](std::unique_ptr<Array> const& array) {
+			return std::none_of(array->used.begin(), array->used.end(), [](uint8_t used) { return used != 0; });
+		});
+	}
+
+	TextureArrayPool::Stats TextureArrayPool::stats() const {
+		Stats stats{ .arrays = static_cast<uint32_t>(mArrays.size()) };
+
+		for (auto const& array : mArrays) {
+			stats.layers += static_cast<uint32_t>(array->used.size());
+			stats.used += static_cast<uint32_t>(std::count(array->used.begin(), array->used.end(), uint8_t(1)));
+		}
+
+		return stats;
+	}
+
+	// Core 3.3 has no image copies, the first level of each layer is blitted over. The
+	// other levels are regenerated by the upload that needed the room
+	void TextureArrayPool::grow(Array& array, GLsizei layers) {
+		Texture texture = makeArray(array.width, array.height, layers, array.format);
+
+		GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+		glDisable(GL_SCISSOR_TEST);
+
+		GLint readState = 0, drawState = 0;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readState);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawState);
+
+		for (GLint layer = 0; layer < static_cast<GLint>(array.used.size()); ++layer) {
+			std::array<Framebuffer::Attachment, 1> source{ Framebuffer::Attachment(GL_COLOR_ATTACHMENT0, std::ref(array.texture), layer) };
+			std::array<Framebuffer::Attachment, 1> destination{ Framebuffer::Attachment(GL_COLOR_ATTACHMENT0, std::ref(texture), layer) };
+			Framebuffer read({ .attachments = source });
+			Framebuffer draw({ .attachments = destination });
+
+			if (GLAD_GL_ARB_direct_state_access) {
+				glBlitNamedFramebuffer(read.handle(), draw.handle(), 0, 0, array.width, array.height, 0, 0, array.width, array.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			}
+			else {
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, read.handle());
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw.handle());
+				glBlitFramebuffer(0, 0, array.width, array.height, 0, 0, array.width, array.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			}
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(readState));
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(drawState));
+		if (scissor) glEnable(GL_SCISSOR_TEST);
+
+		array.texture = std::move(texture);
+		array.used.resize(static_cast<size_t>(layers));
+	}
+}
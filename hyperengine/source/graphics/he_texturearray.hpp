@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glad/gl.h>
+
+#include "he_pixelformat.hpp"
+#include "he_texture.hpp"
+
+namespace hyperengine {
+	// Copies of textures sharing size and format packed into 2D array textures, one layer each. Materials whose
+	// textures are all packed can sample the arrays by layer, draws using the same arrays then skip the rebinds
+	class TextureArrayPool final {
+	public:
+		struct CreateInfo final {
+			GLsizei initialLayers = 2; // Arrays double from here when full
+			GLsizei maxLayers = 64; // Also capped by the driver, a full array starts the next one
+		};
+
+		struct Slot final {
+			Texture* array = nullptr;
+			uint32_t layer = 0;
+
+			inline explicit operator bool() const { return array; }
+		};
+
+		struct Stats final {
+			uint32_t arrays = 0;
+			uint32_t layers = 0;
+			uint32_t used = 0;
+		};
+
+		TextureArrayPool() : TextureArrayPool(CreateInfo{}) {}
+		TextureArrayPool(CreateInfo const& info);
+
+		// Uploads `pixels` into a free layer kept until `texture` expires, false if it is packed already
+		bool add(std::shared_ptr<Texture> const& texture, GLsizei width, GLsizei height, PixelFormat format, void const* pixels);
+		Slot find(Texture const* texture) const;
+		// Frees the layers of expired textures and releases arrays left empty
+		void collect();
+		Stats stats() const;
+	private:
+		struct Array final {
+			GLsizei width;
+			GLsizei height;
+			PixelFormat format;
+			Texture texture;
+			std::vector<uint8_t> used; // One per layer
+		};
+
+		// Keyed by address, a texture allocated where an expired one lived replaces its entry
+		struct Entry final {
+			std::weak_ptr<Texture> texture;
+			Array* array;
+			uint32_t layer;
+		};
+
+		void grow(Array& array, GLsizei layers);
+
+		std::vector<std::unique_ptr<Array>> mArrays;
+		std::unordered_map<Texture const*, Entry> mEntries;
+		GLsizei mInitialLayers = 0;
+		GLsizei mMaxLayers = 0;
+		bool mLimitQueried = false;
+	};
+}
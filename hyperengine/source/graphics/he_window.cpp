@@ -21,7 +21,9 @@ namespace hyperengine {
 		if (!gWindowCount) {
 			glfwSetErrorCallback(&errorCallback);
 
-			if (hyperengine::isWsl())
+			if (info.headless)
+				glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+			else if (hyperengine::isWsl())
 				glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_X11);
 
 			if (!glfwInit()) return;
@@ -43,12 +45,24 @@ namespace hyperengine {
 #ifdef _DEBUG
 			glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 #endif
+
+			// The null platform has no native contexts, EGL runs surfaceless on Mesa and drivers without a display
+			if (info.headless)
+				glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
 		}
 
 		glfwWindowHint(GLFW_MAXIMIZED, info.maximized);
+		glfwWindowHint(GLFW_VISIBLE, info.visible && !info.headless);
 
 		mHandle = glfwCreateWindow(info.width, info.height, info.title, nullptr, nullptr);
 
+		// OSMesa renders on the cpu where EGL is missing
+		if (!mHandle && info.headless && !info.noClientApi) {
+			spdlog::warn("No EGL context, trying OSMesa");
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+			mHandle = glfwCreateWindow(info.width, info.height, info.title, nullptr, nullptr);
+		}
+
 		if (!mHandle && !gWindowCount) {
 			glfwTerminate();
 			return;
@@ -11,6 +11,8 @@ namespace hyperengine {
 			char const* title = nullptr;
 			bool maximized = false;
 			bool noClientApi = false;
+			bool visible = true;
+			bool headless = false; // No display, the context comes from EGL or OSMesa. Must be the first window
 		};
 
 		constexpr Window() noexcept = default;
@@ -0,0 +1,503 @@
+#include "he_benchmark.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <spdlog/spdlog.h>
+
+#include "he_io.hpp"
+#include "he_bvh.hpp"
+#include "he_hierarchy.hpp"
+#include "he_jobs.hpp"
+#include "he_transform.hpp"
+#include "graphics/he_framebuffer.hpp"
+#include "graphics/he_mesh.hpp"
+#include "graphics/he_occlusion.hpp"
+#include "graphics/he_shader.hpp"
+#include "graphics/he_shaderpreprocessor.hpp"
+#include "graphics/he_texture.hpp"
+#include "graphics/he_window.hpp"
+
+#define STB_INCLUDE_IMPLEMENTATION
+#define STB_INCLUDE_LINE_GLSL
+#include <stb_include.h>
+
+namespace {
+	template<class Fn>
+	double measureMilliseconds(int iterations, Fn&& fn) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; ++i) fn();
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	}
+
+	// The shader preprocessing path used before the single pass preprocessor, kept for comparison
+	size_t preprocessLegacy(std::string const& input) {
+		std::string source = input;
+		std::regex regex("@(\\w+)\\s+(\\w+)\\s*=\\s*(\\w+)");
+
+		size_t pragmas = 0;
+		for (std::sregex_iterator i = std::sregex_iterator(source.begin(), source.end(), regex); i != std::sregex_iterator(); ++i)
+			++pragmas;
+		source = std::regex_replace(source, regex, "// ENGINE PRAGMA APPLIED // $&");
+
+		char error[256];
+		char* vertSource = stb_include_string(source.data(), (char*)"#version 330 core\n#define VERT", (char*)"./shaders", nullptr, error);
+		char* fragSource = stb_include_string(source.data(), (char*)"#version 330 core\n#define FRAG", (char*)"./shaders", nullptr, error);
+
+		size_t size = pragmas + (vertSource ? strlen(vertSource) : 0) + (fragSource ? strlen(fragSource) : 0);
+		free(vertSource);
+		free(fragSource);
+		return size;
+	}
+
+	size_t preprocessSinglePass(std::string const& input) {
+		hyperengine::PreprocessedShader preprocessed = hyperengine::preprocessShader(input);
+		std::string vertSource = preprocessed.emit("#version 330 core\n#define VERT");
+		std::string fragSource = preprocessed.emit("#version 330 core\n#define FRAG");
+		return preprocessed.pragmas.size() + vertSource.size() + fragSource.size();
+	}
+
+	void shaderPreprocess() {
+		constexpr int kIterations = 200;
+		volatile size_t sink = 0;
+
+		for (auto const& entry : std::filesystem::directory_iterator("./shaders")) {
+			if (entry.path().extension() != ".glsl") continue;
+
+			std::string path = entry.path().generic_string();
+			auto source = hyperengine::readFileString(path.c_str());
+			if (!source.has_value()) continue;
+
+			// Only files with an `#inject` are full programs
+			if (source->find("#inject") == std::string::npos) continue;
+
+			double legacy = measureMilliseconds(kIterations, [&]() { sink = sink + preprocessLegacy(source.value()); });
+
+			double cold = measureMilliseconds(kIterations, [&]() {
+				hyperengine::clearShaderIncludeCache();
+				sink = sink + preprocessSinglePass(source.value());
+			});
+
+			double warm = measureMilliseconds(kIterations, [&]() { sink = sink + preprocessSinglePass(source.value()); });
+
+			spdlog::info("{:<32} legacy {:8.4f} ms | single pass cold {:8.4f} ms, warm {:8.4f} ms | {:5.1f}x", path, legacy, cold, warm, legacy / warm);
+		}
+	}
+
+	// 100k entities, 1% moving every frame, queries compared against a linear walk
+	void bvh() {
+		constexpr int kEntities = 100'000;
+		constexpr int kMoving = kEntities / 100;
+		constexpr int kFrames = 60;
+
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> size(0.2f, 3.0f);
+
+		auto randomBox = [&]() {
+			glm::vec3 center(position(rng), position(rng) * 0.1f, position(rng));
+			glm::vec3 extents(size(rng), size(rng), size(rng));
+			return hyperengine::Aabb{ center - extents, center + extents };
+		};
+
+		std::vector<hyperengine::Aabb> boxes(kEntities);
+		std::vector<hyperengine::DynamicBvh::Proxy> proxies(kEntities);
+		hyperengine::DynamicBvh tree({ .capacity = kEntities });
+
+		double insert = measureMilliseconds(1, [&]() {
+			for (int i = 0; i < kEntities; ++i) {
+				boxes[i] = randomBox();
+				proxies[i] = tree.insert(boxes[i], static_cast<uint32_t>(i));
+			}
+		});
+
+		spdlog::info("insert {} entities {:8.3f} ms, height {}", kEntities, insert, tree.height());
+
+		size_t reinserted = 0;
+		double move = measureMilliseconds(kFrames, [&]() {
+			glm::vec3 displacement(0.5f, 0.0f, 0.3f);
+			for (int i = 0; i < kEntities; i += kEntities / kMoving) {
+				boxes[i] = { boxes[i].min + displacement, boxes[i].max + displacement };
+				reinserted += tree.move(proxies[i], boxes[i], displacement);
+			}
+		});
+
+		spdlog::info("move {} entities   {:8.3f} ms per frame, {:.1f} reinserted per frame", kMoving, move, static_cast<double>(reinserted) / kFrames);
+
+		glm::mat4 viewProjection = glm::perspective(glm::radians(80.0f), 16.0f / 9.0f, 0.1f, 150.0f) * glm::lookAt(glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(1.0f, 5.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		hyperengine::Frustum frustum = hyperengine::Frustum::fromMatrix(viewProjection);
+
+		std::vector<uint32_t> results;
+		results.reserve(kEntities);
+		volatile size_t sink = 0;
+
+		double treeFrustum = measureMilliseconds(100, [&]() {
+			results.clear();
+			tree.query(frustum, results);
+			sink = sink + results.size();
+		});
+
+		double linearFrustum = measureMilliseconds(100, [&]() {
+			size_t count = 0;
+			for (hyperengine::Aabb const& box : boxes)
+				count += frustum.classify(box) != hyperengine::Containment::kOutside;
+			sink = sink + count;
+		});
+
+		spdlog::info("frustum query      {:8.3f} ms, linear {:8.3f} ms, {} results", treeFrustum, linearFrustum, results.size());
+
+		hyperengine::BoundingSphere sphere{ glm::vec3(0.0f), 25.0f };
+		double treeSphere = measureMilliseconds(1000, [&]() {
+			results.clear();
+			tree.query(sphere, results);
+			sink = sink + results.size();
+		});
+
+		spdlog::info("sphere query       {:8.3f} ms, {} results", treeSphere, results.size());
+
+		std::vector<hyperengine::DynamicBvh::RayHit> hits;
+		hyperengine::Ray ray{ glm::vec3(0.0f, 1.0f, 0.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 0.3f)) };
+
+		double treeRay = measureMilliseconds(1000, [&]() {
+			hits.clear();
+			tree.raycast(ray, 500.0f, hits);
+			sink = sink + hits.size();
+		});
+
+		double linearRay = measureMilliseconds(100, [&]() {
+			size_t count = 0;
+			for (hyperengine::Aabb const& box : boxes)
+				count += box.raycast(ray, 500.0f).has_value();
+			sink = sink + count;
+		});
+
+		spdlog::info("ray query          {:8.3f} ms, linear {:8.3f} ms, {} hits", treeRay, linearRay, hits.size());
+	}
+
+	// A street level view through a grid of buildings hiding 20k props
+	void occlusion() {
+		constexpr int kGrid = 16;
+		constexpr int kProps = 20'000;
+		constexpr int kIterations = 200;
+
+		// Unit cube as two triangles per face
+		std::array<glm::vec3, 8> corners;
+		for (int i = 0; i < 8; ++i)
+			corners[i] = glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f);
+
+		std::array<uint32_t, 36> const cubeIndices = {
+			0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+			2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5,
+		};
+
+		auto cube = hyperengine::Occluder::fromTriangles(corners, cubeIndices);
+
+		std::vector<glm::mat4> buildings;
+		for (int x = 0; x < kGrid; ++x) {
+			for (int z = 0; z < kGrid; ++z) {
+				glm::vec3 center((x - kGrid / 2) * 20.0f + 10.0f, 10.0f, (z - kGrid / 2) * 20.0f + 10.0f);
+				buildings.push_back(glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(14.0f, 20.0f, 14.0f)));
+			}
+		}
+
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> position(-kGrid * 10.0f, kGrid * 10.0f);
+		std::vector<hyperengine::Aabb> props(kProps);
+		for (hyperengine::Aabb& box : props) {
+			glm::vec3 center(position(rng), 0.5f, position(rng));
+			box = { center - glm::vec3(0.5f), center + glm::vec3(0.5f) };
+		}
+
+		glm::mat4 viewProjection = glm::perspective(glm::radians(80.0f), 16.0f / 9.0f, 0.1f, 500.0f) * glm::lookAt(glm::vec3(0.0f, 1.8f, 0.0f), glm::vec3(1.0f, 1.8f, 0.3f), glm::vec3(0.0f, 1.0f, 0.0f));
+		hyperengine::OcclusionBuffer buffer;
+		hyperengine::JobSystem jobs;
+
+		auto setup = [&]() {
+			buffer.begin(viewProjection);
+			for (glm::mat4 const& building : buildings)
+				buffer.addOccluder(*cube, building);
+		};
+
+		double clip = measureMilliseconds(kIterations, setup);
+		double single = measureMilliseconds(kIterations, [&]() { setup(); buffer.rasterize(); }) - clip;
+		double threaded = measureMilliseconds(kIterations, [&]() { setup(); buffer.rasterize(&jobs); }) - clip;
+
+		spdlog::info("{} occluders, {} triangles after clipping", buffer.stats().occluders, buffer.stats().triangles);
+		spdlog::info("transform and clip {:8.3f} ms", clip);
+		spdlog::info("rasterize          {:8.3f} ms, {} workers {:8.3f} ms", single, jobs.workers(), threaded);
+
+		hyperengine::Frustum frustum = hyperengine::Frustum::fromMatrix(viewProjection);
+		size_t inFrustum = 0, occluded = 0;
+		double test = measureMilliseconds(kIterations, [&]() {
+			inFrustum = 0;
+			occluded = 0;
+			for (hyperengine::Aabb const& box : props) {
+				if (frustum.classify(box) == hyperengine::Containment::kOutside) continue;
+				++inFrustum;
+				occluded += !buffer.visible(box);
+			}
+		});
+
+		spdlog::info("frustum and occlusion test {:8.3f} ms, {} of {} in frustum occluded ({:.1f}%)", test, occluded, inFrustum, 100.0 * occluded / std::max<size_t>(inFrustum, 1));
+	}
+
+	// World matrices of 100k transforms, recomposed one by one like before the cache and in batches
+	void transforms() {
+		constexpr int kTransforms = 100'000;
+		constexpr int kIterations = 50;
+
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+		std::vector<hyperengine::Transform> transforms(kTransforms);
+		for (hyperengine::Transform& transform : transforms) {
+			transform.translation = glm::vec3(value(rng), value(rng), value(rng)) * 100.0f;
+			transform.orientation = glm::normalize(glm::quat(value(rng), value(rng), value(rng), value(rng)));
+			transform.scale = glm::vec3(value(rng), value(rng), value(rng)) + 2.0f;
+		}
+
+		std::vector<glm::mat4> matrices(kTransforms);
+
+		double recompose = measureMilliseconds(kIterations, [&]() {
+			glm::vec3 skew = glm::zero<glm::vec3>();
+			glm::vec4 perspective(0.0f, 0.0f, 0.0f, 1.0f);
+			for (int i = 0; i < kTransforms; ++i)
+				matrices[i] = glm::recompose(transforms[i].scale, transforms[i].orientation, transforms[i].translation, skew, perspective);
+		});
+
+		std::vector<glm::mat4> reference = matrices;
+
+		double single = measureMilliseconds(kIterations, [&]() {
+			for (int i = 0; i < kTransforms; ++i)
+				matrices[i] = transforms[i].get();
+		});
+
+		double batched = measureMilliseconds(kIterations, [&]() { hyperengine::composeTransforms(transforms, matrices); });
+
+		float error = 0.0f;
+		for (int i = 0; i < kTransforms; ++i)
+			for (int c = 0; c < 4; ++c)
+				for (int r = 0; r < 4; ++r)
+					error = std::max(error, std::abs(matrices[i][c][r] - reference[i][c][r]));
+
+		spdlog::info("glm::recompose {:8.3f} ms | compose {:8.3f} ms | batched {:8.3f} ms, {:5.1f}x | max error {}", recompose, single, batched, recompose / batched, error);
+	}
+
+	// 100k nodes under 100 roots, every root moving each frame so every world matrix is recomputed
+	void hierarchy() {
+		constexpr int kNodes = 100'000;
+		constexpr int kRoots = 100;
+		constexpr int kFrames = 60;
+
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+		auto randomMatrix = [&]() {
+			hyperengine::Transform transform;
+			transform.translation = glm::vec3(value(rng), value(rng), value(rng));
+			transform.orientation = glm::normalize(glm::quat(value(rng), value(rng), value(rng), value(rng)));
+			return transform.get();
+		};
+
+		hyperengine::TransformHierarchy tree({ .capacity = kNodes });
+		std::vector<hyperengine::TransformHierarchy::Node> nodes;
+		nodes.reserve(kNodes);
+
+		// Parents are picked among the earlier half so the tree gets a dozen levels
+		for (int i = 0; i < kNodes; ++i) {
+			auto parent = i < kRoots ? hyperengine::TransformHierarchy::kNull : nodes[std::uniform_int_distribution<int>(0, std::max(i / 2, kRoots) - 1)(rng)];
+			nodes.push_back(tree.insert(static_cast<uint32_t>(i), parent));
+			tree.local(nodes.back(), randomMatrix());
+		}
+
+		std::vector<uint32_t> changed;
+		changed.reserve(kNodes);
+
+		double build = measureMilliseconds(1, [&]() {
+			changed.clear();
+			tree.propagate(changed);
+		});
+
+		spdlog::info("{} nodes, {} levels, first propagation with sort {:8.3f} ms", tree.size(), tree.levels(), build);
+
+		hyperengine::JobSystem jobs;
+		for (hyperengine::JobSystem* system : { static_cast<hyperengine::JobSystem*>(nullptr), &jobs }) {
+			double propagate = measureMilliseconds(kFrames, [&]() {
+				for (int i = 0; i < kRoots; ++i)
+					tree.local(nodes[i], randomMatrix());
+				changed.clear();
+				tree.propagate(changed, system);
+			});
+
+			spdlog::info("propagate {} workers  {:8.3f} ms per frame, {} changed", system ? system->workers() : 0, propagate, changed.size());
+		}
+
+		double reparent = measureMilliseconds(1, [&]() {
+			for (int i = 0; i < 1000; ++i)
+				tree.reparent(nodes[kNodes - 1 - i], nodes[i % kRoots]);
+			changed.clear();
+			tree.propagate(changed, &jobs);
+		});
+
+		spdlog::info("reparent 1000 nodes and propagate {:8.3f} ms", reparent);
+	}
+
+	// Noise keeps framebuffer compression from hiding the traffic
+	constexpr std::string_view kFillShader = R"(#inject
+#include "common.glsl"
+
+VARYING(vec2, vUv);
+OUTPUT(vec4, oColor, 0);
+
+#ifdef VERT
+const vec2 kPositions[4] = vec2[](vec2(-1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(1.0, -1.0));
+
+void main(void) {
+	gl_Position = vec4(kPositions[gl_VertexID], 0.0, 1.0);
+	vUv = kPositions[gl_VertexID] * 0.5 + 0.5;
+}
+#endif
+
+#ifdef FRAG
+void main(void) {
+	float noise = fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233))) * 43758.5453);
+	oColor = vec4(vUv * 16.0, noise * 4.0, 1.0);
+}
+#endif
+)";
+
+	// Writes a scene color target and tonemaps it into RGBA8 like the viewport does, for every candidate format
+	void renderTargets() {
+		constexpr int kFrames = 200;
+
+		struct Candidate final {
+			hyperengine::PixelFormat format;
+			char const* note;
+		};
+
+		using enum hyperengine::PixelFormat;
+		constexpr std::array<Candidate, 5> kCandidates = {{
+			{ kRgba32f, "" },
+			{ kRgba16f, "" },
+			{ kR11G11B10f, "" },
+			{ kRgb10A2, ", clamps to 1" },
+			{ kRgba8, ", clamps to 1" },
+		}};
+
+		hyperengine::Window window({ .width = 64, .height = 64, .title = "HyperEngine Benchmark", .visible = false });
+		if (!window.handle()) {
+			spdlog::error("Failed to create an OpenGL context");
+			return;
+		}
+
+		glfwMakeContextCurrent(window.handle());
+		gladLoadGL(&glfwGetProcAddress);
+
+		auto acesSource = hyperengine::readFileString("shaders/aces.glsl");
+		if (!acesSource.has_value()) return;
+
+		hyperengine::ShaderProgram fill({ .source = kFillShader, .origin = "benchmark fill" });
+		hyperengine::ShaderProgram aces({ .source = acesSource.value(), .origin = "shaders/aces.glsl" });
+		fill.wait();
+		aces.wait();
+
+		hyperengine::Mesh empty({ .origin = "Empty Mesh" });
+
+		GLuint query;
+		glGenQueries(1, &query);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_CULL_FACE);
+
+		using enum hyperengine::Texture::FilterMode;
+		using enum hyperengine::Texture::WrapMode;
+
+		for (glm::ivec2 size : { glm::ivec2(1920, 1080), glm::ivec2(3840, 2160) }) {
+			hyperengine::Texture output({ .width = size.x, .height = size.y, .format = kRgba8, .minFilter = kLinear, .magFilter = kLinear, .wrap = kClampEdge, .label = "benchmark output" });
+			std::array<hyperengine::Framebuffer::Attachment, 1> outputAttachments{ hyperengine::Framebuffer::Attachment(GL_COLOR_ATTACHMENT0, std::ref(output)) };
+			hyperengine::Framebuffer outputFramebuffer({ .attachments = outputAttachments });
+
+			for (Candidate const& candidate : kCandidates) {
+				hyperengine::Texture color({ .width = size.x, .height = size.y, .format = candidate.format, .minFilter = kLinear, .magFilter = kLinear, .wrap = kClampEdge, .label = "benchmark scene color" });
+				std::array<hyperengine::Framebuffer::Attachment, 1> colorAttachments{ hyperengine::Framebuffer::Attachment(GL_COLOR_ATTACHMENT0, std::ref(color)) };
+				hyperengine::Framebuffer colorFramebuffer({ .attachments = colorAttachments });
+
+				auto frame = [&]() {
+					glViewport(0, 0, size.x, size.y);
+					colorFramebuffer.bind();
+					fill.bind();
+					empty.draw(GL_TRIANGLE_STRIP, 0, 4);
+
+					outputFramebuffer.bind();
+					aces.bind();
+					color.bind(0);
+					empty.draw(GL_TRIANGLE_STRIP, 0, 4);
+				};
+
+				frame();
+				glFinish();
+
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				for (int i = 0; i < kFrames; ++i) frame();
+				glEndQuery(GL_TIME_ELAPSED);
+
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+				// The target is written and read once, the output written once
+				double pixels = static_cast<double>(size.x) * size.y;
+				double bytes = pixels * (2.0 * hyperengine::pixelFormatSize(candidate.format) + hyperengine::pixelFormatSize(kRgba8));
+				double milliseconds = static_cast<double>(elapsed) / 1e6 / kFrames;
+
+				spdlog::info("{}x{} {:>10} {:6.1f} MiB  {:7.3f} ms per frame, {:6.1f} GB/s{}", size.x, size.y, hyperengine::pixelFormatName(candidate.format),
+					pixels * hyperengine::pixelFormatSize(candidate.format) / (1024.0 * 1024.0), milliseconds, bytes / (milliseconds * 1e6), candidate.note);
+			}
+		}
+
+		glDeleteQueries(1, &query);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	struct Benchmark final {
+		std::string_view name;
+		std::function<void()> fn;
+	};
+
+	std::array<Benchmark, 6> const kBenchmarks = {{
+		{ "shader-preprocess", shaderPreprocess },
+		{ "bvh", bvh },
+		{ "occlusion", occlusion },
+		{ "transforms", transforms },
+		{ "hierarchy", hierarchy },
+		{ "render-targets", renderTargets },
+	}};
+}
+
+namespace hyperengine::benchmark {
+	bool run(std::string_view name) {
+		for (auto const& benchmark : kBenchmarks) {
+			if (benchmark.name != name) continue;
+
+			spdlog::info("Running benchmark {}", benchmark.name);
+			benchmark.fn();
+			return true;
+		}
+
+		spdlog::error("Unknown benchmark {}", name);
+		for (auto const& benchmark : kBenchmarks)
+			spdlog::info("  {}", benchmark.name);
+		return false;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string_view>
+
+// Microbenchmarks, run with `--benchmark <name>` from the working directory
+namespace hyperengine::benchmark {
+	// Returns false if no benchmark has the given name
+	bool run(std::string_view name);
+}
\ No newline at end of file
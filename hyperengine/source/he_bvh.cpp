@@ -0,0 +1,347 @@
+#include "he_bvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+	hyperengine::Aabb merged(hyperengine::Aabb const& a, hyperengine::Aabb const& b) {
+		hyperengine::Aabb result = a;
+		result.expand(b);
+		return result;
+	}
+}
+
+namespace hyperengine {
+	DynamicBvh::DynamicBvh(CreateInfo const& info) : mMargin(info.margin) {
+		mNodes.reserve(info.capacity * 2);
+	}
+
+	Aabb DynamicBvh::fatten(Aabb const& box, glm::vec3 displacement) const {
+		constexpr float kDisplacementMultiplier = 4.0f;
+
+		Aabb fat = { box.min - glm::vec3(mMargin), box.max + glm::vec3(mMargin) };
+		glm::vec3 predicted = displacement * kDisplacementMultiplier;
+		fat.min += glm::min(predicted, glm::vec3(0.0f));
+		fat.max += glm::max(predicted, glm::vec3(0.0f));
+		return fat;
+	}
+
+	DynamicBvh::Proxy DynamicBvh::allocateNode() {
+		if (mFree == kNull) {
+			mNodes.emplace_back();
+			mNodes.back().height = 0;
+			return static_cast<Proxy>(mNodes.size() - 1);
+		}
+
+		Proxy node = mFree;
+		mFree = mNodes[node].parent;
+		mNodes[node] = Node{ .height = 0 };
+		return node;
+	}
+
+	void DynamicBvh::freeNode(Proxy node) {
+		mNodes[node].parent = mFree;
+		mNodes[node].height = -1;
+		mFree = node;
+	}
+
+	DynamicBvh::Proxy DynamicBvh::insert(Aabb const& box, uint32_t userData) {
+		Proxy leaf = allocateNode();
+		mNodes[leaf].box = fatten(box, glm::vec3(0.0f));
+		mNodes[leaf].userData = userData;
+
+		insertLeaf(leaf);
+		++mLeafCount;
+		return leaf;
+	}
+
+	void DynamicBvh::remove(Proxy proxy) {
+		assert(proxy >= 0 && proxy < static_cast<Proxy>(mNodes.size()) && mNodes[proxy].leaf());
+
+		removeLeaf(proxy);
+		freeNode(proxy);
+		--mLeafCount;
+	}
+
+	bool DynamicBvh::move(Proxy proxy, Aabb const& box, glm::vec3 displacement) {
+		if (mNodes[proxy].box.contains(box)) return false;
+
+		removeLeaf(proxy);
+		mNodes[proxy].box = fatten(box, displacement);
+		insertLeaf(proxy);
+		return true;
+	}
+
+	void DynamicBvh::clear() {
+		mNodes.clear();
+		mRoot = kNull;
+		mFree = kNull;
+		mLeafCount = 0;
+	}
+
+	// See: Catto, Dynamic Bounding Volume Hierarchies. Descends towards the sibling with the lowest surface area cost
+	void DynamicBvh::insertLeaf(Proxy leaf) {
+		if (mRoot == kNull) {
+			mRoot = leaf;
+			mNodes[leaf].parent = kNull;
+			return;
+		}
+
+		Aabb const leafBox = mNodes[leaf].box;
+		Proxy index = mRoot;
+
+		while (!mNodes[index].leaf()) {
+			Node const& node = mNodes[index];
+			float area = node.box.surfaceArea();
+			float combinedArea = merged(node.box, leafBox).surfaceArea();
+
+			// Cost of making a new parent here and the increase pushed down to the children
+			float cost = 2.0f * combinedArea;
+			float inheritance = 2.0f * (combinedArea - area);
+
+			auto descendCost = [&](Proxy child) {
+				Aabb const& childBox = mNodes[child].box;
+				float childCost = merged(childBox, leafBox).surfaceArea();
+				if (!mNodes[child].leaf()) childCost -= childBox.surfaceArea();
+				return childCost + inheritance;
+			};
+
+			float cost1 = descendCost(node.child1);
+			float cost2 = descendCost(node.child2);
+
+			if (cost < cost1 && cost < cost2) break;
+			index = cost1 < cost2 ? node.child1 : node.child2;
+		}
+
+		Proxy sibling = index;
+		Proxy oldParent = mNodes[sibling].parent;
+		Proxy newParent = allocateNode();
+
+		mNodes[newParent].parent = oldParent;
+		mNodes[newParent].box = merged(leafBox, mNodes[sibling].box);
+		mNodes[newParent].height = mNodes[sibling].height + 1;
+		mNodes[newParent].child1 = sibling;
+		mNodes[newParent].child2 = leaf;
+		mNodes[sibling].parent = newParent;
+		mNodes[leaf].parent = newParent;
+
+		if (oldParent == kNull)
+			mRoot = newParent;
+		else if (mNodes[oldParent].child1 == sibling)
+			mNodes[oldParent].child1 = newParent;
+		else
+			mNodes[oldParent].child2 = newParent;
+
+		// Refit and rebalance up to the root
+		for (index = mNodes[leaf].parent; index != kNull; index = mNodes[index].parent) {
+			index = balance(index);
+
+			Node& node = mNodes[index];
+			node.height = 1 + std::max(mNodes[node.child1].height, mNodes[node.child2].height);
+			node.box = merged(mNodes[node.child1].box, mNodes[node.child2].box);
+		}
+	}
+
+	void DynamicBvh::removeLeaf(Proxy leaf) {
+		if (leaf == mRoot) {
+			mRoot = kNull;
+			return;
+		}
+
+		Proxy parent = mNodes[leaf].parent;
+		Proxy grandParent = mNodes[parent].parent;
+		Proxy sibling = mNodes[parent].child1 == leaf ? mNodes[parent].child2 : mNodes[parent].child1;
+
+		freeNode(parent);
+
+		if (grandParent == kNull) {
+			mRoot = sibling;
+			mNodes[sibling].parent = kNull;
+			return;
+		}
+
+		if (mNodes[grandParent].child1 == parent)
+			mNodes[grandParent].child1 = sibling;
+		else
+			mNodes[grandParent].child2 = sibling;
+		mNodes[sibling].parent = grandParent;
+
+		for (Proxy index = grandParent; index != kNull; index = mNodes[index].parent) {
+			index = balance(index);
+
+			Node& node = mNodes[index];
+			node.height = 1 + std::max(mNodes[node.child1].height, mNodes[node.child2].height);
+			node.box = merged(mNodes[node.child1].box, mNodes[node.child2].box);
+		}
+	}
+
+	// Rotates the taller child up when the subtree heights differ by more than one, returns the new subtree root
+	DynamicBvh::Proxy DynamicBvh::balance(Proxy a) {
+		Node& nodeA = mNodes[a];
+		if (nodeA.leaf() || nodeA.height < 2) return a;
+
+		Proxy b = nodeA.child1;
+		Proxy c = nodeA.child2;
+		int32_t difference = mNodes[c].height - mNodes[b].height;
+
+		if (difference > 1 || difference < -1) {
+			// `up` is the taller child replacing `a`, `down` stays below `a`
+			bool rotateRight = difference > 1;
+			Proxy up = rotateRight ? c : b;
+			Proxy down = rotateRight ? b : c;
+
+			Proxy f = mNodes[up].child1;
+			Proxy g = mNodes[up].child2;
+
+			mNodes[up].child1 = a;
+			mNodes[up].parent = nodeA.parent;
+			nodeA.parent = up;
+
+			if (mNodes[up].parent == kNull)
+				mRoot = up;
+			else if (mNodes[mNodes[up].parent].child1 == a)
+				mNodes[mNodes[up].parent].child1 = up;
+			else
+				mNodes[mNodes[up].parent].child2 = up;
+
+			// The taller grandchild stays with `up`, the shorter one moves under `a`
+			Proxy keep = mNodes[f].height > mNodes[g].height ? f : g;
+			Proxy give = keep == f ? g : f;
+
+			mNodes[up].child2 = keep;
+			if (rotateRight)
+				nodeA.child2 = give;
+			else
+				nodeA.child1 = give;
+			mNodes[give].parent = a;
+
+			nodeA.box = merged(mNodes[down].box, mNodes[give].box);
+			nodeA.height = 1 + std::max(mNodes[down].height, mNodes[give].height);
+			mNodes[up].box = merged(nodeA.box, mNodes[keep].box);
+			mNodes[up].height = 1 + std::max(nodeA.height, mNodes[keep].height);
+
+			return up;
+		}
+
+		return a;
+	}
+
+	void DynamicBvh::collectLeaves(Proxy node, std::vector<uint32_t>& results, std::vector<Proxy>& stack) const {
+		size_t base = stack.size();
+		stack.push_back(node);
+
+		while (stack.size() > base) {
+			Proxy index = stack.back();
+			stack.pop_back();
+
+			Node const& current = mNodes[index];
+			if (current.leaf()) {
+				results.push_back(current.userData);
+				continue;
+			}
+
+			stack.push_back(current.child1);
+			stack.push_back(current.child2);
+		}
+	}
+
+	void DynamicBvh::query(Aabb const& box, std::vector<uint32_t>& results) const {
+		if (mRoot == kNull) return;
+
+		std::vector<Proxy> stack;
+		stack.reserve(64);
+		stack.push_back(mRoot);
+
+		while (!stack.empty()) {
+			Node const& node = mNodes[stack.back()];
+			stack.pop_back();
+
+			if (!node.box.overlaps(box)) continue;
+
+			if (node.leaf()) {
+				results.push_back(node.userData);
+				continue;
+			}
+
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+
+	void DynamicBvh::query(BoundingSphere const& sphere, std::vector<uint32_t>& results) const {
+		if (mRoot == kNull) return;
+
+		std::vector<Proxy> stack;
+		stack.reserve(64);
+		stack.push_back(mRoot);
+
+		while (!stack.empty()) {
+			Node const& node = mNodes[stack.back()];
+			stack.pop_back();
+
+			if (!node.box.overlaps(sphere.center, sphere.radius)) continue;
+
+			if (node.leaf()) {
+				results.push_back(node.userData);
+				continue;
+			}
+
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+
+	// Subtrees fully inside the frustum are collected without testing their children
+	void DynamicBvh::query(Frustum const& frustum, std::vector<uint32_t>& results) const {
+		if (mRoot == kNull) return;
+
+		std::vector<Proxy> stack;
+		stack.reserve(64);
+		stack.push_back(mRoot);
+
+		while (!stack.empty()) {
+			Proxy index = stack.back();
+			stack.pop_back();
+
+			Node const& node = mNodes[index];
+			Containment containment = frustum.classify(node.box);
+
+			if (containment == Containment::kOutside) continue;
+
+			if (containment == Containment::kInside || node.leaf()) {
+				collectLeaves(index, results, stack);
+				continue;
+			}
+
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+
+	void DynamicBvh::raycast(Ray const& ray, float maxDistance, std::vector<RayHit>& results) const {
+		if (mRoot == kNull) return;
+
+		size_t first = results.size();
+		std::vector<Proxy> stack;
+		stack.reserve(64);
+		stack.push_back(mRoot);
+
+		while (!stack.empty()) {
+			Node const& node = mNodes[stack.back()];
+			stack.pop_back();
+
+			auto distance = node.box.raycast(ray, maxDistance);
+			if (!distance.has_value()) continue;
+
+			if (node.leaf()) {
+				results.push_back({ node.userData, distance.value() });
+				continue;
+			}
+
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+
+		std::sort(results.begin() + first, results.end(), [](RayHit const& a, RayHit const& b) { return a.distance < b.distance; });
+	}
+}
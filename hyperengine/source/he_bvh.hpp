@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "graphics/he_bounds.hpp"
+
+namespace hyperengine {
+	// Incrementally updated bounding volume hierarchy over fattened boxes
+	// Leaves are only reinserted once their box leaves the fat box, small movements cost a containment test
+	// Queries append the user data of every hit to `results` so callers can batch them
+	class DynamicBvh final {
+	public:
+		using Proxy = int32_t;
+		static constexpr Proxy kNull = -1;
+
+		struct CreateInfo final {
+			float margin = 0.1f;
+			size_t capacity = 0;
+		};
+
+		struct RayHit final {
+			uint32_t userData;
+			float distance;
+		};
+
+		DynamicBvh() : DynamicBvh(CreateInfo{}) {}
+		DynamicBvh(CreateInfo const& info);
+
+		Proxy insert(Aabb const& box, uint32_t userData);
+		void remove(Proxy proxy);
+		// Returns true if the leaf had to be reinserted, the fat box is stretched along `displacement` to predict further motion
+		bool move(Proxy proxy, Aabb const& box, glm::vec3 displacement = glm::vec3(0.0f));
+		void clear();
+
+		inline uint32_t userData(Proxy proxy) const { return mNodes[proxy].userData; }
+		inline Aabb const& fatBox(Proxy proxy) const { return mNodes[proxy].box; }
+		inline size_t size() const { return mLeafCount; }
+		inline int height() const { return mRoot == kNull ? 0 : mNodes[mRoot].height; }
+
+		void query(Aabb const& box, std::vector<uint32_t>& results) const;
+		void query(BoundingSphere const& sphere, std::vector<uint32_t>& results) const;
+		void query(Frustum const& frustum, std::vector<uint32_t>& results) const;
+		// Hits on fat boxes sorted by entry distance, callers refine front to back
+		void raycast(Ray const& ray, float maxDistance, std::vector<RayHit>& results) const;
+	private:
+		struct Node final {
+			Aabb box;
+			Proxy parent = kNull; // Next free node while on the free list
+			Proxy child1 = kNull;
+			Proxy child2 = kNull;
+			int32_t height = -1; // Leaves are 0, free nodes are -1
+			uint32_t userData = 0;
+
+			inline bool leaf() const { return child1 == kNull; }
+		};
+
+		Aabb fatten(Aabb const& box, glm::vec3 displacement) const;
+		Proxy allocateNode();
+		void freeNode(Proxy node);
+		void insertLeaf(Proxy leaf);
+		void removeLeaf(Proxy leaf);
+		Proxy balance(Proxy node);
+		void collectLeaves(Proxy node, std::vector<uint32_t>& results, std::vector<Proxy>& stack) const;
+
+		std::vector<Node> mNodes;
+		Proxy mRoot = kNull;
+		Proxy mFree = kNull;
+		size_t mLeafCount = 0;
+		float mMargin = 0.1f;
+	};
+}
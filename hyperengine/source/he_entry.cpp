@@ -17,7 +17,13 @@
 #include <span>
 #include <memory>
 #include <sstream>
+#include <cstring>
+#include <atomic>
 #include <regex>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
 
 #include "gui/he_console.hpp"
 #include "gui/he_texteditor.hpp"
@@ -33,7 +39,6 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
-#include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -41,15 +46,31 @@
 #include "he_io.hpp"
 #include "he_util.hpp"
 #include "he_audio.hpp"
+#include "he_benchmark.hpp"
+#include "he_bvh.hpp"
+#include "he_jobs.hpp"
+#include "he_transform.hpp"
+#include "he_hierarchy.hpp"
 
 #include "graphics/he_framebuffer.hpp"
+#include "graphics/he_commandlist.hpp"
+#include "graphics/he_framegraph.hpp"
+#include "graphics/he_gpuprofiler.hpp"
+#include "graphics/he_governor.hpp"
+#include "graphics/he_lightclusters.hpp"
 #include "graphics/he_gl.hpp"
 #include "graphics/he_window.hpp"
 #include "graphics/he_rdoc.hpp"
 #include "graphics/he_mesh.hpp"
+#include "graphics/he_bounds.hpp"
 #include "graphics/he_texture.hpp"
 #include "graphics/he_shader.hpp"
-#include "graphics/he_renderbuffer.hpp"
+#include "graphics/he_shadercache.hpp"
+#include "graphics/he_shaderpreprocessor.hpp"
+#include "graphics/he_renderqueue.hpp"
+#include "graphics/he_ringbuffer.hpp"
+#include "graphics/he_material.hpp"
+#include "graphics/he_occlusion.hpp"
 
 #include <format>
 
@@ -101,30 +122,6 @@ constexpr std::string_view kInternalTextureUvName = "internal://uv.png";
 constexpr std::string_view kInternalTextureCheckerboardName = "internal://checkerboard.png";
 // !!! NOTICE !!! When adding to this list, make sure to update the definition inside gui/he_filesystem.hpp
 
-struct Transform final {
-	glm::vec3 translation{};
-	glm::quat orientation = glm::identity<glm::quat>();
-	glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
-
-	glm::mat4 get() const {
-		glm::vec3 skew = glm::zero<glm::vec3>();
-		glm::vec4 perspective(0.0f, 0.0f, 0.0f, 1.0f);
-		return glm::recompose(scale, orientation, translation, skew, perspective);
-	}
-
-	void set(glm::mat4 const& mat) {
-		glm::vec3 skew;
-		glm::vec4 perspective;
-		glm::decompose(mat, scale, orientation, translation, skew, perspective);
-	}
-
-	void translate(glm::vec3 direction) {
-		glm::mat4 matrix = get();
-		matrix = glm::translate(matrix, direction);
-		set(matrix);
-	}
-};
-
 static std::unordered_map<std::string, ImFont*> fonts;
 
 static void initImGui(hyperengine::Window& window) {
@@ -190,66 +187,96 @@ static void imguiEndFrame() {
 struct GameObjectComponent final {
 	std::string name;
 	hyperengine::Uuid uuid = hyperengine::Uuid::generate();
-	Transform transform;
+	hyperengine::Transform transform;
 
 	GameObjectComponent() {
 		std::stringstream ss;
 		ss << "unnamed " << std::hex << (uint64_t)uuid;
 		name = ss.str();
 	}
-
-	// unused rn
-	entt::entity parent = entt::null;
-	entt::entity first = entt::null;
-	entt::entity prev = entt::null;
-	entt::entity next = entt::null;
 };
 
 struct MeshFilterComponent {
 	std::shared_ptr<hyperengine::Mesh> mesh;
 };
 
-// TODO: It's possible to get heap corruption when hotswapping shaders with different material sizes,
-// need to look into fixing this
-struct MeshRendererComponent {
-	std::shared_ptr<hyperengine::ShaderProgram> shader;
-	std::vector<uint8_t> data;
-	GLuint uniformBuffer = 0;
-	std::array<std::shared_ptr<hyperengine::Texture>, 8> textures;
+// World matrix of the game object, only recomposed after its transform or one of its parents was marked dirty
+// The game object transform is relative to the parent, parent links live in the engine transform hierarchy
+struct WorldTransformComponent final {
+	glm::mat4 matrix{ 1.0f };
+	hyperengine::TransformHierarchy::Node node = hyperengine::TransformHierarchy::kNull;
+};
 
-	void resetMaterial() {
-		for (int i = 0; i < textures.size(); ++i)
-			textures[i] = nullptr;
+// Tags game objects whose transform or mesh changed since the last world transform update
+struct TransformDirtyComponent final {};
 
-		if (uniformBuffer)
-			glDeleteBuffers(1, &uniformBuffer);
+// Leaf of an entity in the scene BVH, the translation and mesh are the ones its box was computed from
+struct SpatialComponent final {
+	hyperengine::DynamicBvh::Proxy proxy = hyperengine::DynamicBvh::kNull;
+	glm::vec3 translation{};
+	hyperengine::Mesh const* mesh = nullptr;
+};
+
+// Renderers share materials, the material data is copied into the frame ring once per frame for every distinct material drawn
+struct MeshRendererComponent {
+	std::shared_ptr<hyperengine::Material> material;
 
-		// realloc buffer
-		data = std::vector<uint8_t>();
+	// Copy on write, a material loaded from a file or used by other renderers is copied before the first change
+	hyperengine::Material& editMaterial() {
+		if (!material)
+			material = std::make_shared<hyperengine::Material>();
+		else if (material.use_count() > 1 || !material->origin().empty())
+			material = material->clone();
 
-		// Attempt to allocate material data
-		allocateMaterialBuffer();
+		return *material;
 	}
+};
 
-	void allocateMaterialBuffer() {
-		if (!shader) return;
-		auto allocation = shader->materialAllocationSize();
-		data.resize(allocation);
-		memset(data.data(), 0, allocation);
+// One draw of the render queue, transform doubles as instance data
+struct DrawPacket final {
+	hyperengine::ShaderProgram* program;
+	hyperengine::Mesh* mesh;
+	hyperengine::Material* material;
+	uint64_t materialHash;
+	glm::mat4 transform;
+};
 
-		// TODO: Implment buffer abstraction, we actually leak memory a bit rn
-		glGenBuffers(1, &uniformBuffer);
-		glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
-		glBufferData(GL_UNIFORM_BUFFER, allocation, nullptr, GL_STREAM_DRAW);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
-	}
+struct CullCandidate final {
+	hyperengine::Material* material;
+	hyperengine::Mesh* mesh;
+	glm::mat4 transform;
+	glm::vec3 position;
+};
 
-	void uploadAndPrep() {
-		glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
-		glBufferSubData(GL_UNIFORM_BUFFER, 0, data.size(), data.data());
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
-		glBindBufferBase(GL_UNIFORM_BUFFER, 1, uniformBuffer);
-	}
+// Draws submitted with one API call, either a single (instanced) draw or a multi draw indirect over `commandCount` commands
+struct DrawGroup final {
+	uint32_t packet;
+	uint32_t first;
+	uint32_t count = 0;
+	uint32_t firstCommand = 0;
+	uint32_t commandCount = 0;
+	bool instanced;
+	GLintptr materialOffset = -1; // Material block in the frame ring, negative without material data
+	GLsizeiptr materialSize = 0;
+};
+
+// Draw groups of one pass recorded into a single command list
+struct RecordJob final {
+	hyperengine::RenderPass pass;
+	uint32_t first;
+	uint32_t last;
+};
+
+// Command lists of a pass, replayed in order
+struct CommandRange final {
+	uint32_t first = 0;
+	uint32_t count = 0;
+};
+
+struct CommandStats final {
+	size_t commands = 0;
+	size_t lists = 0;
+	size_t bytes = 0;
 };
 
 struct CameraComponent final {
@@ -258,35 +285,58 @@ struct CameraComponent final {
 };
 
 struct LightComponent final {
+	enum struct Type : uint8_t { kDirectional, kPoint, kSpot };
+
+	Type type = Type::kDirectional;
 	glm::vec3 color = glm::vec3(1.0f);
 	float strength = 3.0f;
+	float range = 10.0f; // Point and spot lights fall off to nothing here
+	glm::vec2 angles = { 20.0f, 30.0f }; // Spot inner and outer half angles in degrees
 };
 
 struct UniformEngineData final {
 	glm::mat4 projection;   
 	glm::mat4 view;
-	glm::mat4 lightmat;
+	std::array<glm::mat4, hyperengine::kShadowCascades> lightmats;
 	glm::vec3 skyColor;
 	float farPlane;
 	glm::vec3 sunDirection;
 	float gTime;
 	glm::vec3 sunColor;
-	float HE_UNNAMABLE;
+	int32_t cascade;
+	glm::vec4 cascadeSplits;
+	glm::uvec4 clusterGrid;
+	glm::vec4 clusterScale;
 };
 
 // Assert layout matches glsl std140
-static_assert(sizeof(UniformEngineData) == 240);
-static_assert(offsetof(UniformEngineData, projection)   ==   0);
-static_assert(offsetof(UniformEngineData, view)         ==  64);
-static_assert(offsetof(UniformEngineData, lightmat)     == 128);
-static_assert(offsetof(UniformEngineData, skyColor)     == 192);
-static_assert(offsetof(UniformEngineData, farPlane)     == 204);
-static_assert(offsetof(UniformEngineData, sunDirection) == 208);
-static_assert(offsetof(UniformEngineData, gTime)        == 220);
-static_assert(offsetof(UniformEngineData, sunColor)     == 224);
+static_assert(sizeof(UniformEngineData) == 480);
+static_assert(offsetof(UniformEngineData, projection)    ==   0);
+static_assert(offsetof(UniformEngineData, view)          ==  64);
+static_assert(offsetof(UniformEngineData, lightmats)     == 128);
+static_assert(offsetof(UniformEngineData, skyColor)      == 384);
+static_assert(offsetof(UniformEngineData, farPlane)      == 396);
+static_assert(offsetof(UniformEngineData, sunDirection)  == 400);
+static_assert(offsetof(UniformEngineData, gTime)         == 412);
+static_assert(offsetof(UniformEngineData, sunColor)      == 416);
+static_assert(offsetof(UniformEngineData, cascade)       == 428);
+static_assert(offsetof(UniformEngineData, cascadeSplits) == 432);
+static_assert(offsetof(UniformEngineData, clusterGrid)   == 448);
+static_assert(offsetof(UniformEngineData, clusterScale)  == 464);
+
+// A cascade keeps the matrix it was last rendered with, shading reads that one until it is rendered again
+struct ShadowCascade final {
+	glm::mat4 matrix{ 1.0f };
+	glm::vec3 center{};
+	float extent = 0.0f;
+	uint64_t signature = 0;
+	uint32_t age = 0;
+	bool valid = false;
+	bool render = false;
+};
 
 struct Views final {
-	bool flatHierarchy = true;
+	bool hierarchy = true;
 	bool properties = true;
 	bool viewport = true;
 	bool console = true;
@@ -296,7 +346,7 @@ struct Views final {
 	bool experimentAudio = false;
 
 	void drawUi() {
-		ImGui::MenuItem("Hierarchy", nullptr, &flatHierarchy);
+		ImGui::MenuItem("Hierarchy", nullptr, &hierarchy);
 		ImGui::MenuItem("Properties", nullptr, &properties);
 		ImGui::MenuItem("Viewport", nullptr, &viewport);
 		ImGui::MenuItem("Console", nullptr, &console);
@@ -450,19 +500,21 @@ ATTRIBUTE_ALIGNED16(struct) EngineMotionState : public btMotionState {
 	BT_DECLARE_ALIGNED_ALLOCATOR();
 	EngineMotionState(entt::handle handle) : mHandle(handle) {}
 
+	// Bodies are unscaled, only translation and orientation are exchanged
+	// They drive the local transform, which is only the world transform for objects without a parent
 	virtual void getWorldTransform(btTransform& worldTrans) const override {
-		auto transform = mHandle.get<GameObjectComponent>().transform;
-		transform.scale = glm::vec3(1.0f);
-		worldTrans.setFromOpenGLMatrix(glm::value_ptr(transform.get()));
+		auto const& transform = mHandle.get<GameObjectComponent>().transform;
+		worldTrans.setOrigin(btVector3(transform.translation.x, transform.translation.y, transform.translation.z));
+		worldTrans.setRotation(btQuaternion(transform.orientation.x, transform.orientation.y, transform.orientation.z, transform.orientation.w));
 	}
 
 	virtual void setWorldTransform(btTransform const& worldTrans) override {
-		glm::mat4 matrix;
-		worldTrans.getOpenGLMatrix(glm::value_ptr(matrix));
 		auto& transform = mHandle.get<GameObjectComponent>().transform;
-		glm::vec3 oldScale = transform.scale;
-		transform.set(matrix);
-		transform.scale = oldScale;
+		btVector3 const& origin = worldTrans.getOrigin();
+		btQuaternion rotation = worldTrans.getRotation();
+		transform.translation = glm::vec3(origin.x(), origin.y(), origin.z());
+		transform.orientation = glm::quat(rotation.w(), rotation.x(), rotation.y(), rotation.z());
+		mHandle.emplace_or_replace<TransformDirtyComponent>();
 	}
 };
 
@@ -578,12 +630,19 @@ struct Engine final {
 			mResourceManager.mTextures[std::string(kInternalTextureUvName)] = mInternalTextureUv;
 		}
 
-		mAcesProgram = mResourceManager.getShaderProgram("shaders/aces.glsl", mFileErrors);
-		mShadowProgram = mResourceManager.getShaderProgram("shaders/shadow.glsl", mFileErrors);
+		mAcesProgram = mResourceManager.getShaderProgram("shaders/aces.glsl");
+		mShadowProgram = mResourceManager.getShaderProgram("shaders/shadow.glsl");
+		mFallbackProgram = mResourceManager.getShaderProgram("shaders/fallback.glsl");
+		mResourceManager.waitShaders(mFileErrors);
 	}
 
-	void init() {
-		mWindow = {{ .width = 1280, .height = 720, .title = "HyperEngine", .maximized = true }};
+	bool init(bool headless = false) {
+		if (headless)
+			mWindow = {{ .width = 64, .height = 64, .title = "HyperEngine", .headless = true }};
+		else
+			mWindow = {{ .width = 1280, .height = 720, .title = "HyperEngine", .maximized = true }};
+
+		if (!mWindow.handle()) return false;
 
 		glfwMakeContextCurrent(mWindow.handle());
 		gladLoadGL(&glfwGetProcAddress);
@@ -597,13 +656,21 @@ struct Engine final {
 			glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
 		}
 
+		// Let the driver pick its own worker count
+		if (GLAD_GL_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else if (GLAD_GL_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
 		glfwSetWindowUserPointer(mWindow.handle(), this);
 		glfwSetWindowCloseCallback(mWindow.handle(), [](GLFWwindow* window) {
 			static_cast<Engine*>(glfwGetWindowUserPointer(window))->mRunning = false;
 		});
 
-		initImGui(mWindow);
-		mAudioEngine.init("");
+		if (!headless) {
+			initImGui(mWindow);
+			mAudioEngine.init("");
+		}
 
 		createInternalTextures();
 
@@ -612,16 +679,46 @@ struct Engine final {
 		glDisable(GL_MULTISAMPLE);
 		glCullFace(GL_BACK);
 
-		// TODO: Implment buffer abstraction, we actually leak memory a bit rn
-		glGenBuffers(1, &mEngineUniformBuffer);
-		glBindBuffer(GL_UNIFORM_BUFFER, mEngineUniformBuffer);
-		glBufferData(GL_UNIFORM_BUFFER, sizeof(decltype(mUniformEngineData)), nullptr, GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
-		glBindBufferBase(GL_UNIFORM_BUFFER, 0, mEngineUniformBuffer);
+		GLint uniformAlignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+		mUniformAlignment = std::max<GLsizeiptr>(uniformAlignment, 16);
+		mFrameRing = hyperengine::RingBuffer({ .regionSize = 1 << 20, .regions = 3, .label = "Frame Ring" });
+		mGpuProfiler = hyperengine::GpuProfiler({ .latency = 4, .scopes = 32, .history = 240 });
+		mLightClusters = hyperengine::LightClusters({ .grid = { 16, 9, 24 }, .maxLights = 4096 });
+
+		// Milliseconds per pass, eg: `GpuBudgets = { opaque = 4.0 }` in config.lua
+		{
+			lua_State* L = luaL_newstate();
+			if (luaL_dofile(L, "config.lua") == LUA_OK) {
+				lua_getglobal(L, "TextureArrays");
+				mResourceManager.mPackTextures = lua_toboolean(L, -1);
+				lua_pop(L, 1);
+
+				// Frames per second the governor holds, zero turns it off
+				lua_getglobal(L, "TargetFrameRate");
+				if (lua_isnumber(L, -1)) {
+					double rate = lua_tonumber(L, -1);
+					mGovernorEnabled = rate > 0.0;
+					if (mGovernorEnabled) mGovernor.target(static_cast<float>(1000.0 / rate));
+				}
+				lua_pop(L, 1);
+
+				lua_getglobal(L, "GpuBudgets");
+				if (lua_istable(L, -1)) {
+					lua_pushnil(L);
+					while (lua_next(L, -2) != 0) {
+						if (lua_type(L, -2) == LUA_TSTRING && lua_isnumber(L, -1))
+							mGpuProfiler.budget(lua_tostring(L, -2), static_cast<float>(lua_tonumber(L, -1)));
+						lua_pop(L, 1);
+					}
+				}
+			}
+			lua_close(L);
+		}
+
 		genShadowmap();
 		editorOpNewScene();
-
-		
+		return true;
 	}
 
 	void genShadowmap() {
@@ -631,6 +728,7 @@ struct Engine final {
 		mFramebufferShadowDepth = {{
 				.width = mShadowMapSize,
 				.height = mShadowMapSize,
+				.depth = static_cast<GLsizei>(hyperengine::kShadowCascades),
 				.format = hyperengine::PixelFormat::kD24,
 				.minFilter = kNearest,
 				.magFilter = kNearest,
@@ -638,30 +736,51 @@ struct Engine final {
 				.label = "shadow depth"
 			}};
 
-		std::array<hyperengine::Framebuffer::Attachment, 1> attachments{
-			hyperengine::Framebuffer::Attachment(GL_DEPTH_ATTACHMENT, std::ref(mFramebufferShadowDepth)),
-		};
+		// One framebuffer per layer so each cascade is rendered on its own
+		for (size_t i = 0; i < hyperengine::kShadowCascades; ++i) {
+			std::array<hyperengine::Framebuffer::Attachment, 1> attachments{
+				hyperengine::Framebuffer::Attachment(GL_DEPTH_ATTACHMENT, std::ref(mFramebufferShadowDepth), static_cast<GLint>(i)),
+			};
+
+			mFramebufferShadow[i] = {{ .attachments = attachments }};
+		}
 
-		mFramebufferShadow = {{ .attachments = attachments }};
+		for (ShadowCascade& cascade : mCascades)
+			cascade.valid = false;
 	}
 
 	void run() {
-		init();
+		if (!init()) {
+			spdlog::critical("Failed to create a window");
+			return;
+		}
 
 		mEmptyMesh = {{ .origin = "Empty Mesh" }};
 
 		while (mRunning) {
+			auto frameStart = std::chrono::steady_clock::now();
 			glfwPollEvents();
 			glfwGetFramebufferSize(mWindow.handle(), &mFramebufferSize.x, &mFramebufferSize.y);
 
 			if (mFramebufferSize.x > 0 && mFramebufferSize.y > 0) {
+				mGpuProfiler.beginFrame();
 				hyperengine::Framebuffer().bind();
 				imguiBeginFrame();
 				mResourceManager.update();
+				mResourceManager.pollShaders(mFileErrors);
+				mTime = static_cast<float>(glfwGetTime());
+				updateWorldTransforms();
+				updateSpatialIndex();
 				update();
 				mPhysicsWorld.stepSimulation(ImGui::GetIO().DeltaTime, 10);
 				hyperengine::Framebuffer().bind();
+				mGpuProfiler.begin("ui");
 				imguiEndFrame();
+				mGpuProfiler.end();
+
+				// The wait in the swap is left out, that is the gpu or the display catching up
+				if (mGovernorEnabled)
+					mGovernor.update(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count(), mGpuProfiler.frameTime());
 			}
 
 			mWindow.swapBuffers();
@@ -677,6 +796,109 @@ struct Engine final {
 		FrameMark;
 	}
 
+	struct HeadlessInfo final {
+		std::string scene;
+		glm::ivec2 size = { 1280, 720 };
+		int frames = 100;
+		std::string output;
+		std::string timings;
+	};
+
+	// Renders the first scene camera into the viewport target with no ImGui, audio or swapchain.
+	// Time and physics advance by a fixed step so every run of a scene produces the same frames
+	int runHeadless(HeadlessInfo const& info) {
+		if (!init(true)) {
+			spdlog::critical("Failed to create a headless OpenGL context");
+			return 1;
+		}
+
+		spdlog::info("Headless on {}, {}", hyperengine::glContextInfo().renderer, hyperengine::glContextInfo().version);
+
+		// Runs stay comparable, every frame renders at the requested size and quality
+		mGovernorEnabled = false;
+
+		mEmptyMesh = {{ .origin = "Empty Mesh" }};
+		loadScene(info.scene.c_str());
+		resizeFramebuffers(info.size);
+
+		constexpr float kStep = 1.0f / 60.0f;
+		int frame = 0;
+
+		auto render = [&]() {
+			mGpuProfiler.beginFrame();
+			mTime = static_cast<float>(frame++) * kStep;
+			mResourceManager.update();
+			mResourceManager.pollShaders(mFileErrors);
+			updateWorldTransforms();
+			updateSpatialIndex();
+
+			hyperengine::Transform cameraTransform = mEditorCameraTransform;
+			CameraComponent camera = mEditorCamera;
+			for (auto&& [entity, world, sceneCamera] : mRegistry.view<WorldTransformComponent, CameraComponent>().each()) {
+				cameraTransform.set(world.matrix);
+				camera = sceneCamera;
+				break;
+			}
+
+			glm::vec3 sunDirection;
+			glm::vec3 sunColor;
+			findSun(sunDirection, sunColor);
+
+			drawScene(cameraTransform, camera, sunDirection, sunColor);
+			mPhysicsWorld.stepSimulation(kStep, 10);
+			glFinish();
+
+			TracyGpuCollect;
+			FrameMark;
+		};
+
+		if (mRegistry.view<CameraComponent>().empty())
+			spdlog::warn("{} has no camera, rendering from the origin", info.scene);
+
+		// The first frame requests the shader permutations, finish them so no measured frame draws with a fallback
+		render();
+		for (auto& [path, weak] : mResourceManager.mShaders)
+			if (auto program = weak.lock()) program->waitVariants();
+
+		std::vector<double> times;
+		times.reserve(info.frames);
+
+		for (int i = 0; i < info.frames; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			render();
+			times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		if (!times.empty()) {
+			double total = 0.0;
+			for (double time : times) total += time;
+			std::sort(times.begin(), times.end());
+
+			spdlog::info("{} frames at {}x{}: mean {:.3f} ms, median {:.3f} ms, p95 {:.3f} ms, max {:.3f} ms", times.size(), info.size.x, info.size.y,
+				total / times.size(), times[times.size() / 2], times[times.size() * 95 / 100], times.back());
+		}
+
+		for (auto const& timing : mGpuProfiler.timings())
+			spdlog::info("gpu {:<10} mean {:.3f} ms, median {:.3f} ms, p95 {:.3f} ms{}", timing.name, timing.mean, timing.median, timing.p95, timing.overBudget() ? ", over budget" : "");
+
+		if (!info.timings.empty() && !mGpuProfiler.exportCsv(info.timings.c_str()))
+			spdlog::error("Failed to write {}", info.timings);
+
+		if (!info.output.empty()) {
+			std::vector<std::byte> pixels(static_cast<size_t>(mViewportSize.x) * mViewportSize.y * 4);
+			mPostFramebufferColor.download(hyperengine::PixelFormat::kRgba8, pixels);
+
+			if (!hyperengine::writeImagePpm(info.output.c_str(), mViewportSize.x, mViewportSize.y, pixels)) {
+				spdlog::error("Failed to write {}", info.output);
+				return 1;
+			}
+
+			spdlog::info("Wrote {}", info.output);
+		}
+
+		return 0;
+	}
+
 	void audioExperiment() {
 		if (!mViews.experimentAudio) return;
 
@@ -704,6 +926,9 @@ struct Engine final {
 						ImGui::SetClipboardText(formatted.c_str());
 					}
 
+					entt::entity parent = ptr->parentOf(ptr->mSelected);
+					ImGui::LabelText("Parent", "%s", parent == entt::null ? "<none>" : ptr->mRegistry.get<GameObjectComponent>(parent).name.c_str());
+
 					bool edited = false;
 
 					edited |= drawVec3Control("Translation", comp.transform.translation, 0.0f, false);
@@ -721,6 +946,8 @@ struct Engine final {
 					edited |= drawVec3Control("Scale", comp.transform.scale, 1.0f);
 
 					if (edited) {
+						ptr->markTransformDirty(ptr->mSelected);
+
 						auto* physics = ptr->mRegistry.try_get<PhysicsComponent>(ptr->mSelected);
 						if (physics) {
 							if (ptr->mOperation == ImGuizmo::TRANSLATE) {
@@ -735,8 +962,19 @@ struct Engine final {
 				}, false);
 
 				bool hasLight = drawComponentEditGui<LightComponent, Engine>(mRegistry, mSelected, "Light", this, [](auto& comp, auto* ptr) {
+					constexpr char const* kTypes[] = { "Directional", "Point", "Spot" };
+					int type = static_cast<int>(comp.type);
+					if (ImGui::Combo("Type", &type, kTypes, IM_ARRAYSIZE(kTypes)))
+						comp.type = static_cast<LightComponent::Type>(type);
+
 					ImGui::ColorEdit3("Color", glm::value_ptr(comp.color));
 					ImGui::DragFloat("Strength", &comp.strength, 0.1f);
+
+					if (comp.type != LightComponent::Type::kDirectional)
+						ImGui::DragFloat("Range", &comp.range, 0.1f, 0.01f, 1000.0f);
+
+					if (comp.type == LightComponent::Type::kSpot)
+						ImGui::DragFloat2("Angles", glm::value_ptr(comp.angles), 0.5f, 0.0f, 90.0f);
 				});
 
 				bool hasMeshFilter = drawComponentEditGui<MeshFilterComponent, Engine>(mRegistry, mSelected, "Mesh Filter", this, [](auto& comp, auto* ptr) {
@@ -749,82 +987,117 @@ struct Engine final {
 						if (ImGuiPayload const* payload = ImGui::AcceptDragDropPayload("FilesystemFile")) {
 							std::string path((char const*)payload->Data, payload->DataSize);
 							comp.mesh = ptr->mResourceManager.getMesh(path);
+							ptr->markTransformDirty(ptr->mSelected);
 						}
 						ImGui::EndDragDropTarget();
 					}
 				});
 
 				bool hasMeshRenderer = drawComponentEditGui<MeshRendererComponent, Engine>(mRegistry, mSelected, "Mesh Renderer", this, [](auto& comp, auto* ptr) {
-					if (comp.shader)
-						ImGui::LabelText("Shader", "%s", comp.shader->origin().c_str());
+					if (!comp.material)
+						ImGui::LabelText("Material", "%s", "<null>");
+					else if (comp.material->origin().empty())
+						ImGui::LabelText("Material", "<instance> (%ld users)", comp.material.use_count());
+					else
+						ImGui::LabelText("Material", "%s (%ld users)", comp.material->origin().c_str(), comp.material.use_count());
+
+					if (ImGui::BeginDragDropTarget()) {
+						if (ImGuiPayload const* payload = ImGui::AcceptDragDropPayload("FilesystemFile")) {
+							std::string path((char const*)payload->Data, payload->DataSize);
+							if (path.ends_with(".lua"))
+								comp.material = ptr->mResourceManager.getMaterial(path);
+						}
+						ImGui::EndDragDropTarget();
+					}
+
+					std::shared_ptr<hyperengine::ShaderProgram> shader = comp.material ? comp.material->shader() : nullptr;
+
+					if (shader)
+						ImGui::LabelText("Shader", "%s", shader->origin().c_str());
 					else
 						ImGui::LabelText("Shader", "%s", "<null>");	
 
 					if (ImGui::BeginDragDropTarget()) {
 						if (ImGuiPayload const* payload = ImGui::AcceptDragDropPayload("FilesystemFile")) {
 							std::string path((char const*)payload->Data, payload->DataSize);
-							comp.shader = ptr->mResourceManager.getShaderProgram(path, ptr->mFileErrors);
-							comp.resetMaterial();
+							comp.editMaterial().shader(ptr->mResourceManager.getShaderProgram(path));
 						}
 						ImGui::EndDragDropTarget();
 					}
 
-					if(comp.shader)
-						for (auto const& [k, v] : comp.shader->materialInfo()) {
-
-							using enum hyperengine::ShaderProgram::UniformType;
-
-							void* ptr = comp.data.data() + v.offset;
-
-							switch (v.type) {
-								case kFloat:
-									ImGui::DragFloat(k.c_str(), (float*)ptr);
-									break;
-								case kVec2f:
-									ImGui::DragFloat2(k.c_str(), (float*)ptr);
-									break;
-								case kVec3f:
-								{
-									if (comp.shader->editHint(k) == "color")
-										ImGui::ColorEdit3(k.c_str(), (float*)ptr);
-									else
-										ImGui::DragFloat3(k.c_str(), (float*)ptr);
-									break;
-								}
-								case kVec4f:
-									ImGui::DragFloat4(k.c_str(), (float*)ptr);
-									break;
-							default:
-								ImGui::Text("Unsupported property %s", k.c_str());
+					if (!shader) return;
+
+					if (shader->failed())
+						ImGui::TextDisabled("Failed to link");
+					else if (!shader->ready())
+						ImGui::TextDisabled("Compiling...");
+
+					comp.material->update();
+
+					// Edits go through a copy so a shared material is only cloned once something actually changes
+					for (auto const& [k, v] : shader->materialInfo()) {
+						using enum hyperengine::ShaderProgram::UniformType;
+						if (shader->editHint(k) == "hidden") continue;
+
+						std::span<uint8_t const> data = comp.material->data();
+						if (v.offset < 0 || static_cast<size_t>(v.offset) >= data.size()) continue;
+
+						std::array<float, 4> values{};
+						size_t size = std::min(sizeof(values), data.size() - v.offset);
+						std::memcpy(values.data(), data.data() + v.offset, size);
+
+						bool changed = false;
+
+						switch (v.type) {
+							case kFloat:
+								changed = ImGui::DragFloat(k.c_str(), values.data());
+								break;
+							case kVec2f:
+								changed = ImGui::DragFloat2(k.c_str(), values.data());
+								break;
+							case kVec3f:
+							{
+								if (shader->editHint(k) == "color")
+									changed = ImGui::ColorEdit3(k.c_str(), values.data());
+								else
+									changed = ImGui::DragFloat3(k.c_str(), values.data());
+								break;
 							}
+							case kVec4f:
+								changed = ImGui::DragFloat4(k.c_str(), values.data());
+								break;
+						default:
+							ImGui::Text("Unsupported property %s", k.c_str());
 						}
 
+						if (changed)
+							std::memcpy(comp.editMaterial().editData().data() + v.offset, values.data(), size);
+					}
+
 					// Present texture options
-					if (comp.shader) {
-						for (auto const& [k, v] : comp.shader->opaqueAssignments()) {
-							if (comp.shader->editHint(k) == "hidden") continue;
+					for (auto const& [k, v] : shader->opaqueAssignments()) {
+						if (shader->editHint(k) == "hidden") continue;
 
-							ImGui::PushID(v);
+						ImGui::PushID(v);
 
-							auto& texture = comp.textures[v];
-							
-							ImGui::LabelText(k.c_str(), "%s", texture ? texture->origin().c_str() : "<null>");
+						auto const& texture = comp.material->texture(v);
+						
+						ImGui::LabelText(k.c_str(), "%s", texture ? texture->origin().c_str() : "<null>");
 
-							if(!texture)
-								ImGui::Image((void*)(uintptr_t)ptr->mInternalTextureCheckerboard->handle(), {64, 64}, {0, 1}, {1, 0});
-							else
-								ImGui::Image((void*)(uintptr_t)texture->handle(), { 64, 64 }, { 0, 1 }, { 1, 0 });
+						if(!texture)
+							ImGui::Image((void*)(uintptr_t)ptr->mInternalTextureCheckerboard->handle(), {64, 64}, {0, 1}, {1, 0});
+						else
+							ImGui::Image((void*)(uintptr_t)texture->handle(), { 64, 64 }, { 0, 1 }, { 1, 0 });
 
-							if (ImGui::BeginDragDropTarget()) {
-								if (ImGuiPayload const* payload = ImGui::AcceptDragDropPayload("FilesystemFile")) {
-									std::string path((char const*)payload->Data, payload->DataSize);
-									comp.textures[v] = ptr->mResourceManager.getTexture(path);
-								}
-								ImGui::EndDragDropTarget();
+						if (ImGui::BeginDragDropTarget()) {
+							if (ImGuiPayload const* payload = ImGui::AcceptDragDropPayload("FilesystemFile")) {
+								std::string path((char const*)payload->Data, payload->DataSize);
+								comp.editMaterial().texture(v, ptr->mResourceManager.getTexture(path));
 							}
-
-							ImGui::PopID();
+							ImGui::EndDragDropTarget();
 						}
+
+						ImGui::PopID();
 					}
 				});
 
@@ -872,50 +1145,90 @@ struct Engine final {
 		
 	}
 
-	void drawGuiFlatHierarchy() {
-		ZoneScoped;
+	void drawGuiHierarchyNode(entt::entity entity, GameObjectComponent const& gameObject, WorldTransformComponent const& world) {
+		using hyperengine::TransformHierarchy;
 
-		if (!mViews.flatHierarchy) return;
+		TransformHierarchy::Node child = mHierarchy.firstChild(world.node);
 
-		if (ImGui::Begin("Flat Hierarchy", &mViews.flatHierarchy)) {
-			for (auto&& [entity, gameObject] : mRegistry.view<GameObjectComponent>().each()) {
-				ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_SpanAvailWidth;
-				if (mSelected == entity)
-					flags |= ImGuiTreeNodeFlags_Selected;
+		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_SpanAvailWidth;
+		if (child == TransformHierarchy::kNull)
+			flags |= ImGuiTreeNodeFlags_Leaf;
+		if (mSelected == entity)
+			flags |= ImGuiTreeNodeFlags_Selected;
 
-				bool opened = ImGui::TreeNodeEx((void*)(uintptr_t)entity, flags, "%s", gameObject.name.c_str());
-				if (ImGui::IsItemActive())
-					mSelected = entity;
+		bool opened = ImGui::TreeNodeEx((void*)(uintptr_t)entity, flags, "%s", gameObject.name.c_str());
+		if (ImGui::IsItemActive())
+			mSelected = entity;
 
-				bool shouldDelete = false;
+		if (ImGui::BeginDragDropSource()) {
+			ImGui::SetDragDropPayload("Entity", &entity, sizeof(entity));
+			ImGui::TextUnformatted(gameObject.name.c_str());
+			ImGui::EndDragDropSource();
+		}
 
-				if (ImGui::BeginPopupContextItem()) {
-					if (ImGui::MenuItem("Delete This")) {
-						shouldDelete = true;
-					}
+		if (ImGui::BeginDragDropTarget()) {
+			if (ImGuiPayload const* payload = ImGui::AcceptDragDropPayload("Entity"))
+				mHierarchyMove = { *(entt::entity const*)payload->Data, entity };
+			ImGui::EndDragDropTarget();
+		}
 
-					ImGui::EndPopup();
-				}
+		if (ImGui::BeginPopupContextItem()) {
+			if (ImGui::MenuItem("Unparent", nullptr, nullptr, mHierarchy.parent(world.node) != TransformHierarchy::kNull))
+				mHierarchyMove = { entity, entt::null };
 
-				if (opened)
-					ImGui::TreePop();
+			if (ImGui::MenuItem("Delete This"))
+				mHierarchyDelete = entity;
 
+			ImGui::EndPopup();
+		}
 
-				if (shouldDelete) {
-					if (mSelected == entity)
-						mSelected = entt::null;
-					mRegistry.destroy(entity);
-				}
+		if (opened) {
+			for (; child != TransformHierarchy::kNull; child = mHierarchy.nextSibling(child)) {
+				entt::entity childEntity = static_cast<entt::entity>(mHierarchy.userData(child));
+				drawGuiHierarchyNode(childEntity, mRegistry.get<GameObjectComponent>(childEntity), mRegistry.get<WorldTransformComponent>(childEntity));
 			}
 
+			ImGui::TreePop();
+		}
+	}
+
+	void drawGuiHierarchy() {
+		ZoneScoped;
+
+		if (!mViews.hierarchy) return;
 
+		if (ImGui::Begin("Hierarchy", &mViews.hierarchy)) {
+			for (auto&& [entity, gameObject, world] : mRegistry.view<GameObjectComponent, WorldTransformComponent>().each()) {
+				if (mHierarchy.parent(world.node) == hyperengine::TransformHierarchy::kNull)
+					drawGuiHierarchyNode(entity, gameObject, world);
+			}
+
+			// Dropping below the tree moves an entity back to the top
+			ImGui::Dummy({ ImGui::GetContentRegionAvail().x, std::max(ImGui::GetContentRegionAvail().y, ImGui::GetFrameHeight()) });
+			if (ImGui::BeginDragDropTarget()) {
+				if (ImGuiPayload const* payload = ImGui::AcceptDragDropPayload("Entity"))
+					mHierarchyMove = { *(entt::entity const*)payload->Data, entt::null };
+				ImGui::EndDragDropTarget();
+			}
 
-			if (ImGui::BeginPopupContextWindow(0, ImGuiPopupFlags_MouseButtonRight | ImGuiPopupFlags_NoOpenOverItems)) {
+			if (ImGui::BeginPopupContextItem("Hierarchy Context") || ImGui::BeginPopupContextWindow(0, ImGuiPopupFlags_MouseButtonRight | ImGuiPopupFlags_NoOpenOverItems)) {
 				editorOpGuiEntity();
 				ImGui::EndPopup();
 			}
 		}
 		ImGui::End();
+
+		// Deferred so the tree is not changed while it's drawn
+		if (mHierarchyDelete != entt::null) {
+			destroyEntity(mHierarchyDelete);
+			mHierarchyDelete = entt::null;
+		}
+
+		if (mHierarchyMove.first != entt::null) {
+			if (!setParent(mHierarchyMove.first, mHierarchyMove.second))
+				spdlog::warn("Cannot parent {} to one of its own children", mRegistry.get<GameObjectComponent>(mHierarchyMove.first).name);
+			mHierarchyMove = { entt::null, entt::null };
+		}
 	}
 
 	void drawGuiResourceManager() {
@@ -946,6 +1259,8 @@ struct Engine final {
 				for (auto& [k, v] : mResourceManager.mShaders) {
 					if (ImGui::TreeNodeEx(k.c_str())) {
 						ImGui::LabelText("Strong refs", "%d", v.use_count());
+						if (auto strongRef = v.lock())
+							ImGui::LabelText("Ready", "%s", strongRef->ready() ? "true" : "false");
 
 						ImGui::TreePop();
 					}
@@ -996,6 +1311,32 @@ struct Engine final {
 		}
 		else {
 			int t = lua_gettop(L);
+
+			// Submit every shader up front so the driver can compile them concurrently, material files submit their own
+			std::vector<std::shared_ptr<hyperengine::ShaderProgram>> shaders;
+			std::vector<std::shared_ptr<hyperengine::Material>> materials;
+			lua_pushnil(L);
+			while (lua_next(L, t) != 0) {
+				lua_getfield(L, -1, "MeshRenderer");
+				if (lua_istable(L, -1)) {
+					lua_getfield(L, -1, "shader");
+					if (lua_isstring(L, -1))
+						shaders.push_back(mResourceManager.getShaderProgram(lua_tostring(L, -1)));
+					lua_pop(L, 1);
+
+					lua_getfield(L, -1, "material");
+					if (lua_isstring(L, -1))
+						materials.push_back(mResourceManager.getMaterial(lua_tostring(L, -1)));
+					lua_pop(L, 1);
+				}
+				lua_pop(L, 2);
+			}
+			mResourceManager.waitShaders(mFileErrors);
+
+			// Parents are referenced by uuid and may appear after their children
+			std::unordered_map<uint64_t, entt::entity> entities;
+			std::vector<std::pair<entt::entity, uint64_t>> parents;
+
 			lua_pushnil(L);
 
 			// Iterate object list
@@ -1038,9 +1379,17 @@ struct Engine final {
 					}
 					lua_pop(L, 1);
 
+					lua_getfield(L, -1, "parent");
+					if (lua_isinteger(L, -1)) {
+						parents.push_back({ entity, static_cast<uint64_t>(lua_tointeger(L, -1)) });
+					}
+					lua_pop(L, 1);
+
 				}
 				lua_pop(L, 1);
 
+				entities[gameObject.uuid] = entity;
+
 				lua_getfield(L, -1, "MeshFilter");
 				if (lua_istable(L, -1)) {
 					auto& meshFilter = mRegistry.emplace<MeshFilterComponent>(entity);
@@ -1057,62 +1406,47 @@ struct Engine final {
 				if (lua_istable(L, -1)) {
 					auto& meshRenderer = mRegistry.emplace<MeshRendererComponent>(entity);
 
-					lua_getfield(L, -1, "shader");
+					// Either a material file or an inline material, inline fields after a file override it
+					lua_getfield(L, -1, "material");
 					if (lua_isstring(L, -1)) {
-						meshRenderer.shader = mResourceManager.getShaderProgram(lua_tostring(L, -1), mFileErrors);
-					}
-					lua_pop(L, 1);
-
-					if (meshRenderer.shader) {
-						meshRenderer.allocateMaterialBuffer();
+						meshRenderer.material = mResourceManager.getMaterial(lua_tostring(L, -1));
+						lua_pop(L, 1);
 
+						lua_getfield(L, -1, "shader");
+						bool overrides = !lua_isnil(L, -1);
+						lua_pop(L, 1);
 						lua_getfield(L, -1, "textures");
-						if (lua_istable(L, -1)) {
-							int textureTable = lua_gettop(L);
-							lua_pushnil(L);
-							while (lua_next(L, textureTable) != 0) {
-								auto it = meshRenderer.shader->opaqueAssignments().find(lua_tostring(L, -2));
-								if (it != meshRenderer.shader->opaqueAssignments().end()) {
-									meshRenderer.textures[it->second] = mResourceManager.getTexture(lua_tostring(L, -1));
-								}
-								lua_pop(L, 1);
-							}
+						overrides |= !lua_isnil(L, -1);
+						lua_pop(L, 1);
+						lua_getfield(L, -1, "parameters");
+						overrides |= !lua_isnil(L, -1);
+						lua_pop(L, 1);
 
-						}
+						if (overrides)
+							mResourceManager.readMaterial(L, meshRenderer.editMaterial());
+					}
+					else {
 						lua_pop(L, 1);
+						mResourceManager.readMaterial(L, meshRenderer.editMaterial());
+					}
+				}
+				lua_pop(L, 1);
 
-						lua_getfield(L, -1, "material");
-						if (lua_istable(L, -1)) {
-							int materialTable = lua_gettop(L);
-							lua_pushnil(L);
-
-							while (lua_next(L, materialTable) != 0) {
-								auto it = meshRenderer.shader->materialInfo().find(lua_tostring(L, -2));
-								if (it != meshRenderer.shader->materialInfo().end()) {
-									auto offset = it->second.offset;
-									auto type = it->second.type;
-
-									if (type == hyperengine::ShaderProgram::UniformType::kFloat && lua_isnumber(L, -1)) {
-										*((float*)(meshRenderer.data.data() + offset)) = static_cast<float>(lua_tonumber(L, -1));
-									}
-									else if (type == hyperengine::ShaderProgram::UniformType::kVec2f && lua_istable(L, -1)) {
-										*((glm::vec2*)(meshRenderer.data.data() + offset)) = hyperengine::luaToVec2(L);
-									}
-									else if (type == hyperengine::ShaderProgram::UniformType::kVec3f && lua_istable(L, -1)) {
-										*((glm::vec3*)(meshRenderer.data.data() + offset)) = hyperengine::luaToVec3(L);
-									}
-									else if (type == hyperengine::ShaderProgram::UniformType::kVec4f && lua_istable(L, -1)) {
-										*((glm::vec4*)(meshRenderer.data.data() + offset)) = hyperengine::luaToVec4(L);
-									}
-									else
-										spdlog::warn("Unsupported uniform type");
-								}
+				lua_getfield(L, -1, "Camera");
+				if (lua_istable(L, -1)) {
+					auto& camera = mRegistry.emplace<CameraComponent>(entity);
 
-								lua_pop(L, 1);
-							}
-						}
-						lua_pop(L, 1);
+					lua_getfield(L, -1, "fov");
+					if (lua_isnumber(L, -1)) {
+						camera.fov = static_cast<float>(lua_tonumber(L, -1));
 					}
+					lua_pop(L, 1);
+
+					lua_getfield(L, -1, "clippingPlanes");
+					if (lua_istable(L, -1)) {
+						camera.clippingPlanes = hyperengine::luaToVec2(L);
+					}
+					lua_pop(L, 1);
 				}
 				lua_pop(L, 1);
 
@@ -1131,11 +1465,40 @@ struct Engine final {
 						light.strength = static_cast<float>(lua_tonumber(L, -1));
 					}
 					lua_pop(L, 1);
+
+					lua_getfield(L, -1, "type");
+					if (lua_isstring(L, -1)) {
+						std::string_view type = lua_tostring(L, -1);
+						if (type == "point") light.type = LightComponent::Type::kPoint;
+						else if (type == "spot") light.type = LightComponent::Type::kSpot;
+					}
+					lua_pop(L, 1);
+
+					lua_getfield(L, -1, "range");
+					if (lua_isnumber(L, -1)) {
+						light.range = static_cast<float>(lua_tonumber(L, -1));
+					}
+					lua_pop(L, 1);
+
+					lua_getfield(L, -1, "angles");
+					if (lua_istable(L, -1)) {
+						light.angles = hyperengine::luaToVec2(L);
+					}
+					lua_pop(L, 1);
 				}
 				lua_pop(L, 1);
 
 				lua_pop(L, 1);
 			}
+
+			// Scene transforms are already relative to the parent
+			for (auto const& [entity, uuid] : parents) {
+				auto it = entities.find(uuid);
+				if (it == entities.end())
+					spdlog::warn("Parent 0x{:016x} of {} not found", uuid, mRegistry.get<GameObjectComponent>(entity).name);
+				else if (!setParent(entity, it->second, false))
+					spdlog::warn("Parenting {} would create a cycle", mRegistry.get<GameObjectComponent>(entity).name);
+			}
 		}
 
 
@@ -1161,93 +1524,290 @@ struct Engine final {
 		}
 	}
 
-	void editorOpNewScene() {
-		mRegistry.clear();
-		mRegistry = entt::registry();
-		mSelected = entt::null;
-		mRegistry.on_destroy<PhysicsComponent>().connect<&Engine::DetachPhysicsObj>(this);
+	void removeSpatialProxy(entt::registry& reg, entt::entity e) {
+		auto& spatial = reg.get<SpatialComponent>(e);
+		if (spatial.proxy != hyperengine::DynamicBvh::kNull)
+			mSceneBvh.remove(spatial.proxy);
+	}
 
-		auto& rootGameObject = mRegistry.emplace<GameObjectComponent>(mRoot);
-		rootGameObject.name = "_root";
-		rootGameObject.uuid = 0;
+	void removeSpatial(entt::registry& reg, entt::entity e) {
+		reg.remove<SpatialComponent>(e);
+	}
 
-		{
-			entt::entity entity = mRegistry.create();
-			auto& gameObject = mRegistry.emplace<GameObjectComponent>(entity);
-			gameObject.transform.scale = { 0, 0, 0 };
-			auto& comp = mRegistry.emplace<PhysicsComponent>(entity);
-			auto& meshFilter = mRegistry.emplace<MeshFilterComponent>(entity);
-			meshFilter.mesh = mResourceManager.getMesh("plane.obj");
-			comp.mShape = std::make_unique<btStaticPlaneShape>(btVector3(0, 1, 0), 0.0f);
-			auto& meshRenderer = mRegistry.emplace<MeshRendererComponent>(entity);
-			meshRenderer.shader = mResourceManager.getShaderProgram("shaders/opaque.glsl", mFileErrors);
-			if (meshRenderer.shader) {
-				meshRenderer.allocateMaterialBuffer();
-				*((glm::vec3*)meshRenderer.data.data()) = glm::vec3(1.0f);
-				meshRenderer.textures[meshRenderer.shader->opaqueAssignments().at("tAlbedo")] = mResourceManager.getTexture("rocks.png");
-			}
-			btScalar mass = 0.0f;
-			btVector3 localInertia = btVector3(0, 0, 0);
-			if (mass > 0.0f) comp.mShape->calculateLocalInertia(mass, localInertia);
-			comp.mMotionState = std::make_unique<EngineMotionState>(entt::handle(mRegistry, entity));
-			auto info = btRigidBody::btRigidBodyConstructionInfo{ mass, comp.mMotionState.get(), comp.mShape.get(), localInertia };
-			info.m_linearDamping = .2f;
-			info.m_angularDamping = .2f;
-			info.m_restitution = 1.0f;
-			comp.mBody = std::make_unique<btRigidBody>(info);
+	void constructGameObject(entt::registry& reg, entt::entity e) {
+		auto& world = reg.emplace<WorldTransformComponent>(e);
+		world.node = mHierarchy.insert(static_cast<uint32_t>(entt::to_integral(e)));
+		reg.emplace_or_replace<TransformDirtyComponent>(e);
+	}
 
-			// Adjust shape realtime
-			// comp.detach(mPhysicsWorld);
-			// comp.mBody->setCollisionShape(shape);
-			// comp.mBody->setMassProps(mass, inertia);
-			// comp.attach(mPhysicsWorld);
+	// Children move up to the parent, `destroyEntity` takes them along instead
+	void destroyWorldTransform(entt::registry& reg, entt::entity e) {
+		mHierarchy.remove(reg.get<WorldTransformComponent>(e).node);
+	}
 
-			comp.attach(mPhysicsWorld);
-		}
-		for (int y = 0; y < 20; ++y) {
-			entt::entity entity = mRegistry.create();
-			auto& gameObject = mRegistry.emplace<GameObjectComponent>(entity);
-			gameObject.transform.translation = { 0, 5 * y + 5, 0 };
-			auto& meshFilter = mRegistry.emplace<MeshFilterComponent>(entity);
-			meshFilter.mesh = mResourceManager.getMesh("cube.obj");
-			auto& meshRenderer = mRegistry.emplace<MeshRendererComponent>(entity);
-			meshRenderer.shader = mResourceManager.getShaderProgram("shaders/opaque.glsl", mFileErrors);
-			if (meshRenderer.shader) {
-				meshRenderer.allocateMaterialBuffer();
-				*((glm::vec3*)meshRenderer.data.data()) = glm::vec3(1.0f);
-				meshRenderer.textures[meshRenderer.shader->opaqueAssignments().at("tAlbedo")] = mResourceManager.getTexture("rocks.png");
-			}
+	void constructMeshFilter(entt::registry& reg, entt::entity e) {
+		reg.emplace_or_replace<TransformDirtyComponent>(e);
+	}
 
-			auto& comp = mRegistry.emplace<PhysicsComponent>(entity);
-			comp.setup(mPhysicsWorld, entt::handle(mRegistry, entity));
-		}
+	void markTransformDirty(entt::entity e) {
+		mRegistry.emplace_or_replace<TransformDirtyComponent>(e);
 	}
 
-	void editorOpCreateEmpty() {
-		mSelected = mRegistry.create();
-		mRegistry.emplace<GameObjectComponent>(mSelected);
+	void connectRegistrySignals() {
+		mRegistry.on_destroy<PhysicsComponent>().connect<&Engine::DetachPhysicsObj>(this);
+		mRegistry.on_destroy<SpatialComponent>().connect<&Engine::removeSpatialProxy>(this);
+		mRegistry.on_destroy<MeshFilterComponent>().connect<&Engine::removeSpatial>(this);
+		mRegistry.on_construct<GameObjectComponent>().connect<&Engine::constructGameObject>(this);
+		mRegistry.on_destroy<WorldTransformComponent>().connect<&Engine::destroyWorldTransform>(this);
+		mRegistry.on_construct<MeshFilterComponent>().connect<&Engine::constructMeshFilter>(this);
 	}
 
-	void editorOpDeleteSelected() {
-		mRegistry.destroy(mSelected);
-		mSelected = entt::null;
+	entt::entity parentOf(entt::entity entity) const {
+		auto node = mHierarchy.parent(mRegistry.get<WorldTransformComponent>(entity).node);
+		return node == hyperengine::TransformHierarchy::kNull ? entt::null : static_cast<entt::entity>(mHierarchy.userData(node));
 	}
 
-	void editorOpGuiEntity() {
-		if (ImGui::MenuItem("Create Empty", ImGui::GetKeyChordName(ImGuiMod_Ctrl | ImGuiMod_Shift | ImGuiKey_N))) {
-			editorOpCreateEmpty();
+	// From the current transform, the cached matrix only follows it after the next update
+	glm::mat4 worldMatrix(entt::entity entity) const {
+		glm::mat4 local = mRegistry.get<GameObjectComponent>(entity).transform.get();
+		entt::entity parent = parentOf(entity);
+		return parent == entt::null ? local : worldMatrix(parent) * local;
+	}
+
+	// Returns false if `parent` is the entity or one of its children, keeping the world transform rewrites the local one
+	bool setParent(entt::entity entity, entt::entity parent, bool keepWorld = true) {
+		auto const& world = mRegistry.get<WorldTransformComponent>(entity);
+		auto parentNode = parent == entt::null ? hyperengine::TransformHierarchy::kNull : mRegistry.get<WorldTransformComponent>(parent).node;
+
+		glm::mat4 matrix = worldMatrix(entity);
+		if (!mHierarchy.reparent(world.node, parentNode)) return false;
+
+		if (keepWorld)
+			mRegistry.get<GameObjectComponent>(entity).transform.set(parent == entt::null ? matrix : glm::inverse(worldMatrix(parent)) * matrix);
+
+		markTransformDirty(entity);
+		return true;
+	}
+
+	// Takes the children along, leaves go first so nothing is moved up to a parent about to be destroyed
+	void destroyEntity(entt::entity entity) {
+		mDestroyQueue.assign(1, entity);
+
+		for (size_t i = 0; i < mDestroyQueue.size(); ++i) {
+			auto node = mRegistry.get<WorldTransformComponent>(mDestroyQueue[i]).node;
+			for (auto child = mHierarchy.firstChild(node); child != hyperengine::TransformHierarchy::kNull; child = mHierarchy.nextSibling(child))
+				mDestroyQueue.push_back(static_cast<entt::entity>(mHierarchy.userData(child)));
 		}
 
-		if (ImGui::MenuItem("Delete Selected", nullptr, nullptr, mSelected != entt::null)) {
-			editorOpDeleteSelected();
+		for (auto it = mDestroyQueue.rbegin(); it != mDestroyQueue.rend(); ++it) {
+			if (mSelected == *it) mSelected = entt::null;
+			mRegistry.destroy(*it);
+		}
+	}
+
+	// Recomposes the local matrix of every game object marked dirty, then the world matrices of them and their children
+	// Static objects cost nothing here
+	void updateWorldTransforms() {
+		ZoneScoped;
+
+		auto view = mRegistry.view<GameObjectComponent, WorldTransformComponent, TransformDirtyComponent>();
+
+		mDirtyTransforms.clear();
+		for (auto&& [entity, gameObject, world] : view.each())
+			mDirtyTransforms.push_back(gameObject.transform);
+
+		mDirtyMatrices.resize(mDirtyTransforms.size());
+		hyperengine::composeTransforms(mDirtyTransforms, mDirtyMatrices);
+
+		size_t i = 0;
+		for (auto&& [entity, gameObject, world] : view.each())
+			mHierarchy.local(world.node, mDirtyMatrices[i++]);
+
+		mRegistry.clear<TransformDirtyComponent>();
+
+		mHierarchyChanged.clear();
+		mHierarchy.propagate(mHierarchyChanged, &mJobs);
+
+		for (uint32_t userData : mHierarchyChanged) {
+			entt::entity entity = static_cast<entt::entity>(userData);
+			auto& world = mRegistry.get<WorldTransformComponent>(entity);
+			world.matrix = mHierarchy.world(world.node);
+			mTransformsChanged.push_back(entity);
+		}
+
+		mTransformsRecomposed = mHierarchyChanged.size();
+	}
+
+	static hyperengine::Aabb worldBox(hyperengine::Mesh const& mesh, glm::mat4 const& matrix) {
+		hyperengine::Aabb box = mesh.bounds().box.transformed(matrix);
+		if (!box.valid()) box = { glm::vec3(matrix[3]), glm::vec3(matrix[3]) };
+		return box;
+	}
+
+	// Only entities whose transform or mesh changed since the last update touch the tree
+	void updateSpatialIndex() {
+		ZoneScoped;
+
+		mSpatialStats = { .entities = mSceneBvh.size() };
+
+		for (entt::entity entity : mTransformsChanged) {
+			if (!mRegistry.valid(entity)) continue;
+
+			auto* world = mRegistry.try_get<WorldTransformComponent>(entity);
+			auto* meshFilter = mRegistry.try_get<MeshFilterComponent>(entity);
+			auto* spatial = mRegistry.try_get<SpatialComponent>(entity);
+
+			if (!world || !meshFilter || !meshFilter->mesh) {
+				if (spatial) mRegistry.erase<SpatialComponent>(entity);
+				continue;
+			}
+
+			glm::vec3 translation = glm::vec3(world->matrix[3]);
+			hyperengine::Aabb box = worldBox(*meshFilter->mesh, world->matrix);
+
+			if (!spatial) {
+				spatial = &mRegistry.emplace<SpatialComponent>(entity);
+				spatial->translation = translation;
+				spatial->mesh = meshFilter->mesh.get();
+				spatial->proxy = mSceneBvh.insert(box, static_cast<uint32_t>(entt::to_integral(entity)));
+				++mSpatialStats.inserted;
+				continue;
+			}
+
+			glm::vec3 displacement = translation - spatial->translation;
+			spatial->translation = translation;
+			spatial->mesh = meshFilter->mesh.get();
+
+			++mSpatialStats.moved;
+			if (mSceneBvh.move(spatial->proxy, box, displacement))
+				++mSpatialStats.reinserted;
+		}
+
+		mTransformsChanged.clear();
+	}
+
+	// Nearest entity whose oriented mesh box the ray hits, the tree only yields candidates front to back
+	entt::entity pickEntity(hyperengine::Ray const& ray, float maxDistance) {
+		mRayHits.clear();
+		mSceneBvh.raycast(ray, maxDistance, mRayHits);
+
+		entt::entity picked = entt::null;
+		float nearest = maxDistance;
+
+		for (auto const& hit : mRayHits) {
+			if (hit.distance > nearest) break;
+
+			entt::entity entity = static_cast<entt::entity>(hit.userData);
+			auto* world = mRegistry.try_get<WorldTransformComponent>(entity);
+			auto* meshFilter = mRegistry.try_get<MeshFilterComponent>(entity);
+			if (!world || !meshFilter || !meshFilter->mesh) continue;
+
+			// Affine transforms keep the ray parameter, the distance stays in world units of the original ray
+			glm::mat4 inverse = glm::inverse(world->matrix);
+			hyperengine::Ray local{ glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.0f)) };
+
+			auto distance = meshFilter->mesh->bounds().box.raycast(local, nearest);
+			if (!distance.has_value()) continue;
+
+			nearest = distance.value();
+			picked = entity;
+		}
+
+		return picked;
+	}
+
+	void editorOpNewScene() {
+		mRegistry.clear();
+		mRegistry = entt::registry();
+		mSceneBvh.clear();
+		mSelected = entt::null;
+		mTransformsChanged.clear();
+		mHierarchy.clear();
+		connectRegistrySignals();
+
+		mRoot = mRegistry.create();
+		auto& rootGameObject = mRegistry.emplace<GameObjectComponent>(mRoot);
+		rootGameObject.name = "_root";
+		rootGameObject.uuid = 0;
+
+		std::shared_ptr<hyperengine::ShaderProgram> opaqueProgram = mResourceManager.getShaderProgram("shaders/opaque.glsl");
+		mResourceManager.waitShaders(mFileErrors);
+
+		// One material for the ground and every cube
+		auto rocks = std::make_shared<hyperengine::Material>(hyperengine::Material::CreateInfo{ .shader = opaqueProgram });
+		std::array<float, 3> const white = { 1.0f, 1.0f, 1.0f };
+		rocks->parameter("uColor", white);
+		rocks->texture("tAlbedo", mResourceManager.getTexture("rocks.png"));
+
+		{
+			entt::entity entity = mRegistry.create();
+			auto& gameObject = mRegistry.emplace<GameObjectComponent>(entity);
+			gameObject.transform.scale = { 0, 0, 0 };
+			auto& comp = mRegistry.emplace<PhysicsComponent>(entity);
+			auto& meshFilter = mRegistry.emplace<MeshFilterComponent>(entity);
+			meshFilter.mesh = mResourceManager.getMesh("plane.obj");
+			comp.mShape = std::make_unique<btStaticPlaneShape>(btVector3(0, 1, 0), 0.0f);
+			auto& meshRenderer = mRegistry.emplace<MeshRendererComponent>(entity);
+			meshRenderer.material = rocks;
+			btScalar mass = 0.0f;
+			btVector3 localInertia = btVector3(0, 0, 0);
+			if (mass > 0.0f) comp.mShape->calculateLocalInertia(mass, localInertia);
+			comp.mMotionState = std::make_unique<EngineMotionState>(entt::handle(mRegistry, entity));
+			auto info = btRigidBody::btRigidBodyConstructionInfo{ mass, comp.mMotionState.get(), comp.mShape.get(), localInertia };
+			info.m_linearDamping = .2f;
+			info.m_angularDamping = .2f;
+			info.m_restitution = 1.0f;
+			comp.mBody = std::make_unique<btRigidBody>(info);
+
+			// Adjust shape realtime
+			// comp.detach(mPhysicsWorld);
+			// comp.mBody->setCollisionShape(shape);
+			// comp.mBody->setMassProps(mass, inertia);
+			// comp.attach(mPhysicsWorld);
+
+			comp.attach(mPhysicsWorld);
+		}
+		for (int y = 0; y < 20; ++y) {
+			entt::entity entity = mRegistry.create();
+			auto& gameObject = mRegistry.emplace<GameObjectComponent>(entity);
+			gameObject.transform.translation = { 0, 5 * y + 5, 0 };
+			auto& meshFilter = mRegistry.emplace<MeshFilterComponent>(entity);
+			meshFilter.mesh = mResourceManager.getMesh("cube.obj");
+			auto& meshRenderer = mRegistry.emplace<MeshRendererComponent>(entity);
+			meshRenderer.material = rocks;
+
+			auto& comp = mRegistry.emplace<PhysicsComponent>(entity);
+			comp.setup(mPhysicsWorld, entt::handle(mRegistry, entity));
+		}
+	}
+
+	void editorOpCreateEmpty() {
+		mSelected = mRegistry.create();
+		mRegistry.emplace<GameObjectComponent>(mSelected);
+	}
+
+	void editorOpDeleteSelected() {
+		destroyEntity(mSelected);
+		mSelected = entt::null;
+	}
+
+	void editorOpGuiEntity() {
+		if (ImGui::MenuItem("Create Empty", ImGui::GetKeyChordName(ImGuiMod_Ctrl | ImGuiMod_Shift | ImGuiKey_N))) {
+			editorOpCreateEmpty();
+		}
+
+		if (ImGui::MenuItem("Delete Selected", nullptr, nullptr, mSelected != entt::null)) {
+			editorOpDeleteSelected();
 		}
 	}
 
 	void editorOpReloadShaders() {
+		hyperengine::clearShaderIncludeCache();
+
 		for (auto& [k, v] : mResourceManager.mShaders) {
 			if (std::shared_ptr<hyperengine::ShaderProgram> program = v.lock()) {
 				mFileErrors.erase(std::u8string((char8_t const*)k.c_str()));
-				mResourceManager.reloadShader(k, *program, mFileErrors);
+				mResourceManager.reloadShader(k, program);
 			}
 		}
 		spdlog::info("Reloaded Shaders");
@@ -1300,6 +1860,10 @@ struct Engine final {
 					editorOpReloadShaders();
 				}
 
+				if (ImGui::MenuItem("Clear Shader Cache", nullptr, nullptr, hyperengine::shadercache::supported())) {
+					hyperengine::shadercache::clear();
+				}
+
 				if (ImGui::MenuItem("Capture Frame", nullptr, nullptr, hyperengine::rdoc::isRunning())) {
 					hyperengine::rdoc::triggerCapture();
 				}
@@ -1339,8 +1903,33 @@ struct Engine final {
 			ImGui::SeparatorText("Rendering values");
 
 			ImGui::Checkbox("Wireframe", &mWireframe);
+			ImGui::Checkbox("Fast shaders", &mFastShaders);
+			if (ImGui::Checkbox("Frame governor", &mGovernorEnabled) && !mGovernorEnabled)
+				mGovernor.reset();
+			ImGui::BeginDisabled(mGovernorEnabled);
+			ImGui::SliderFloat("Render scale", &mRenderScale, 0.25f, 1.0f);
+			ImGui::EndDisabled();
+			ImGui::Checkbox("Shadows", &mShadows);
+			ImGui::Checkbox("Depth prepass", &mDepthPrepass);
+			ImGui::BeginDisabled(!mResourceManager.mPackTextures);
+			ImGui::Checkbox("Texture arrays", &mTextureArrays);
+			ImGui::EndDisabled();
+			ImGui::Checkbox("Frustum culling", &mFrustumCulling);
+			ImGui::Checkbox("Occlusion culling", &mOcclusionCulling);
+			ImGui::BeginDisabled(!multiDrawSupported());
+			ImGui::Checkbox("Multi draw indirect", &mMultiDraw);
+			ImGui::EndDisabled();
 			ImGui::ColorEdit3("Sky color", glm::value_ptr(mSkyColor));
 
+			// Tonemapped right away, R11G11B10F holds enough range at a quarter of the bandwidth of RGBA32F
+			using enum hyperengine::PixelFormat;
+			if (ImGui::BeginCombo("Scene color", hyperengine::pixelFormatName(mSceneColorFormat))) {
+				for (hyperengine::PixelFormat format : { kR11G11B10f, kRgba16f, kRgba32f })
+					if (ImGui::Selectable(hyperengine::pixelFormatName(format), format == mSceneColorFormat))
+						mSceneColorFormat = format;
+				ImGui::EndCombo();
+			}
+
 			ImGui::SeparatorText("Gizmos");
 
 			if (ImGui::RadioButton("Translate", mOperation == ImGuizmo::TRANSLATE))
@@ -1388,7 +1977,7 @@ struct Engine final {
 		}
 
 		drawGuiResourceManager();
-		drawGuiFlatHierarchy();
+		drawGuiHierarchy();
 		drawGuiProperties();
 		audioExperiment();
 
@@ -1403,179 +1992,759 @@ struct Engine final {
 		using enum hyperengine::Texture::WrapMode;
 		using enum hyperengine::Texture::FilterMode;
 
-		mFramebufferColor = {{
+		// Intermediate targets are transients of the frame graph, only the image shown by the viewport persists
+		mPostFramebufferColor = { {
 			.width = mViewportSize.x,
 			.height = mViewportSize.y,
-			.format = hyperengine::PixelFormat::kRgba32f,
+			.format = hyperengine::PixelFormat::kRgba8,
 			.minFilter = kLinear,
 			.magFilter = kLinear,
 			.wrap = kClampEdge,
-			.label = "framebuffer viewport color"
-		}};
+			.label = "framebuffer post color"
+		} };
+	}
 
-		mFramebufferDepth = {{
-			.width = mViewportSize.x,
-			.height = mViewportSize.y,
-			.format = hyperengine::PixelFormat::kD24,
-			.label = "framebuffer viewport depth"
-		}};
+	// Bounding sphere of a slice of the view frustum, the radius does not change as the camera rotates
+	static hyperengine::BoundingSphere frustumSliceSphere(glm::mat4 const& view, float fov, float aspect, float sliceNear, float sliceFar) {
+		auto corners = getSystemSpaceNdcExtremes(glm::perspective(fov, aspect, sliceNear, sliceFar) * view);
+
+		hyperengine::BoundingSphere sphere{ .radius = 0.0f };
+		for (glm::vec3 const& corner : corners)
+			sphere.center += corner;
+		sphere.center /= static_cast<float>(corners.size());
+
+		for (glm::vec3 const& corner : corners) {
+			float distance = glm::length(corner - sphere.center);
+			sphere.radius = std::max(sphere.radius, distance);
+		}
+
+		return sphere;
+	}
+
+	// Fixed light rotation and a texel snapped center, the cascade moves in whole texels and edges do not shimmer
+	ShadowCascade fitCascade(hyperengine::BoundingSphere const& slice, glm::vec3 sunDirection, float padding) const {
+		// Rounded so float noise never changes the texel size
+		float radius = std::ceil(slice.radius * padding * 16.0f) / 16.0f;
+
+		glm::vec3 up = std::abs(sunDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), sunDirection, up);
+
+		glm::vec3 center = glm::vec3(lightView * glm::vec4(slice.center, 1.0f));
+		float texel = 2.0f * radius / static_cast<float>(mShadowMapSize);
+		center.x = std::floor(center.x / texel) * texel;
+		center.y = std::floor(center.y / texel) * texel;
+
+		// View space looks down -z, pull the near plane towards the sun for casters outside the slice
+		glm::mat4 lightProjection = glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius, -(center.z + radius) - mShadowMapOffset, -(center.z - radius));
+
+		ShadowCascade cascade;
+		cascade.matrix = lightProjection * lightView;
+		cascade.center = glm::vec3(glm::inverse(lightView) * glm::vec4(center, 1.0f));
+		cascade.extent = radius;
+		cascade.valid = true;
+		return cascade;
+	}
+
+	void cullCascade(size_t index) {
+		std::vector<uint8_t>& visible = mLightVisible[index];
+		visible.resize(mCullCandidates.size());
+
+		if (mFrustumCulling)
+			hyperengine::cullSpheres(hyperengine::Frustum::fromMatrix(mCascades[index].matrix), mCullSpheres, visible);
+		else
+			std::fill(visible.begin(), visible.end(), uint8_t(1));
+	}
+
+	// Everything that ends up in the cascade, if this is unchanged the cached depth is still correct
+	uint64_t cascadeSignature(size_t index, glm::vec3 sunDirection) const {
+		auto bytes = [](auto const& value) { return std::string_view(reinterpret_cast<char const*>(&value), sizeof(value)); };
+
+		uint64_t hash = hyperengine::fnv1a(bytes(mCascades[index].matrix));
+		hash = hyperengine::fnv1a(bytes(sunDirection), hash);
+
+		for (size_t i = 0; i < mCullCandidates.size(); ++i) {
+			if (!mLightVisible[index][i]) continue;
+
+			CullCandidate const& candidate = mCullCandidates[i];
+			hash = hyperengine::fnv1a(bytes(candidate.mesh), hash);
+			hash = hyperengine::fnv1a(bytes(candidate.transform), hash);
+			hash = hyperengine::fnv1a(bytes(candidate.material->shader().get()), hash);
+
+			if (candidate.material->shader()->variants() & hyperengine::ShaderProgram::kVariantAlphaTest)
+				hash = hyperengine::fnv1a(bytes(candidate.material->hash()), hash);
+		}
+
+		return hash;
+	}
+
+	// The nearest cascade is rendered every frame. Distant cascades keep their depth until their casters or the sun change,
+	// the oldest changed one is rendered each frame. Padding lets the camera move before a cascade stops covering its slice
+	void scheduleShadowCascades(std::span<hyperengine::BoundingSphere const> slices, glm::vec3 sunDirection) {
+		constexpr float kCascadePadding = 1.2f;
+		ShadowCascade* stale = nullptr;
+
+		for (size_t i = 0; i < hyperengine::kShadowCascades; ++i) {
+			ShadowCascade& cascade = mCascades[i];
+			cascade.render = false;
+			++cascade.age;
+
+			if (!mShadows) continue;
 
-		std::array<hyperengine::Framebuffer::Attachment, 2> attachments{
-			hyperengine::Framebuffer::Attachment(GL_COLOR_ATTACHMENT0, std::ref(mFramebufferColor)),
-			hyperengine::Framebuffer::Attachment(GL_DEPTH_ATTACHMENT, std::ref(mFramebufferDepth)),
+			bool covered = cascade.valid && glm::distance(slices[i].center, cascade.center) + slices[i].radius <= cascade.extent;
+			if (i == 0 || !mShadowCaching || !covered) {
+				cascade.render = true;
+				continue;
+			}
+
+			cullCascade(i);
+			if (cascadeSignature(i, sunDirection) == cascade.signature) continue;
+
+			if (!stale || cascade.age > stale->age)
+				stale = &cascade;
+		}
+
+		if (stale) stale->render = true;
+
+		for (size_t i = 0; i < hyperengine::kShadowCascades; ++i) {
+			if (!mCascades[i].render) continue;
+
+			mCascades[i] = fitCascade(slices[i], sunDirection, i == 0 ? 1.0f : kCascadePadding);
+			mCascades[i].render = true;
+			cullCascade(i);
+			mCascades[i].signature = cascadeSignature(i, sunDirection);
+		}
+	}
+
+	// Large camera visible meshes are rasterized on the cpu, every camera visible candidate is then tested against their depth
+	void cullOccluded(glm::vec3 cameraPosition, glm::mat4 const& cameraViewProjection) {
+		ZoneScoped;
+		constexpr size_t kTestsPerJob = 256;
+
+		mOcclusionBuffer.begin(cameraViewProjection);
+
+		size_t tests = 0;
+		for (size_t i = 0; i < mCullCandidates.size(); ++i) {
+			if (!mCameraVisible[i]) continue;
+			++tests;
+
+			CullCandidate const& candidate = mCullCandidates[i];
+			hyperengine::Occluder const* occluder = candidate.mesh->occluder();
+			if (!occluder) continue;
+
+			// Alpha tested cards would write depth where the texture has holes
+			hyperengine::ShaderProgram const& shader = *candidate.material->shader();
+			if (!shader.occluder() || shader.variants() & hyperengine::ShaderProgram::kVariantAlphaTest) continue;
+
+			// Small on screen occluders hide little for the same rasterization cost
+			hyperengine::BoundingSphere sphere = candidate.mesh->bounds().sphere.transformed(candidate.transform);
+			if (sphere.radius < mOccluderMinSize * glm::distance(cameraPosition, sphere.center)) continue;
+
+			mOcclusionBuffer.addOccluder(*occluder, candidate.transform);
+		}
+
+		mOcclusionBuffer.rasterize(&mJobs);
+
+		std::atomic<size_t> occluded = 0;
+		uint32_t jobCount = static_cast<uint32_t>((mCullCandidates.size() + kTestsPerJob - 1) / kTestsPerJob);
+
+		mJobs.parallelFor(jobCount, [&](uint32_t job) {
+			size_t first = job * kTestsPerJob;
+			size_t last = std::min(first + kTestsPerJob, mCullCandidates.size());
+			size_t hidden = 0;
+
+			for (size_t i = first; i < last; ++i) {
+				if (!mCameraVisible[i]) continue;
+
+				CullCandidate const& candidate = mCullCandidates[i];
+				if (mOcclusionBuffer.visible(candidate.mesh->bounds().box.transformed(candidate.transform))) continue;
+
+				mCameraVisible[i] = 0;
+				++hidden;
+			}
+
+			occluded.fetch_add(hidden, std::memory_order_relaxed);
+		});
+
+		mOcclusionBuffer.countTests(tests, occluded.load());
+	}
+
+	void buildRenderQueue(glm::vec3 cameraPosition, float farPlane, glm::mat4 const& cameraViewProjection, std::span<hyperengine::BoundingSphere const> slices, glm::vec3 sunDirection) {
+		using hyperengine::ShaderProgram;
+
+		mRenderQueue.clear();
+		mDrawPackets.clear();
+		mCullCandidates.clear();
+		mCullSpheres.clear();
+
+		ShaderProgram::VariantMask variantMask = ShaderProgram::kVariantDefault | ShaderProgram::kVariantInstancing;
+		if (mFastShaders || (mGovernorEnabled && mGovernor.level() > 0)) variantMask |= ShaderProgram::kVariantFast;
+		if (!mShadows) variantMask &= ~ShaderProgram::kVariantShadows;
+
+		for (auto&& [entity, world, meshFilter, meshRenderer] : mRegistry.view<WorldTransformComponent, MeshFilterComponent, MeshRendererComponent>().each()) {
+			if (!meshRenderer.material || !meshRenderer.material->shader()) continue;
+			if (!meshFilter.mesh) continue;
+
+			mCullCandidates.push_back({ meshRenderer.material.get(), meshFilter.mesh.get(), world.matrix, glm::vec3(world.matrix[3]) });
+			mCullSpheres.push(meshFilter.mesh->bounds().sphere.transformed(world.matrix));
+		}
+
+		// World space spheres are tested in batches, once per view
+		mCameraVisible.resize(mCullCandidates.size());
+
+		if (mFrustumCulling)
+			hyperengine::cullSpheres(hyperengine::Frustum::fromMatrix(cameraViewProjection), mCullSpheres, mCameraVisible);
+		else
+			std::fill(mCameraVisible.begin(), mCameraVisible.end(), uint8_t(1));
+
+		// Shadow casters hidden from the camera still cast, only the opaque pass is affected
+		if (mOcclusionCulling)
+			cullOccluded(cameraPosition, cameraViewProjection);
+
+		scheduleShadowCascades(slices, sunDirection);
+
+		mCullStats = { .candidates = mCullCandidates.size() };
+
+		// Both depth only variants have to be ready, the opaque pass only draws where the prepass wrote depth
+		ShaderProgram& depthProgram = mShadowProgram->variant(ShaderProgram::kVariantInstancing);
+		ShaderProgram& depthProgramAlphaTest = mShadowProgram->variant(ShaderProgram::kVariantAlphaTest | ShaderProgram::kVariantInstancing);
+		mDepthPrepassActive = mDepthPrepass && !mWireframe && depthProgram.ready() && depthProgramAlphaTest.ready();
+
+		// Cut out fragments already failed the prepass, without the discard the opaque draw keeps early depth rejection
+		if (mDepthPrepassActive) variantMask &= ~ShaderProgram::kVariantAlphaTest;
+
+		bool textureArrays = mTextureArrays && mResourceManager.mPackTextures;
+
+		auto push = [&](hyperengine::RenderPass pass, ShaderProgram& program, hyperengine::Material& material, hyperengine::Mesh& mesh, uint64_t materialHash, glm::mat4 const& transform, float depth) {
+			uint64_t key = hyperengine::RenderQueue::makeKey(pass, mRenderQueue.programId(&program), mRenderQueue.materialId(materialHash), mRenderQueue.meshId(&mesh), depth);
+			mRenderQueue.push(key, static_cast<uint32_t>(mDrawPackets.size()));
+			mDrawPackets.push_back({ &program, &mesh, &material, materialHash, transform });
 		};
 
-		mFramebuffer = {{ .attachments = attachments }};
+		for (size_t i = 0; i < mCullCandidates.size(); ++i) {
+			CullCandidate const& candidate = mCullCandidates[i];
+			hyperengine::Material& material = *candidate.material;
+			ShaderProgram& shader = *material.shader();
 
-		mPostFramebufferColor = { {
-			.width = mViewportSize.x,
-			.height = mViewportSize.y,
-			.format = hyperengine::PixelFormat::kRgba8,
-			.minFilter = kLinear,
-			.magFilter = kLinear,
-			.wrap = kClampEdge,
-			.label = "framebuffer post color"
-		} };
+			bool shadowVisible = false;
+			for (size_t cascade = 0; cascade < hyperengine::kShadowCascades; ++cascade)
+				shadowVisible |= mCascades[cascade].render && mLightVisible[cascade][i];
+
+			if (!shadowVisible && !mCameraVisible[i]) continue;
+
+			// Front to back within a state bucket for early depth rejection
+			float depth = glm::distance(cameraPosition, candidate.position) / farPlane;
+
+			material.update();
+			uint64_t materialHash = material.hash();
+
+			// Only alpha tested materials need the texture fetch and discard
+			ShaderProgram& shadowProgram = shader.variants() & ShaderProgram::kVariantAlphaTest ? depthProgramAlphaTest : depthProgram;
+			bool alphaTested = shadowProgram.variantMask() & ShaderProgram::kVariantAlphaTest;
+
+			if (shadowVisible) {
+				for (size_t cascade = 0; cascade < hyperengine::kShadowCascades; ++cascade) {
+					if (!mCascades[cascade].render || !mLightVisible[cascade][i]) continue;
+					push(hyperengine::shadowPass(cascade), shadowProgram, material, *candidate.mesh, alphaTested ? materialHash : 0, candidate.transform, 0.0f);
+					++mCullStats.lightVisible;
+				}
+			}
+
+			if (!mCameraVisible[i]) continue;
+			++mCullStats.cameraVisible;
+
+			// Still compiling or failed to link, draw with the fallback until a working program arrives
+			if (!shader.ready()) {
+				if (mDepthPrepassActive)
+					push(hyperengine::RenderPass::kDepth, depthProgram, material, *candidate.mesh, 0, candidate.transform, depth);
+				push(hyperengine::RenderPass::kOpaque, *mFallbackProgram, material, *candidate.mesh, 0, candidate.transform, depth);
+				continue;
+			}
+
+			// Keyed by material like the opaque draw it stands in for, the group then culls the same faces
+			if (mDepthPrepassActive)
+				push(hyperengine::RenderPass::kDepth, shadowProgram, material, *candidate.mesh, materialHash, candidate.transform, depth);
+
+			ShaderProgram::VariantMask opaqueMask = variantMask;
+			if (textureArrays && (shader.variants() & ShaderProgram::kVariantTextureArrays) && texturesPacked(material))
+				opaqueMask |= ShaderProgram::kVariantTextureArrays;
+
+			push(hyperengine::RenderPass::kOpaque, shader.variant(opaqueMask), material, *candidate.mesh, materialHash, candidate.transform, depth);
+		}
+
+		mRenderQueue.sort();
+
+		mIndirectCommands.clear();
+		for (size_t pass = 0; pass < static_cast<size_t>(hyperengine::RenderPass::kCount); ++pass)
+			buildDrawGroups(static_cast<hyperengine::RenderPass>(pass));
+
+		writeDrawData();
+		recordCommands();
+	}
+
+	// Starts the frame ring region, engine blocks are written later by `drawScene` and are reserved for here
+	void writeDrawData() {
+		auto items = mRenderQueue.items();
+		auto& opaqueGroups = mDrawGroups[static_cast<size_t>(hyperengine::RenderPass::kOpaque)];
+
+		GLsizeiptr reserve = static_cast<GLsizeiptr>(items.size() * sizeof(glm::mat4) + mIndirectCommands.size() * sizeof(hyperengine::DrawElementsIndirectCommand)) + 2 * mUniformAlignment;
+		reserve += static_cast<GLsizeiptr>(2 + hyperengine::kShadowCascades) * (static_cast<GLsizeiptr>(sizeof(UniformEngineData)) + mUniformAlignment);
+		for (DrawGroup const& group : opaqueGroups) {
+			DrawPacket const& packet = mDrawPackets[group.packet];
+			reserve += static_cast<GLsizeiptr>(std::max(packet.material->data().size(), static_cast<size_t>(packet.program->materialAllocationSize()))) + mUniformAlignment;
+		}
+
+		mFrameRing.begin(reserve);
+
+		// Instance data follows the sorted order so every batch is a contiguous range
+		constexpr size_t kTransformsPerJob = 4096;
+		auto instances = mFrameRing.allocate(static_cast<GLsizeiptr>(items.size() * sizeof(glm::mat4)), sizeof(glm::vec4));
+		glm::mat4* transforms = static_cast<glm::mat4*>(instances.pointer);
+
+		mJobs.parallelFor(static_cast<uint32_t>((items.size() + kTransformsPerJob - 1) / kTransformsPerJob), [&](uint32_t job) {
+			size_t last = std::min((job + 1) * kTransformsPerJob, items.size());
+			for (size_t i = job * kTransformsPerJob; i < last; ++i)
+				transforms[i] = mDrawPackets[items[i].index].transform;
+		});
+		mInstanceOffset = instances.offset;
+
+		mIndirectOffset = mFrameRing.write(mIndirectCommands.data(), static_cast<GLsizeiptr>(mIndirectCommands.size() * sizeof(hyperengine::DrawElementsIndirectCommand)), sizeof(GLuint));
+
+		// Groups with identical material data share one block
+		mMaterialOffsets.clear();
+		for (DrawGroup& group : opaqueGroups) {
+			DrawPacket const& packet = mDrawPackets[group.packet];
+			std::span<uint8_t const> data = packet.material->data();
+			bool layered = packet.program->variantMask() & hyperengine::ShaderProgram::kVariantTextureArrays;
+			size_t size = layered ? std::max(data.size(), static_cast<size_t>(packet.program->materialAllocationSize())) : data.size();
+			if (packet.program == mFallbackProgram.get() || size == 0) continue;
+
+			auto [it, inserted] = mMaterialOffsets.try_emplace(packet.materialHash, 0);
+			if (inserted) {
+				if (layered) data = layeredMaterialData(*packet.program, *packet.material);
+				it->second = mFrameRing.write(data.data(), static_cast<GLsizeiptr>(data.size()), mUniformAlignment);
+			}
+
+			group.materialOffset = it->second;
+			group.materialSize = static_cast<GLsizeiptr>(size);
+		}
+	}
+
+	// Every sampler but the shadow map needs a packed texture before the array variant can stand in
+	bool texturesPacked(hyperengine::Material const& material) const {
+		for (auto const& [name, unit] : material.shader()->opaqueAssignments()) {
+			if (name == "tShadowMap") continue;
+			if (!mResourceManager.mTextureArrays.find(material.texture(unit).get())) return false;
+		}
+
+		return true;
+	}
+
+	// Array variants read the layer of each texture from the `<sampler>Layer` parameter, filled in on a copy of the
+	// material data. Sized for the variant's block, the base program may never have used it
+	std::span<uint8_t const> layeredMaterialData(hyperengine::ShaderProgram const& program, hyperengine::Material const& material) {
+		std::span<uint8_t const> data = material.data();
+		mLayeredMaterial.assign(std::max(data.size(), static_cast<size_t>(program.materialAllocationSize())), 0);
+		std::copy(data.begin(), data.end(), mLayeredMaterial.begin());
+
+		for (auto const& [name, unit] : material.shader()->opaqueAssignments()) {
+			auto it = program.materialInfo().find(name + "Layer");
+			if (it == program.materialInfo().end() || it->second.offset < 0 || static_cast<size_t>(it->second.offset) + sizeof(float) > mLayeredMaterial.size()) continue;
+
+			float layer = static_cast<float>(mResourceManager.mTextureArrays.find(material.texture(unit).get()).layer);
+			std::memcpy(mLayeredMaterial.data() + it->second.offset, &layer, sizeof(layer));
+		}
+
+		return mLayeredMaterial;
+	}
+
+	bool multiDrawSupported() const {
+		return GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance;
+	}
+
+	// Consecutive items sharing program, mesh and material are drawn as one instanced batch when the program supports it
+	// With multi draw indirect, consecutive batches of pooled meshes that only differ in mesh become a single call
+	void buildDrawGroups(hyperengine::RenderPass pass) {
+		auto items = mRenderQueue.range(pass);
+		size_t base = static_cast<size_t>(items.data() - mRenderQueue.items().data());
+		bool multiDraw = mMultiDraw && multiDrawSupported();
+
+		std::vector<DrawGroup>& groups = mDrawGroups[static_cast<size_t>(pass)];
+		groups.clear();
 
-		std::array<hyperengine::Framebuffer::Attachment, 1> attachmentsPost{
-			hyperengine::Framebuffer::Attachment(GL_COLOR_ATTACHMENT0, std::ref(mPostFramebufferColor))
+		auto batchSize = [&](size_t first) {
+			DrawPacket const& packet = mDrawPackets[items[first].index];
+			size_t count = 1;
+
+			while (first + count < items.size()) {
+				DrawPacket const& next = mDrawPackets[items[first + count].index];
+				if (next.program != packet.program || next.mesh != packet.mesh || next.materialHash != packet.materialHash) break;
+				++count;
+			}
+
+			return count;
 		};
 
-		mPostFramebuffer = {{ .attachments = attachmentsPost }};
+		for (size_t i = 0; i < items.size();) {
+			DrawPacket const& packet = mDrawPackets[items[i].index];
+			bool instanced = packet.program->variantMask() & hyperengine::ShaderProgram::kVariantInstancing;
+
+			DrawGroup group{ .packet = items[i].index, .first = static_cast<uint32_t>(base + i), .instanced = instanced };
+
+			if (instanced && multiDraw && packet.mesh->pooled()) {
+				group.firstCommand = static_cast<uint32_t>(mIndirectCommands.size());
+				size_t end = i;
+
+				while (end < items.size()) {
+					DrawPacket const& next = mDrawPackets[items[end].index];
+					if (next.program != packet.program || next.materialHash != packet.materialHash || next.mesh->vao() != packet.mesh->vao()) break;
+
+					size_t count = batchSize(end);
+					mIndirectCommands.push_back(next.mesh->indirectCommand(static_cast<GLuint>(count), static_cast<GLuint>(base + end)));
+					end += count;
+				}
+
+				group.commandCount = static_cast<uint32_t>(mIndirectCommands.size()) - group.firstCommand;
+				group.count = static_cast<uint32_t>(end - i);
+			}
+			else {
+				group.count = static_cast<uint32_t>(instanced ? batchSize(i) : 1);
+			}
+
+			groups.push_back(group);
+			i += group.count;
+		}
+	}
+
+	void recordGroup(hyperengine::CommandList& list, DrawGroup const& group, hyperengine::VertexStream stream = hyperengine::VertexStream::kFull) {
+		using hyperengine::CommandList;
+		DrawPacket const& packet = mDrawPackets[group.packet];
+
+		if (group.commandCount > 0) {
+			GLintptr commands = mIndirectOffset + static_cast<GLintptr>(group.firstCommand * sizeof(hyperengine::DrawElementsIndirectCommand));
+			list.push(CommandList::DrawIndirect{ .stream = stream, .instances = group.count, .mesh = packet.mesh, .buffer = mFrameRing.handle(), .commandCount = group.commandCount, .offset = mInstanceOffset, .commandOffset = commands });
+		}
+		else if (group.instanced) {
+			GLintptr offset = mInstanceOffset + static_cast<GLintptr>(group.first * sizeof(glm::mat4));
+			list.push(CommandList::DrawInstanced{ .stream = stream, .instances = group.count, .mesh = packet.mesh, .buffer = mFrameRing.handle(), .offset = offset });
+		}
+		else {
+			list.push(CommandList::UniformMat4{ .location = packet.program->transformHandle().location, .value = packet.transform });
+			list.push(CommandList::Draw{ .stream = stream, .mesh = packet.mesh });
+		}
+	}
+
+	// Array variants are only picked with every texture packed, they get the arrays. Materials sharing arrays then bind the same handles
+	void recordMaterialTextures(hyperengine::CommandList& list, hyperengine::ShaderProgram const& program, hyperengine::Material const& material) {
+		bool arrays = program.variantMask() & hyperengine::ShaderProgram::kVariantTextureArrays;
+
+		for (auto const& [k, v] : material.shader()->opaqueAssignments()) {
+			hyperengine::Texture* texture = material.texture(v) ? material.texture(v).get() : mInternalTextureBlack.get();
+			if (k == "tShadowMap")
+				texture = &mFramebufferShadowDepth;
+			else if (arrays)
+				texture = mResourceManager.mTextureArrays.find(texture).array;
+
+			list.push(hyperengine::CommandList::BindTexture{ .unit = static_cast<uint32_t>(v), .texture = texture });
+		}
+	}
+
+	// Shadow and prepass draws, only the samplers the depth program uses are bound. Without alpha testing nothing
+	// but the position is read, those draws come from the position stream
+	void recordShadowGroup(hyperengine::CommandList& list, DrawGroup const& group) {
+		DrawPacket const& packet = mDrawPackets[group.packet];
+		hyperengine::ShaderProgram const& program = *packet.program;
+		auto const& assignments = packet.material->shader()->opaqueAssignments();
+
+		list.push(hyperengine::CommandList::Program{ .program = packet.program });
+
+		for (auto const& [name, unit] : program.opaqueAssignments()) {
+			hyperengine::Texture* texture = mInternalTextureBlack.get();
+			if (auto it = assignments.find(name); it != assignments.end() && packet.material->texture(it->second))
+				texture = packet.material->texture(it->second).get();
+
+			list.push(hyperengine::CommandList::BindTexture{ .unit = static_cast<uint32_t>(unit), .texture = texture });
+		}
+
+		bool alphaTested = program.variantMask() & hyperengine::ShaderProgram::kVariantAlphaTest;
+		recordGroup(list, group, alphaTested ? hyperengine::VertexStream::kFull : hyperengine::VertexStream::kPosition);
+	}
+
+	// Fallback draws carry no material hash and are double sided like the fallback program
+	void recordDepthGroup(hyperengine::CommandList& list, DrawGroup const& group) {
+		DrawPacket const& packet = mDrawPackets[group.packet];
+		list.push(hyperengine::CommandList::Cull{ .enabled = packet.materialHash != 0 && packet.material->shader()->cull() });
+		recordShadowGroup(list, group);
+	}
+
+	void recordOpaqueGroup(hyperengine::CommandList& list, DrawGroup const& group) {
+		using hyperengine::CommandList;
+		DrawPacket const& packet = mDrawPackets[group.packet];
+		hyperengine::ShaderProgram& program = *packet.program;
+		bool fallback = &program == mFallbackProgram.get();
+
+		if (!fallback) {
+			recordMaterialTextures(list, program, *packet.material);
+
+			// The whole group shares identical material data
+			if (group.materialOffset >= 0)
+				list.push(CommandList::UniformBuffer{ .binding = 1, .buffer = mFrameRing.handle(), .offset = group.materialOffset, .size = group.materialSize });
+		}
+
+		list.push(CommandList::Cull{ .enabled = program.cull() });
+		list.push(CommandList::Program{ .program = &program });
+		if (!fallback)
+			list.push(CommandList::UniformVec3{ .location = program.skyColorHandle().location, .value = mSkyColor });
+
+		recordGroup(list, group);
+	}
+
+	// Draw groups are recorded by the job system, a fixed chunk of groups per list so the split does not depend on the worker count.
+	// Only the gl calls are left for the render thread
+	void recordCommands() {
+		ZoneScoped;
+		constexpr uint32_t kGroupsPerList = 128;
+
+		mRecordJobs.clear();
+		for (size_t pass = 0; pass < static_cast<size_t>(hyperengine::RenderPass::kCount); ++pass) {
+			uint32_t groups = static_cast<uint32_t>(mDrawGroups[pass].size());
+			mCommandRanges[pass].first = static_cast<uint32_t>(mRecordJobs.size());
+
+			for (uint32_t first = 0; first < groups; first += kGroupsPerList)
+				mRecordJobs.push_back({ static_cast<hyperengine::RenderPass>(pass), first, std::min(first + kGroupsPerList, groups) });
+
+			mCommandRanges[pass].count = static_cast<uint32_t>(mRecordJobs.size()) - mCommandRanges[pass].first;
+		}
+
+		if (mCommandLists.size() < mRecordJobs.size())
+			mCommandLists.resize(mRecordJobs.size());
+
+		mJobs.parallelFor(static_cast<uint32_t>(mRecordJobs.size()), [&](uint32_t job) {
+			RecordJob const& record = mRecordJobs[job];
+			hyperengine::CommandList& list = mCommandLists[job];
+			auto const& groups = mDrawGroups[static_cast<size_t>(record.pass)];
+			list.clear();
+
+			for (uint32_t i = record.first; i < record.last; ++i) {
+				if (record.pass == hyperengine::RenderPass::kOpaque)
+					recordOpaqueGroup(list, groups[i]);
+				else if (record.pass == hyperengine::RenderPass::kDepth)
+					recordDepthGroup(list, groups[i]);
+				else
+					recordShadowGroup(list, groups[i]);
+			}
+		});
+
+		mCommandStats = { .lists = mRecordJobs.size() };
+		for (size_t i = 0; i < mRecordJobs.size(); ++i) {
+			mCommandStats.commands += mCommandLists[i].count();
+			mCommandStats.bytes += mCommandLists[i].bytes();
+		}
 	}
 
-	void drawScene(Transform& cameraTransform, CameraComponent& cameraCamera, glm::vec3 sunDirection, glm::vec3 sunColor) {
+	void replayCommands(hyperengine::RenderPass pass) {
+		auto [first, count] = mCommandRanges[static_cast<size_t>(pass)];
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mFrameRing.handle());
+		for (uint32_t i = first; i < first + count; ++i)
+			mCommandLists[i].replay(mStateCache);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	// Point and spot lights in world space, binned against the camera frustum for the opaque pass
+	void buildLightClusters(glm::mat4 const& view, CameraComponent const& camera, float aspect) {
+		ZoneScoped;
+
+		mLights.clear();
+		for (auto&& [entity, world, light] : mRegistry.view<WorldTransformComponent, LightComponent>().each()) {
+			if (light.type == LightComponent::Type::kDirectional) continue;
+
+			hyperengine::LightClusters::Light& entry = mLights.emplace_back();
+			entry.position = glm::vec3(world.matrix[3]);
+			entry.range = light.range;
+			entry.color = light.color * light.strength;
+
+			if (light.type == LightComponent::Type::kSpot) {
+				entry.direction = glm::normalize(glm::vec3(world.matrix * glm::vec4(0, 0, -1, 0)));
+				entry.cosInner = std::cos(glm::radians(light.angles.x));
+				entry.cosOuter = std::cos(glm::radians(std::max(light.angles.y, light.angles.x + 0.1f)));
+			}
+		}
+
+		mLightClusters.build(mLights, { .view = view, .fov = glm::radians(camera.fov), .aspect = aspect, .zNear = camera.clippingPlanes.x, .zFar = camera.clippingPlanes.y, .size = mRenderSize }, &mJobs);
+		mLightClusters.upload();
+	}
+
+	void drawScene(hyperengine::Transform& cameraTransform, CameraComponent& cameraCamera, glm::vec3 sunDirection, glm::vec3 sunColor) {
 		if (mViewportSize.x <= 0 || mViewportSize.y <= 0)  return;
 
+		// Scene targets follow the render scale, the tonemap pass samples them filtered and so upscales into the viewport
+		float renderScale = mGovernorEnabled ? mGovernor.scale() : mRenderScale;
+		mRenderSize = glm::max(glm::ivec2(glm::round(glm::vec2(mViewportSize) * renderScale)), glm::ivec2(1));
+
+		mStateCache.resetStats();
+
 		glm::mat4 cameraProjection = glm::perspective(glm::radians(cameraCamera.fov), static_cast<float>(mViewportSize.x) / static_cast<float>(mViewportSize.y), cameraCamera.clippingPlanes.x, cameraCamera.clippingPlanes.y);
 
-		// Depth only pass ; shadowmap
+		// Every cascade reads its own copy of the engine uniforms, the shadow shader picks its matrix with `gCascade`.
+		// The depth prepass runs the same shader with a negative cascade
+		std::array<GLintptr, hyperengine::kShadowCascades> cascadeOffsets{};
+		GLintptr depthOffset = 0;
+
+		// Cascade fitting, render queue and uniforms
 		{
-			mFramebufferShadow.bind();
-			glViewport(0, 0, mShadowMapSize, mShadowMapSize);
-			glClear(GL_DEPTH_BUFFER_BIT);
-
-			// Calculate center point of adjusted view frustum
-			auto adjustedFrustum = glm::perspective(glm::radians(cameraCamera.fov), static_cast<float>(mViewportSize.x) / static_cast<float>(mViewportSize.y), mShadowMapNear, mShadowMapDistance);
-			auto corners = getSystemSpaceNdcExtremes(adjustedFrustum * glm::inverse(cameraTransform.get()));
-			glm::vec3 center = glm::vec3(0, 0, 0);
-			for (const auto& v : corners)
-				center += glm::vec3(v);
-			center /= static_cast<float>(corners.size());
-
-			// Sun view matrix
-			glm::mat4 lightView = glm::lookAt(-sunDirection + center, center, glm::vec3(0.0f, 1.0f, 0.0f));
-
-			glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
-			glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
-
-			for (const auto& v : corners) {
-				const auto trf = lightView * glm::vec4(v, 1.0f);
-				min.x = glm::min(min.x, trf.x);
-				max.x = glm::max(max.x, trf.x);
-				min.y = glm::min(min.y, trf.y);
-				max.y = glm::max(max.y, trf.y);
-				min.z = glm::min(min.z, trf.z);
-				max.z = glm::max(max.z, trf.z);
+			float aspect = static_cast<float>(mViewportSize.x) / static_cast<float>(mViewportSize.y);
+			glm::mat4 view = glm::inverse(cameraTransform.get());
+
+			// Practical split scheme, a blend of logarithmic and uniform splits
+			std::array<hyperengine::BoundingSphere, hyperengine::kShadowCascades> slices;
+			float sliceNear = mShadowMapNear;
+
+			for (size_t i = 0; i < hyperengine::kShadowCascades; ++i) {
+				float t = static_cast<float>(i + 1) / static_cast<float>(hyperengine::kShadowCascades);
+				float logarithmic = mShadowMapNear * std::pow(mShadowMapDistance / mShadowMapNear, t);
+				float uniform = mShadowMapNear + (mShadowMapDistance - mShadowMapNear) * t;
+				float sliceFar = glm::mix(uniform, logarithmic, mCascadeLambda);
+
+				slices[i] = frustumSliceSphere(view, glm::radians(cameraCamera.fov), aspect, sliceNear, sliceFar);
+				mUniformEngineData.cascadeSplits[static_cast<int>(i)] = sliceFar;
+				sliceNear = sliceFar;
 			}
 
-			min.z -= mShadowMapOffset;
-
-			glm::mat4 lightProjection = glm::ortho(min.x, max.x, min.y, max.y, min.z, max.z);
+			glm::vec3 sunDirectionNormalized = glm::normalize(sunDirection);
+			buildRenderQueue(cameraTransform.translation, cameraCamera.clippingPlanes.y, cameraProjection * view, slices, sunDirectionNormalized);
+			buildLightClusters(view, cameraCamera, aspect);
 
-			// Update engine uniform data
+			// Update engine uniform data, cached cascades keep the matrix their depth was rendered with
 			mUniformEngineData.projection = cameraProjection;
-			mUniformEngineData.view = glm::inverse(cameraTransform.get());
-			mUniformEngineData.lightmat = lightProjection * lightView;
+			mUniformEngineData.view = view;
+			for (size_t i = 0; i < hyperengine::kShadowCascades; ++i)
+				mUniformEngineData.lightmats[i] = mCascades[i].matrix;
 			mUniformEngineData.skyColor = mSkyColor;
 			mUniformEngineData.farPlane = cameraCamera.clippingPlanes[1];
 			mUniformEngineData.sunDirection = sunDirection;
-			mUniformEngineData.gTime = static_cast<float>(glfwGetTime());
+			mUniformEngineData.gTime = mTime;
 			mUniformEngineData.sunColor = sunColor;
-			// Upload buffer
-			glBindBuffer(GL_UNIFORM_BUFFER, mEngineUniformBuffer);
-			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(decltype(mUniformEngineData)), &mUniformEngineData);
-			glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-			// setup drawing
-			mShadowProgram->bind();
+			mUniformEngineData.cascade = 0;
+			mUniformEngineData.clusterGrid = mLightClusters.grid();
+			mUniformEngineData.clusterScale = mLightClusters.scale();
+			mEngineOffset = mFrameRing.write(&mUniformEngineData, sizeof(UniformEngineData), mUniformAlignment);
 
-			glDisable(GL_CULL_FACE);
-
-			for (auto&& [entity, gameObject, meshFilter, meshRenderer] : mRegistry.view<GameObjectComponent, MeshFilterComponent, MeshRendererComponent>().each()) {
-				if (!meshRenderer.shader) continue;
-				if (!meshFilter.mesh) continue;
+			for (size_t i = 0; i < hyperengine::kShadowCascades; ++i) {
+				if (!mShadows || !mCascades[i].render) continue;
 
-				// Assign all needed textures
-				for (auto const& [k, v] : meshRenderer.shader->opaqueAssignments()) {
-					if (meshRenderer.textures[v])
-						meshRenderer.textures[v]->bind(v);
-					else
-						mInternalTextureBlack->bind(v);
-				}
+				mUniformEngineData.cascade = static_cast<int32_t>(i);
+				cascadeOffsets[i] = mFrameRing.write(&mUniformEngineData, sizeof(UniformEngineData), mUniformAlignment);
+			}
 
-				mShadowProgram->uniformMat4f("uTransform", gameObject.transform.get());
-				meshFilter.mesh->draw();
+			if (mDepthPrepassActive) {
+				mUniformEngineData.cascade = -1;
+				depthOffset = mFrameRing.write(&mUniformEngineData, sizeof(UniformEngineData), mUniformAlignment);
 			}
 
-			glEnable(GL_CULL_FACE);
+			mUniformEngineData.cascade = 0;
+			mFrameRing.flush();
 		}
 
-		// Render scene
-		mFramebuffer.bind();
-		glViewport(0, 0, mViewportSize.x, mViewportSize.y);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glClearColor(mSkyColor.r, mSkyColor.g, mSkyColor.b, 1.0f);
+		using FrameGraph = hyperengine::FrameGraph;
+		using enum hyperengine::PixelFormat;
 
-		if (mWireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		FrameGraph::Resource shadow = mFrameGraph.import(mFramebufferShadowDepth, glm::ivec2(mShadowMapSize), "shadow cascades");
+		FrameGraph::Resource color = mFrameGraph.create({ .width = mRenderSize.x, .height = mRenderSize.y, .format = mSceneColorFormat, .label = "scene color" });
+		FrameGraph::Resource depth = mFrameGraph.create({ .width = mRenderSize.x, .height = mRenderSize.y, .format = kD24, .label = "scene depth" });
+		FrameGraph::Resource viewport = mFrameGraph.import(mPostFramebufferColor, mViewportSize, "viewport");
 
-		for (auto&& [entity, gameObject, meshFilter, meshRenderer] : mRegistry.view<GameObjectComponent, MeshFilterComponent, MeshRendererComponent>().each()) {
-			if (!meshRenderer.shader) continue;
-			if (!meshFilter.mesh) continue;
+		// Cascades render into layers of the persistent shadow map, one framebuffer each
+		if (mShadows) {
+			mFrameGraph.pass({ .name = "shadow", .writes = { shadow }, .attachWrites = false, .execute = [&](FrameGraph&) {
+				mStateCache.reset();
+				mStateCache.cull(false);
 
-			// Assign all needed textures
-			for (auto const& [k, v] : meshRenderer.shader->opaqueAssignments()) {
+				for (size_t i = 0; i < hyperengine::kShadowCascades; ++i) {
+					if (!mCascades[i].render) continue;
 
-				if (k == "tShadowMap") {
-					mFramebufferShadowDepth.bind(v);
-				}
-				else {
-					if (meshRenderer.textures[v])
-						meshRenderer.textures[v]->bind(v);
-					else
-						mInternalTextureBlack->bind(v);
+					mFramebufferShadow[i].bind();
+					glViewport(0, 0, mShadowMapSize, mShadowMapSize);
+					glClear(GL_DEPTH_BUFFER_BIT);
+
+					mStateCache.uniformBuffer(mFrameRing.handle(), 0, cascadeOffsets[i], sizeof(UniformEngineData));
+					replayCommands(hyperengine::shadowPass(i));
 				}
 
+				mStateCache.cull(true);
+			}});
+		}
+
+		// Depth only, the opaque pass then tests for equal depth and shades each pixel once
+		bool prepass = mDepthPrepassActive;
+		if (prepass) {
+			mFrameGraph.pass({ .name = "depth", .writes = { depth }, .execute = [&](FrameGraph&) {
+				glClear(GL_DEPTH_BUFFER_BIT);
+
+				mStateCache.reset();
+				mStateCache.uniformBuffer(mFrameRing.handle(), 0, depthOffset, sizeof(UniformEngineData));
+				replayCommands(hyperengine::RenderPass::kDepth);
+				mStateCache.cull(true);
+			}});
+		}
+
+		std::vector<FrameGraph::Resource> opaqueReads = { shadow };
+		if (prepass) opaqueReads.push_back(depth);
+
+		mFrameGraph.pass({ .name = "opaque", .reads = std::move(opaqueReads), .writes = { color, depth }, .execute = [&](FrameGraph&) {
+			glClearColor(mSkyColor.r, mSkyColor.g, mSkyColor.b, 1.0f);
+			glClear(prepass ? GL_COLOR_BUFFER_BIT : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+			if (prepass) {
+				glDepthFunc(GL_EQUAL);
+				glDepthMask(GL_FALSE);
 			}
 
-			// Upload material changes and bind buffer for prep
-			meshRenderer.uploadAndPrep();
+			if (mWireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-			if (!meshRenderer.shader->cull()) glDisable(GL_CULL_FACE);
-			meshRenderer.shader->bind();
-			meshRenderer.shader->uniformMat4f("uTransform", gameObject.transform.get());
-			meshRenderer.shader->uniform3f("uSkyColor", mSkyColor);
-			meshFilter.mesh->draw();
-			if (!meshRenderer.shader->cull()) glEnable(GL_CULL_FACE);
-		}
+			mStateCache.reset();
+			mStateCache.uniformBuffer(mFrameRing.handle(), 0, mEngineOffset, sizeof(UniformEngineData));
+			mLightClusters.bind(hyperengine::kLightClusterUnit);
+			replayCommands(hyperengine::RenderPass::kOpaque);
+			mStateCache.cull(true);
+
+			if (mWireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-		if (mWireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			if (prepass) {
+				glDepthFunc(GL_LESS);
+				glDepthMask(GL_TRUE);
+			}
+		}});
 
 		// Tonemap // aces
+		mFrameGraph.pass({ .name = "tonemap", .reads = { color }, .writes = { viewport }, .execute = [&](FrameGraph& graph) {
+			glDisable(GL_CULL_FACE);
+			glDisable(GL_DEPTH_TEST);
 
-		mPostFramebuffer.bind();
-		glDisable(GL_CULL_FACE);
-		glDisable(GL_DEPTH_TEST);
+			mAcesProgram->bind();
+			graph.texture(color).bind(0);
+			mEmptyMesh.draw(GL_TRIANGLE_STRIP, 0, 4);
 
-		mAcesProgram->bind();
-		mFramebufferColor.bind(0);
-		mEmptyMesh.draw(GL_TRIANGLE_STRIP, 0, 4);
+			glEnable(GL_DEPTH_TEST);
+			glEnable(GL_CULL_FACE);
+		}});
 
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		mFrameGraph.output(viewport);
+		mFrameGraph.execute(&mGpuProfiler);
+
+		mFrameRing.end();
+	}
 
+	// The first directional light of the scene, a fixed sun without one
+	void findSun(glm::vec3& direction, glm::vec3& color) {
+		direction = glm::normalize(glm::vec3(0.0f, -1.0f, 0.01f));
+		color = glm::vec3(1.0f) * 3.0f;
+
+		for (auto&& [entity, world, light] : mRegistry.view<WorldTransformComponent, LightComponent>().each()) {
+			if (light.type != LightComponent::Type::kDirectional) continue;
+			direction = glm::normalize(glm::vec3(world.matrix * glm::vec4(0, 0, -1, 0)));
+			color = light.color * light.strength;
+			break;
+		}
 	}
 
 	void update() {
@@ -1585,7 +2754,8 @@ struct Engine final {
 		drawUi();
 
 		if (ImGui::Begin("Passes")) {
-			ImGui::Image((void*)(uintptr_t)mFramebufferShadowDepth.handle(), { 256, 256 }, { 0, 1 }, { 1, 0 });
+			ImGui::Checkbox("Cache cascades", &mShadowCaching);
+			ImGui::SliderFloat("Cascade Lambda", &mCascadeLambda, 0.0f, 1.0f);
 			ImGui::DragFloat("ShadowMap Offset", &mShadowMapOffset);
 
 			ImGui::DragFloat("ShadowMap Near", &mShadowMapNear);
@@ -1593,6 +2763,147 @@ struct Engine final {
 
 			if(ImGui::DragInt("ShadowMap Size", &mShadowMapSize, 1.0f, 32, 16384))
 				genShadowmap();
+
+			if (ImGui::TreeNode("Cascades")) {
+				for (size_t i = 0; i < hyperengine::kShadowCascades; ++i)
+					ImGui::Text("%zu  split %7.2f  age %4u", i, mUniformEngineData.cascadeSplits[static_cast<int>(i)], mCascades[i].age);
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("Culling")) {
+				ImGui::Text("Camera %5zu / %5zu", mCullStats.cameraVisible, mCullStats.candidates);
+				ImGui::Text("Light  %5zu / %5zu", mCullStats.lightVisible, mCullStats.candidates);
+				ImGui::Text("BVH    %5zu entities, height %d", mSpatialStats.entities, mSceneBvh.height());
+				ImGui::Text("Moved  %5zu, inserted %zu, reinserted %zu", mSpatialStats.moved, mSpatialStats.inserted, mSpatialStats.reinserted);
+				ImGui::Text("Transforms %5zu recomposed, %zu nodes in %zu levels", mTransformsRecomposed, mHierarchy.size(), mHierarchy.levels());
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("Occlusion")) {
+				auto const& stats = mOcclusionBuffer.stats();
+				ImGui::Text("Occluders %5zu, %zu triangles", stats.occluders, stats.triangles);
+				ImGui::Text("Occluded  %5zu / %5zu", stats.occluded, stats.tests);
+				ImGui::Text("Workers   %5u", mJobs.workers());
+				ImGui::SliderFloat("Min occluder size", &mOccluderMinSize, 0.0f, 1.0f);
+
+				if (mOcclusionCulling) {
+					int width = mOcclusionBuffer.width();
+					int height = mOcclusionBuffer.height();
+					mOcclusionBuffer.debugImage(mOcclusionPixels);
+
+					if (mOcclusionDebugSize != glm::ivec2(width, height)) {
+						using enum hyperengine::Texture::WrapMode;
+						using enum hyperengine::Texture::FilterMode;
+						mOcclusionDebug = hyperengine::Texture({ .width = width, .height = height, .format = hyperengine::PixelFormat::kRgba8, .minFilter = kNearest, .magFilter = kNearest, .wrap = kClampEdge, .label = "Occlusion Debug" });
+						mOcclusionDebugSize = { width, height };
+					}
+
+					mOcclusionDebug.upload({ .width = width, .height = height, .format = hyperengine::PixelFormat::kRgba8, .pixels = mOcclusionPixels.data() });
+					ImGui::Image((void*)(uintptr_t)mOcclusionDebug.handle(), { static_cast<float>(width * 2), static_cast<float>(height * 2) }, { 0, 1 }, { 1, 0 });
+				}
+
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("GPU Timings")) {
+				if (ImGui::BeginTable("GPU Timings", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+					for (char const* column : { "Pass", "Mean", "Median", "P95", "Max", "Budget" })
+						ImGui::TableSetupColumn(column);
+					ImGui::TableHeadersRow();
+
+					for (auto const& timing : mGpuProfiler.timings()) {
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						ImGui::TextUnformatted(timing.name.c_str());
+						ImGui::TableNextColumn();
+						ImGui::Text("%6.3f", timing.mean);
+						ImGui::TableNextColumn();
+						ImGui::Text("%6.3f", timing.median);
+						ImGui::TableNextColumn();
+						ImGui::TextColored(timing.overBudget() ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f) : ImGui::GetStyleColorVec4(ImGuiCol_Text), "%6.3f", timing.p95);
+						ImGui::TableNextColumn();
+						ImGui::Text("%6.3f", timing.max);
+						ImGui::TableNextColumn();
+
+						// Zero disables the budget
+						float budget = timing.budget;
+						ImGui::PushID(timing.name.c_str());
+						ImGui::SetNextItemWidth(64.0f);
+						if (ImGui::DragFloat("##budget", &budget, 0.01f, 0.0f, 100.0f, "%.2f"))
+							mGpuProfiler.budget(timing.name, budget);
+						ImGui::PopID();
+					}
+
+					ImGui::EndTable();
+				}
+
+				ImGui::Text("Milliseconds over the last 240 frames, %llu frames dropped", static_cast<unsigned long long>(mGpuProfiler.dropped()));
+				if (ImGui::Button("Export CSV")) {
+					if (mGpuProfiler.exportCsv("gpu_timings.csv"))
+						spdlog::info("Wrote gpu_timings.csv");
+					else
+						spdlog::error("Failed to write gpu_timings.csv");
+				}
+
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("Frame Graph")) {
+				auto const& stats = mFrameGraph.stats();
+				for (auto const& pass : mFrameGraph.report())
+					ImGui::Text("%-10s %s", pass.name.c_str(), pass.culled ? "culled" : "");
+
+				ImGui::Text("Passes     %5u, %u culled", stats.passes, stats.culled);
+				ImGui::Text("Transients %5u in %u textures", stats.transients, stats.textures);
+				ImGui::Text("Pooled     %5u textures, %.1f MiB, %u framebuffers", stats.pooled, stats.pooledBytes / (1024.0 * 1024.0), stats.framebuffers);
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("Governor")) {
+				auto const& stats = mGovernor.stats();
+				float target = mGovernor.target();
+				if (ImGui::DragFloat("Target ms", &target, 0.1f, 1.0f, 100.0f, "%.2f"))
+					mGovernor.target(target);
+
+				ImGui::Text("Cpu        %7.2f ms%s", stats.cpu, stats.cpuBound ? ", cpu bound" : "");
+				ImGui::Text("Gpu        %7.2f ms", stats.gpu);
+				ImGui::Text("Resolution %d x %d of %d x %d", mRenderSize.x, mRenderSize.y, mViewportSize.x, mViewportSize.y);
+				ImGui::Text("Quality    %s", mGovernorEnabled && mGovernor.level() > 0 ? "fast" : "full");
+				ImGui::Text("Changes    %u scale, %u quality", stats.scaleChanges, stats.levelChanges);
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("Lights")) {
+				auto const& stats = mLightClusters.stats();
+				glm::uvec4 grid = mLightClusters.grid();
+				ImGui::Text("Clusters   %u x %u x %u", grid.x, grid.y, grid.z);
+				ImGui::Text("Lights     %5u / %5u visible", stats.visible, stats.lights);
+				ImGui::Text("Indices    %5u, %u in the fullest cluster", stats.indices, stats.maxPerCluster);
+				if (stats.dropped) ImGui::TextColored({ 1.0f, 0.4f, 0.4f, 1.0f }, "Dropped    %5u", stats.dropped);
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("State Changes")) {
+				auto const& stats = mStateCache.stats();
+				auto row = [](char const* name, hyperengine::RenderStateCache::Counter const& counter) {
+					ImGui::Text("%-10s %5u / %5u", name, counter.applied, counter.requested);
+				};
+
+				ImGui::Text("Draws      %5u", stats.draws);
+				ImGui::Text("Instances  %5u", stats.instances);
+				row("Programs", stats.programs);
+				row("Textures", stats.textures);
+				row("Buffers", stats.buffers);
+				row("Meshes", stats.meshes);
+				row("Culling", stats.cullToggles);
+				ImGui::Text("Commands   %5zu in %zu lists, %.1f KiB", mCommandStats.commands, mCommandStats.lists, mCommandStats.bytes / 1024.0);
+				ImGui::Text("Ring       %7.1f / %7.1f KiB%s", mFrameRing.used() / 1024.0, mFrameRing.regionSize() / 1024.0, mFrameRing.persistent() ? "" : ", staged");
+				if (mResourceManager.mPackTextures) {
+					auto arrays = mResourceManager.mTextureArrays.stats();
+					ImGui::Text("Arrays     %5u, %u / %u layers", arrays.arrays, arrays.used, arrays.layers);
+				}
+				ImGui::TreePop();
+			}
 		}
 		ImGui::End();
 
@@ -1609,10 +2920,11 @@ struct Engine final {
 					resizeFramebuffers(contentAvail);
 
 					// Defaults
-					Transform* cameraTransform =  &mEditorCameraTransform;
+					hyperengine::Transform* cameraTransform =  &mEditorCameraTransform;
 					CameraComponent* cameraCamera = &mEditorCamera;
-					glm::vec3 sunDirection = glm::normalize(glm::vec3(0.0f, -1.0f, 0.01f));
-					glm::vec3 sunColor = glm::vec3(1.0f) * 3.0f;
+					glm::vec3 sunDirection;
+					glm::vec3 sunColor;
+					findSun(sunDirection, sunColor);
 
 					// Find camera // TODO: Add scene panel and use this to find cameras for that
 					//for (auto&& [entity, gameObject, camera] : mRegistry.view<GameObjectComponent, CameraComponent>().each()) {
@@ -1621,24 +2933,18 @@ struct Engine final {
 					//	break;
 					//}
 
-					// Find sun
-					for (auto&& [entity, gameObject, light] : mRegistry.view<GameObjectComponent, LightComponent>().each()) {
-						//gameObject.transform.orientation = glm::rotate(gameObject.transform.orientation, glm::radians(ImGui::GetIO().DeltaTime * 10.0f), glm::vec3(1, 0, 0));
-						//gameObject.transform.orientation = glm::rotate(gameObject.transform.orientation, glm::radians(ImGui::GetIO().DeltaTime * 1.0f), glm::vec3(0, 1, 0));
-
-						sunDirection = glm::normalize(glm::vec3(gameObject.transform.get() * glm::vec4(0, 0, -1, 0)));
-						sunColor = light.color * light.strength;
-						break;
-					}
-
 					if (cameraTransform && cameraCamera) {
 						// Draw image
 						ImGui::Image((void*)(uintptr_t)mPostFramebufferColor.handle(), ImGui::GetContentRegionAvail(), { 0, 1 }, { 1, 0 });
+						bool viewportClicked = ImGui::IsItemClicked(ImGuiMouseButton_Left);
+						glm::vec2 viewportMin = std::bit_cast<glm::vec2>(ImGui::GetItemRectMin());
+						glm::vec2 viewportSize = std::bit_cast<glm::vec2>(ImGui::GetItemRectSize());
 
 						// Draw transformation widget
 						if (mSelected != entt::null) {
 							GameObjectComponent& gameObject = mRegistry.get<GameObjectComponent>(mSelected);
-							glm::mat4 matrix = gameObject.transform.get();
+							entt::entity parent = parentOf(mSelected);
+							glm::mat4 matrix = worldMatrix(mSelected);
 
 							ImGuizmo::SetDrawlist();
 							ImGuizmo::SetRect(ImGui::GetWindowPos().x, ImGui::GetWindowPos().y, ImGui::GetWindowWidth(), ImGui::GetWindowHeight());
@@ -1647,7 +2953,8 @@ struct Engine final {
 							glm::mat4 cameraProjection = glm::perspective(glm::radians(cameraCamera->fov), static_cast<float>(mViewportSize.x) / static_cast<float>(mViewportSize.y), cameraCamera->clippingPlanes.x, cameraCamera->clippingPlanes.y);
 
 							if (ImGuizmo::Manipulate(glm::value_ptr(glm::inverse(cameraTransform->get())), glm::value_ptr(cameraProjection), mOperation, mMode, glm::value_ptr(matrix))) {
-								gameObject.transform.set(matrix);
+								gameObject.transform.set(parent == entt::null ? matrix : glm::inverse(worldMatrix(parent)) * matrix);
+								markTransformDirty(mSelected);
 
 								glm::vec2 vec = std::bit_cast<glm::vec2>(ImGui::GetIO().MouseDelta) * 3.0f;
 								vec.y *= -1.0f;
@@ -1671,6 +2978,22 @@ struct Engine final {
 							}
 						}
 
+						// Select by clicking, the gizmo takes priority over whatever is behind it
+						if (viewportClicked && !(mSelected != entt::null && ImGuizmo::IsOver())) {
+							glm::vec2 ndc = (std::bit_cast<glm::vec2>(ImGui::GetMousePos()) - viewportMin) / viewportSize * 2.0f - 1.0f;
+							ndc.y = -ndc.y;
+
+							glm::mat4 cameraProjection = glm::perspective(glm::radians(cameraCamera->fov), static_cast<float>(mViewportSize.x) / static_cast<float>(mViewportSize.y), cameraCamera->clippingPlanes.x, cameraCamera->clippingPlanes.y);
+							glm::mat4 inverse = glm::inverse(cameraProjection * glm::inverse(cameraTransform->get()));
+							glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+							glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+							glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+							glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+							float length = glm::length(direction);
+							mSelected = pickEntity({ origin, direction / length }, length);
+						}
+
 						// Move camera in scene
 						if (ImGui::IsWindowFocused() && ImGui::IsWindowHovered()) {
 							if (ImGui::IsMouseDown(ImGuiMouseButton_Right)) {
@@ -1714,7 +3037,7 @@ struct Engine final {
 
 	hyperengine::Window mWindow;
 
-	Transform mEditorCameraTransform;
+	hyperengine::Transform mEditorCameraTransform;
 	CameraComponent mEditorCamera;
 
 	hyperengine::gui::Filesystem mGuiFilesystem;
@@ -1723,7 +3046,10 @@ struct Engine final {
 	float mShadowMapNear = 0.1f;
 	float mShadowMapDistance = 64.0f;
 	int mShadowMapSize = 2048;
-	hyperengine::Framebuffer mFramebufferShadow;
+	float mCascadeLambda = 0.75f;
+	bool mShadowCaching = true;
+	std::array<ShadowCascade, hyperengine::kShadowCascades> mCascades;
+	std::array<hyperengine::Framebuffer, hyperengine::kShadowCascades> mFramebufferShadow;
 	hyperengine::Texture mFramebufferShadowDepth;
 
 	hyperengine::AudioEngine mAudioEngine;
@@ -1733,23 +3059,34 @@ struct Engine final {
 	entt::entity mRoot = entt::null;
 	PhysicsWorld mPhysicsWorld;
 
-	GLuint mEngineUniformBuffer = 0;
+	GLintptr mEngineOffset = 0;
 	UniformEngineData mUniformEngineData;
 
-	hyperengine::Framebuffer mFramebuffer;
-	hyperengine::Renderbuffer mFramebufferDepth;
-	hyperengine::Texture mFramebufferColor;
+	hyperengine::FrameGraph mFrameGraph;
 	glm::ivec2 mViewportSize{};
 
 	std::unordered_map<std::u8string, std::string> mFileErrors;
 
-	hyperengine::Framebuffer mPostFramebuffer;
 	hyperengine::Texture mPostFramebufferColor;
 
 	glm::vec3 mSkyColor = { 0.7f, 0.8f, 0.9f };
 	bool mWireframe = false;
+	bool mFastShaders = false;
+	bool mShadows = true;
+	bool mDepthPrepass = true;
+	bool mDepthPrepassActive = false; // Set while building the queue, off until the depth programs are ready
+	bool mTextureArrays = true; // Needs textures packed on load
+	bool mGovernorEnabled = false;
+	float mRenderScale = 1.0f; // Used while the governor is off
+	glm::ivec2 mRenderSize{}; // Scene targets, the viewport scaled
+	hyperengine::PixelFormat mSceneColorFormat = hyperengine::PixelFormat::kR11G11B10f;
+	bool mMultiDraw = true;
+	bool mFrustumCulling = true;
+	bool mOcclusionCulling = true;
+	float mOccluderMinSize = 0.1f; // Bounding radius over distance
 
 	bool mRunning = true;
+	float mTime = 0.0f; // Seconds, fixed steps when headless
 	Views mViews;
 	glm::ivec2 mFramebufferSize{};
 	ImGuizmo::OPERATION mOperation = ImGuizmo::OPERATION::TRANSLATE;
@@ -1759,6 +3096,63 @@ struct Engine final {
 
 	std::shared_ptr<hyperengine::ShaderProgram> mShadowProgram;
 	std::shared_ptr<hyperengine::ShaderProgram> mAcesProgram;
+	std::shared_ptr<hyperengine::ShaderProgram> mFallbackProgram;
+
+	hyperengine::JobSystem mJobs;
+	hyperengine::OcclusionBuffer mOcclusionBuffer;
+	hyperengine::Texture mOcclusionDebug;
+	glm::ivec2 mOcclusionDebugSize{};
+	std::vector<uint32_t> mOcclusionPixels;
+
+	struct CullStats final {
+		size_t candidates = 0;
+		size_t cameraVisible = 0;
+		size_t lightVisible = 0;
+	};
+
+	struct SpatialStats final {
+		size_t entities = 0;
+		size_t inserted = 0;
+		size_t moved = 0;
+		size_t reinserted = 0;
+	};
+
+	std::vector<hyperengine::Transform> mDirtyTransforms;
+	std::vector<glm::mat4> mDirtyMatrices;
+	std::vector<entt::entity> mTransformsChanged;
+	hyperengine::TransformHierarchy mHierarchy;
+	std::vector<uint32_t> mHierarchyChanged;
+	std::vector<entt::entity> mDestroyQueue;
+	std::pair<entt::entity, entt::entity> mHierarchyMove{ entt::null, entt::null };
+	entt::entity mHierarchyDelete = entt::null;
+	size_t mTransformsRecomposed = 0;
+	hyperengine::DynamicBvh mSceneBvh;
+	std::vector<hyperengine::DynamicBvh::RayHit> mRayHits;
+	SpatialStats mSpatialStats;
+	std::vector<CullCandidate> mCullCandidates;
+	hyperengine::SphereBatch mCullSpheres;
+	std::vector<uint8_t> mCameraVisible;
+	std::array<std::vector<uint8_t>, hyperengine::kShadowCascades> mLightVisible;
+	CullStats mCullStats;
+	std::vector<DrawPacket> mDrawPackets;
+	std::vector<hyperengine::DrawElementsIndirectCommand> mIndirectCommands;
+	std::array<std::vector<DrawGroup>, static_cast<size_t>(hyperengine::RenderPass::kCount)> mDrawGroups;
+	std::unordered_map<uint64_t, GLintptr> mMaterialOffsets;
+	std::vector<uint8_t> mLayeredMaterial;
+	std::vector<RecordJob> mRecordJobs;
+	std::vector<hyperengine::CommandList> mCommandLists;
+	std::array<CommandRange, static_cast<size_t>(hyperengine::RenderPass::kCount)> mCommandRanges{};
+	CommandStats mCommandStats;
+	hyperengine::LightClusters mLightClusters;
+	std::vector<hyperengine::LightClusters::Light> mLights;
+	hyperengine::RingBuffer mFrameRing;
+	hyperengine::GpuProfiler mGpuProfiler;
+	hyperengine::QualityGovernor mGovernor;
+	GLsizeiptr mUniformAlignment = 256;
+	GLintptr mInstanceOffset = 0;
+	GLintptr mIndirectOffset = 0;
+	hyperengine::RenderQueue mRenderQueue;
+	hyperengine::RenderStateCache mStateCache;
 	std::shared_ptr<hyperengine::Texture> mInternalTextureBlack;
 	std::shared_ptr<hyperengine::Texture> mInternalTextureWhite;
 	std::shared_ptr<hyperengine::Texture> mInternalTextureUv;
@@ -1799,6 +3193,41 @@ int main(int argc, char* argv[]) {
 	setupLogger();
 	hyperengine::rdoc::setup(true);
 
+	if (argc >= 3 && std::string_view(argv[1]) == "--benchmark") {
+		bool found = hyperengine::benchmark::run(argv[2]);
+		spdlog::shutdown();
+		return found ? 0 : 1;
+	}
+
+	// --headless <scene> [--frames n] [--size WxH] [--output image.ppm] [--timings gpu.csv]
+	if (argc >= 3 && std::string_view(argv[1]) == "--headless") {
+		Engine::HeadlessInfo info{ .scene = argv[2] };
+
+		for (int i = 3; i + 1 < argc; i += 2) {
+			std::string_view option = argv[i];
+
+			if (option == "--frames")
+				info.frames = std::max(std::atoi(argv[i + 1]), 0);
+			else if (option == "--size" && std::sscanf(argv[i + 1], "%dx%d", &info.size.x, &info.size.y) == 2)
+				info.size = glm::max(info.size, glm::ivec2(1));
+			else if (option == "--output")
+				info.output = argv[i + 1];
+			else if (option == "--timings")
+				info.timings = argv[i + 1];
+			else
+				spdlog::warn("Ignoring headless option {} {}", option, argv[i + 1]);
+		}
+
+		int result;
+		{
+			Engine engine;
+			result = engine.runHeadless(info);
+		}
+
+		spdlog::shutdown();
+		return result;
+	}
+
 	bool runVulkanDemo = false;
 
 	{
@@ -0,0 +1,299 @@
+#include "he_hierarchy.hpp"
+
+#include <algorithm>
+
+#include "he_jobs.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define HE_HIERARCHY_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace hyperengine {
+	namespace {
+		// `out` must not alias the inputs
+		inline void multiply(glm::mat4 const& parent, glm::mat4 const& local, glm::mat4& out) {
+#ifdef HE_HIERARCHY_SSE2
+			__m128 c0 = _mm_loadu_ps(&parent[0].x);
+			__m128 c1 = _mm_loadu_ps(&parent[1].x);
+			__m128 c2 = _mm_loadu_ps(&parent[2].x);
+			__m128 c3 = _mm_loadu_ps(&parent[3].x);
+
+			for (int i = 0; i < 4; ++i) {
+				__m128 column = _mm_mul_ps(c0, _mm_set1_ps(local[i][0]));
+				column = _mm_add_ps(column, _mm_mul_ps(c1, _mm_set1_ps(local[i][1])));
+				column = _mm_add_ps(column, _mm_mul_ps(c2, _mm_set1_ps(local[i][2])));
+				column = _mm_add_ps(column, _mm_mul_ps(c3, _mm_set1_ps(local[i][3])));
+				_mm_storeu_ps(&out[i].x, column);
+			}
+#else
+			out = parent * local;
+#endif
+		}
+	}
+
+	TransformHierarchy::TransformHierarchy(CreateInfo const& info) : mChunkSize(std::max(info.chunkSize, 1u)) {
+		mSlots.reserve(info.capacity);
+		mHandles.reserve(info.capacity);
+		mParents.reserve(info.capacity);
+		mUserData.reserve(info.capacity);
+		mLocals.reserve(info.capacity);
+		mWorlds.reserve(info.capacity);
+		mDirty.reserve(info.capacity);
+	}
+
+	TransformHierarchy::Node TransformHierarchy::insert(uint32_t userData, Node parent) {
+		Node node;
+		if (mFree != kNull) {
+			node = mFree;
+			mFree = mSlots[node].parent;
+		}
+		else {
+			node = static_cast<Node>(mSlots.size());
+			mSlots.emplace_back();
+		}
+
+		Slot& slot = mSlots[node];
+		slot = {};
+		slot.userData = userData;
+		slot.index = static_cast<int32_t>(mHandles.size());
+
+		mHandles.push_back(node);
+		mParents.push_back(-1);
+		mUserData.push_back(userData);
+		mLocals.emplace_back(1.0f);
+		mWorlds.emplace_back(1.0f);
+		mDirty.push_back(0);
+
+		link(node, parent);
+		markDirty(node);
+		mSorted = false;
+		return node;
+	}
+
+	void TransformHierarchy::remove(Node node) {
+		Node parent = mSlots[node].parent;
+
+		while (mSlots[node].first != kNull) {
+			Node child = mSlots[node].first;
+			unlink(child);
+			link(child, parent);
+			updateDepths(child);
+			markDirty(child);
+		}
+
+		unlink(node);
+
+		// Swap with the last node, the order is rebuilt before the next propagation anyway
+		size_t index = static_cast<size_t>(mSlots[node].index);
+		size_t last = mHandles.size() - 1;
+		if (index != last) {
+			mHandles[index] = mHandles[last];
+			mUserData[index] = mUserData[last];
+			mLocals[index] = mLocals[last];
+			mWorlds[index] = mWorlds[last];
+			mDirty[index] = mDirty[last];
+			mSlots[mHandles[index]].index = static_cast<int32_t>(index);
+		}
+
+		mHandles.pop_back();
+		mParents.pop_back();
+		mUserData.pop_back();
+		mLocals.pop_back();
+		mWorlds.pop_back();
+		mDirty.pop_back();
+
+		mSlots[node] = {};
+		mSlots[node].parent = mFree;
+		mFree = node;
+		mSorted = false;
+	}
+
+	bool TransformHierarchy::reparent(Node node, Node parent) {
+		if (mSlots[node].parent == parent) return true;
+
+		for (Node ancestor = parent; ancestor != kNull; ancestor = mSlots[ancestor].parent)
+			if (ancestor == node) return false;
+
+		uint32_t depth = mSlots[node].depth;
+		unlink(node);
+		link(node, parent);
+		markDirty(node);
+
+		// Same depth keeps the levels intact, only the parent index changes
+		if (mSorted && mSlots[node].depth == depth) {
+			mParents[mSlots[node].index] = parent == kNull ? -1 : mSlots[parent].index;
+			return true;
+		}
+
+		updateDepths(node);
+		mSorted = false;
+		return true;
+	}
+
+	void TransformHierarchy::local(Node node, glm::mat4 const& matrix) {
+		mLocals[mSlots[node].index] = matrix;
+		markDirty(node);
+	}
+
+	void TransformHierarchy::clear() {
+		mSlots.clear();
+		mFree = kNull;
+		mHandles.clear();
+		mParents.clear();
+		mUserData.clear();
+		mLocals.clear();
+		mWorlds.clear();
+		mDirty.clear();
+		mLevels.clear();
+		mDirtyDepth = UINT32_MAX;
+		mSorted = true;
+	}
+
+	void TransformHierarchy::link(Node node, Node parent) {
+		Slot& slot = mSlots[node];
+		slot.parent = parent;
+		slot.prev = kNull;
+
+		if (parent == kNull) {
+			slot.next = kNull;
+			slot.depth = 0;
+			return;
+		}
+
+		slot.next = mSlots[parent].first;
+		if (slot.next != kNull) mSlots[slot.next].prev = node;
+		mSlots[parent].first = node;
+		slot.depth = mSlots[parent].depth + 1;
+	}
+
+	void TransformHierarchy::unlink(Node node) {
+		Slot& slot = mSlots[node];
+
+		if (slot.prev != kNull)
+			mSlots[slot.prev].next = slot.next;
+		else if (slot.parent != kNull)
+			mSlots[slot.parent].first = slot.next;
+
+		if (slot.next != kNull)
+			mSlots[slot.next].prev = slot.prev;
+
+		slot.parent = kNull;
+		slot.prev = kNull;
+		slot.next = kNull;
+	}
+
+	// The depth of `node` itself is already set by `link`
+	void TransformHierarchy::updateDepths(Node node) {
+		mScratch.clear();
+		mScratch.push_back(static_cast<uint32_t>(node));
+
+		while (!mScratch.empty()) {
+			Node current = static_cast<Node>(mScratch.back());
+			mScratch.pop_back();
+
+			for (Node child = mSlots[current].first; child != kNull; child = mSlots[child].next) {
+				mSlots[child].depth = mSlots[current].depth + 1;
+				mScratch.push_back(static_cast<uint32_t>(child));
+			}
+		}
+	}
+
+	void TransformHierarchy::markDirty(Node node) {
+		mDirty[mSlots[node].index] = 1;
+		mDirtyDepth = std::min(mDirtyDepth, mSlots[node].depth);
+	}
+
+	// Breadth first, every level is ordered by parent so propagation reads the previous level front to back
+	void TransformHierarchy::sortByDepth() {
+		mSortedHandles.clear();
+		for (Node node : mHandles)
+			if (mSlots[node].parent == kNull) mSortedHandles.push_back(node);
+
+		mLevels.assign(1, 0);
+		for (size_t begin = 0; begin < mSortedHandles.size();) {
+			size_t end = mSortedHandles.size();
+			mLevels.push_back(static_cast<uint32_t>(end));
+
+			for (size_t i = begin; i < end; ++i)
+				for (Node child = mSlots[mSortedHandles[i]].first; child != kNull; child = mSlots[child].next)
+					mSortedHandles.push_back(child);
+
+			begin = end;
+		}
+
+		mSortedUserData.resize(mUserData.size());
+		mSortedLocals.resize(mLocals.size());
+		mSortedWorlds.resize(mWorlds.size());
+		mSortedDirty.resize(mDirty.size());
+
+		for (size_t i = 0; i < mSortedHandles.size(); ++i) {
+			Slot& slot = mSlots[mSortedHandles[i]];
+			size_t previous = static_cast<size_t>(slot.index);
+			mSortedUserData[i] = mUserData[previous];
+			mSortedLocals[i] = mLocals[previous];
+			mSortedWorlds[i] = mWorlds[previous];
+			mSortedDirty[i] = mDirty[previous];
+			slot.index = static_cast<int32_t>(i);
+		}
+
+		mHandles.swap(mSortedHandles);
+		mUserData.swap(mSortedUserData);
+		mLocals.swap(mSortedLocals);
+		mWorlds.swap(mSortedWorlds);
+		mDirty.swap(mSortedDirty);
+
+		for (size_t i = 0; i < mHandles.size(); ++i) {
+			Node parent = mSlots[mHandles[i]].parent;
+			mParents[i] = parent == kNull ? -1 : mSlots[parent].index;
+		}
+
+		mSorted = true;
+	}
+
+	// Parents were finished by the previous level, a node is dirty if it or its parent is
+	void TransformHierarchy::propagateRange(uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			int32_t parent = mParents[i];
+			if (!mDirty[i] && (parent < 0 || !mDirty[parent])) continue;
+
+			mDirty[i] = 1;
+			if (parent < 0)
+				mWorlds[i] = mLocals[i];
+			else
+				multiply(mWorlds[parent], mLocals[i], mWorlds[i]);
+		}
+	}
+
+	void TransformHierarchy::propagate(std::vector<uint32_t>& changed, JobSystem* jobs) {
+		if (!mSorted) sortByDepth();
+		if (mDirtyDepth >= levels()) {
+			mDirtyDepth = UINT32_MAX;
+			return;
+		}
+
+		for (size_t depth = mDirtyDepth; depth < levels(); ++depth) {
+			uint32_t begin = mLevels[depth];
+			uint32_t end = mLevels[depth + 1];
+			uint32_t chunks = (end - begin + mChunkSize - 1) / mChunkSize;
+
+			if (!jobs || chunks < 2) {
+				propagateRange(begin, end);
+				continue;
+			}
+
+			jobs->parallelFor(chunks, [&](uint32_t chunk) {
+				uint32_t first = begin + chunk * mChunkSize;
+				propagateRange(first, std::min(first + mChunkSize, end));
+			});
+		}
+
+		for (size_t i = mLevels[mDirtyDepth]; i < mHandles.size(); ++i) {
+			if (!mDirty[i]) continue;
+			mDirty[i] = 0;
+			changed.push_back(mUserData[i]);
+		}
+
+		mDirtyDepth = UINT32_MAX;
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace hyperengine {
+	class JobSystem;
+
+	// Parent links over local and world matrices kept in breadth first order. Every depth is a contiguous range
+	// so worlds are propagated level by level, each level split into chunks that run in parallel.
+	// Reparenting only touches the moved subtree and marks the order stale, the next `propagate` rebuilds it
+	class TransformHierarchy final {
+	public:
+		using Node = int32_t;
+		static constexpr Node kNull = -1;
+
+		struct CreateInfo final {
+			size_t capacity = 0;
+			uint32_t chunkSize = 4096; // Nodes per job, smaller levels are propagated on the calling thread
+		};
+
+		TransformHierarchy() : TransformHierarchy(CreateInfo{}) {}
+		TransformHierarchy(CreateInfo const& info);
+
+		Node insert(uint32_t userData, Node parent = kNull);
+		// Children of the removed node move up to its parent
+		void remove(Node node);
+		// Returns false and changes nothing if `parent` is `node` or one of its descendants
+		bool reparent(Node node, Node parent);
+		void local(Node node, glm::mat4 const& matrix);
+		void clear();
+
+		inline uint32_t userData(Node node) const { return mSlots[node].userData; }
+		inline Node parent(Node node) const { return mSlots[node].parent; }
+		inline Node firstChild(Node node) const { return mSlots[node].first; }
+		inline Node nextSibling(Node node) const { return mSlots[node].next; }
+		inline uint32_t depth(Node node) const { return mSlots[node].depth; }
+		inline glm::mat4 const& local(Node node) const { return mLocals[mSlots[node].index]; }
+		// Valid after `propagate`
+		inline glm::mat4 const& world(Node node) const { return mWorlds[mSlots[node].index]; }
+		inline size_t size() const { return mHandles.size(); }
+		inline size_t levels() const { return mLevels.empty() ? 0 : mLevels.size() - 1; }
+
+		// Recomputes the world matrix of every changed node and its descendants, appends their user data to `changed`
+		void propagate(std::vector<uint32_t>& changed, JobSystem* jobs = nullptr);
+	private:
+		struct Slot final {
+			Node parent = kNull; // Next free slot while on the free list
+			Node first = kNull;
+			Node next = kNull;
+			Node prev = kNull;
+			uint32_t depth = 0;
+			int32_t index = -1; // Position in the depth sorted arrays, -1 while free
+			uint32_t userData = 0;
+		};
+
+		void link(Node node, Node parent);
+		void unlink(Node node);
+		void updateDepths(Node node);
+		void markDirty(Node node);
+		void sortByDepth();
+		void propagateRange(uint32_t begin, uint32_t end);
+
+		std::vector<Slot> mSlots;
+		Node mFree = kNull;
+
+		// Depth sorted, indexed by `Slot::index`
+		std::vector<Node> mHandles;
+		std::vector<int32_t> mParents;
+		std::vector<uint32_t> mUserData;
+		std::vector<glm::mat4> mLocals;
+		std::vector<glm::mat4> mWorlds;
+		std::vector<uint8_t> mDirty;
+
+		// Targets of the sort, kept to avoid reallocating
+		std::vector<Node> mSortedHandles;
+		std::vector<uint32_t> mSortedUserData;
+		std::vector<glm::mat4> mSortedLocals;
+		std::vector<glm::mat4> mSortedWorlds;
+		std::vector<uint8_t> mSortedDirty;
+
+		std::vector<uint32_t> mLevels; // First index of every depth, one past the end last
+		std::vector<uint32_t> mScratch;
+		uint32_t mChunkSize = 4096;
+		uint32_t mDirtyDepth = UINT32_MAX; // Shallowest depth with a dirty node
+		bool mSorted = true;
+	};
+}
@@ -15,6 +15,8 @@
 
 #include <spdlog/spdlog.h>
 
+#include "graphics/he_occlusion.hpp"
+
 namespace hyperengine {
 	std::optional<std::string> readFileString(char const* path) {
 		std::ifstream file;
@@ -51,7 +53,27 @@ namespace hyperengine {
 		file.write(static_cast<char const*>(data), size);
 	}
 
-	std::optional<hyperengine::Mesh> readMesh(char const* path) {
+	bool writeImagePpm(char const* path, int width, int height, std::span<std::byte const> pixels) {
+		if (pixels.size() < static_cast<size_t>(width) * height * 4) return false;
+
+		std::ofstream file(path, std::ofstream::out | std::ofstream::binary);
+		if (!file) return false;
+
+		file << "P6\n" << width << " " << height << "\n255\n";
+
+		std::vector<char> row(static_cast<size_t>(width) * 3);
+		for (int y = height - 1; y >= 0; --y) {
+			std::byte const* source = pixels.data() + static_cast<size_t>(y) * width * 4;
+			for (int x = 0; x < width; ++x)
+				for (int c = 0; c < 3; ++c)
+					row[x * 3 + c] = static_cast<char>(source[x * 4 + c]);
+			file.write(row.data(), row.size());
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	std::optional<hyperengine::Mesh> readMesh(char const* path, std::shared_ptr<hyperengine::MeshPool> const& pool) {
 		struct Vertex final {
 			glm::vec3 position;
 			glm::vec3 normal;
@@ -86,6 +108,8 @@ namespace hyperengine {
 
 		std::vector<Vertex> vertices;
 		vertices.reserve(mesh->mNumVertices);
+		std::vector<glm::vec3> positions;
+		positions.reserve(mesh->mNumVertices);
 
 		for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
 			glm::vec2 texCoord = glm::vec2(0, 0);
@@ -100,6 +124,7 @@ namespace hyperengine {
 			}
 
 			vertices.emplace_back(std::bit_cast<glm::vec3>(mesh->mVertices[i]), std::bit_cast<glm::vec3>(mesh->mNormals[i]), texCoord, tangent);
+			positions.push_back(vertices.back().position);
 		}
 
 		unsigned char elementPrimitiveWidth;
@@ -109,6 +134,8 @@ namespace hyperengine {
 
 		std::vector<char> elements;
 		elements.reserve(mesh->mNumFaces * 3 * elementPrimitiveWidth);
+		std::vector<uint32_t> indices;
+		indices.reserve(mesh->mNumFaces * 3);
 
 		GLsizei count = 0;
 
@@ -125,6 +152,7 @@ namespace hyperengine {
 				// This method is okay for little endian systems, should verify for big endian
 				uint32_t element = face.mIndices[iElement];
 				memcpy(elements.data() + elements.size() - elementPrimitiveWidth, &element, elementPrimitiveWidth);
+				indices.push_back(element);
 			}
 		}
 
@@ -141,11 +169,15 @@ namespace hyperengine {
 				.elements = std::as_bytes(std::span(elements)),
 				.elementStride = elementPrimitiveWidth,
 				.attributes = attributes,
-				.origin = path
+				.positions = std::as_bytes(std::span(positions)),
+				.origin = path,
+				.bounds = hyperengine::Bounds::fromPoints(positions),
+				.pool = pool,
+				.occluder = hyperengine::Occluder::fromTriangles(positions, indices)
 			}};
 	}
 
-	std::optional<hyperengine::Texture> readTextureImage(char const* filepath) {
+	std::optional<hyperengine::Texture> readTextureImage(char const* filepath, Image* image) {
 		stbi_set_flip_vertically_on_load(true);
 
 		hyperengine::Texture texture;
@@ -176,6 +208,11 @@ namespace hyperengine {
 				.mips = true
 			});
 
+		if (image) {
+			std::byte const* bytes = reinterpret_cast<std::byte const*>(pixels);
+			*image = { .width = x, .height = y, .pixels = std::vector<std::byte>(bytes, bytes + static_cast<size_t>(x) * y * 4) };
+		}
+
 		stbi_image_free(pixels);
 
 		return texture;
@@ -1,4 +1,6 @@
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -6,9 +8,19 @@
 #include "graphics/he_texture.hpp"
 
 namespace hyperengine {
+	// Decoded pixels as uploaded, bottom row first
+	struct Image final {
+		int width = 0;
+		int height = 0;
+		std::vector<std::byte> pixels;
+	};
+
 	std::optional<std::string> readFileString(char const* path);
 	std::optional<std::vector<char>> readFileBinary(char const* path);
 	void writeFile(char const* path, void const* data, size_t size);
-	std::optional<hyperengine::Mesh> readMesh(char const* path);
-	std::optional<hyperengine::Texture> readTextureImage(char const* filepath);
+	// Binary PPM from bottom up RGBA8 rows as OpenGL returns them, alpha is dropped
+	bool writeImagePpm(char const* path, int width, int height, std::span<std::byte const> pixels);
+	std::optional<hyperengine::Mesh> readMesh(char const* path, std::shared_ptr<hyperengine::MeshPool> const& pool = nullptr);
+	// RGBA8, `image` receives a copy of the pixels when given
+	std::optional<hyperengine::Texture> readTextureImage(char const* filepath, Image* image = nullptr);
 }
\ No newline at end of file
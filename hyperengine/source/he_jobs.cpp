@@ -0,0 +1,71 @@
+#include "he_jobs.hpp"
+
+#include <algorithm>
+
+namespace hyperengine {
+	JobSystem::JobSystem(CreateInfo const& info) {
+		unsigned workers = info.workers;
+		if (workers == 0) workers = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+
+		mThreads.reserve(workers);
+		for (unsigned i = 0; i < workers; ++i)
+			mThreads.emplace_back(&JobSystem::work, this);
+	}
+
+	JobSystem::~JobSystem() noexcept {
+		{
+			std::lock_guard lock(mMutex);
+			mQuit = true;
+		}
+
+		mWake.notify_all();
+		for (std::thread& thread : mThreads)
+			thread.join();
+	}
+
+	void JobSystem::drain() {
+		for (uint32_t i = mNext.fetch_add(1, std::memory_order_relaxed); i < mCount; i = mNext.fetch_add(1, std::memory_order_relaxed))
+			(*mFn)(i);
+	}
+
+	void JobSystem::work() {
+		uint64_t generation = 0;
+
+		while (true) {
+			{
+				std::unique_lock lock(mMutex);
+				mWake.wait(lock, [&]() { return mQuit || mGeneration != generation; });
+				if (mQuit) return;
+				generation = mGeneration;
+			}
+
+			drain();
+
+			std::lock_guard lock(mMutex);
+			if (--mActive == 0) mDone.notify_one();
+		}
+	}
+
+	void JobSystem::parallelFor(uint32_t count, std::function<void(uint32_t)> const& fn) {
+		if (mThreads.empty() || count <= 1) {
+			for (uint32_t i = 0; i < count; ++i) fn(i);
+			return;
+		}
+
+		{
+			std::lock_guard lock(mMutex);
+			mFn = &fn;
+			mCount = count;
+			mNext.store(0, std::memory_order_relaxed);
+			mActive = static_cast<uint32_t>(mThreads.size());
+			++mGeneration;
+		}
+
+		mWake.notify_all();
+		drain();
+
+		std::unique_lock lock(mMutex);
+		mDone.wait(lock, [&]() { return mActive == 0; });
+		mFn = nullptr;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hyperengine {
+	// Fixed pool of worker threads for data parallel loops, the calling thread takes part in every loop
+	class JobSystem final {
+	public:
+		struct CreateInfo final {
+			unsigned workers = 0; // Zero picks one less than the hardware thread count
+		};
+
+		JobSystem() : JobSystem(CreateInfo{}) {}
+		JobSystem(CreateInfo const& info);
+		JobSystem(JobSystem const&) = delete;
+		JobSystem& operator=(JobSystem const&) = delete;
+		~JobSystem() noexcept;
+
+		inline unsigned workers() const { return static_cast<unsigned>(mThreads.size()); }
+
+		// Calls `fn` once for every index below `count` and returns once all calls finished, not reentrant
+		void parallelFor(uint32_t count, std::function<void(uint32_t)> const& fn);
+	private:
+		void work();
+		void drain();
+
+		std::vector<std::thread> mThreads;
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		std::function<void(uint32_t)> const* mFn = nullptr;
+		std::atomic<uint32_t> mNext = 0;
+		uint32_t mCount = 0;
+		uint32_t mActive = 0;
+		uint64_t mGeneration = 0;
+		bool mQuit = false;
+	};
+}
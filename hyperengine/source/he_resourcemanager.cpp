@@ -1,6 +1,9 @@
 #include "he_resourcemanager.hpp"
 
+#include <array>
 #include <set>
+#include <lua.hpp>
+#include <spdlog/spdlog.h>
 #include "he_io.hpp"
 
 void ResourceManager::update() {
@@ -20,6 +23,8 @@ void ResourceManager::update() {
 			++it;
 	}
 
+	mTextureArrays.collect();
+
 	for (auto it = mMeshes.begin(); it != mMeshes.end();) {
 		if (it->second.expired()) {
 			it = mMeshes.erase(it);
@@ -35,6 +40,14 @@ void ResourceManager::update() {
 		else
 			++it;
 	}
+
+	for (auto it = mMaterials.begin(); it != mMaterials.end();) {
+		if (it->second.expired()) {
+			it = mMaterials.erase(it);
+		}
+		else
+			++it;
+	}
 }
 
 // Enforces the provided tetxure to stay for the next x frames
@@ -52,7 +65,11 @@ std::shared_ptr<hyperengine::Mesh> ResourceManager::getMesh(std::string_view pat
 
 	std::string pathStr(path);
 
-	auto optMesh = hyperengine::readMesh(pathStr.c_str());
+	// Loaded meshes share one vertex layout, keep them in one set of buffers
+	if (!mMeshPool)
+		mMeshPool = std::make_shared<hyperengine::MeshPool>(hyperengine::MeshPool::CreateInfo{ .label = "mesh pool" });
+
+	auto optMesh = hyperengine::readMesh(pathStr.c_str(), mMeshPool);
 	if (!optMesh.has_value()) return nullptr;
 
 	std::shared_ptr<hyperengine::Mesh> mesh = std::make_shared<hyperengine::Mesh>(std::move(optMesh.value()));
@@ -69,31 +86,28 @@ std::shared_ptr<hyperengine::Texture> ResourceManager::getTexture(std::string_vi
 
 	std::string pathStr(path);
 
-	auto opt = hyperengine::readTextureImage(pathStr.c_str());
+	hyperengine::Image image;
+	auto opt = hyperengine::readTextureImage(pathStr.c_str(), mPackTextures ? &image : nullptr);
 	if (!opt.has_value()) return nullptr;
 
 	std::shared_ptr<hyperengine::Texture> texture = std::make_shared<hyperengine::Texture>(std::move(opt.value()));
+	if (mPackTextures)
+		mTextureArrays.add(texture, image.width, image.height, hyperengine::PixelFormat::kRgba8, image.pixels.data());
+
 	mTextures[std::move(pathStr)] = texture;
 	return texture;
 }
 
-void ResourceManager::reloadShader(std::string const& pathStr, hyperengine::ShaderProgram& program, std::unordered_map<std::u8string, std::string>& fileErrors) {
+// Programs compile in the background, the target keeps its previous program until the new one is done
+void ResourceManager::reloadShader(std::string const& pathStr, std::shared_ptr<hyperengine::ShaderProgram> const& program) {
 	auto shader = hyperengine::readFileString(pathStr.c_str());
 	if (!shader.has_value()) return;
 
-	// reload shader, will repopulate errors
-	program = {{ .source = shader.value(), .origin = pathStr }};
-
-	if (!program.errors().empty()) {
-		std::string errorTotal;
-		for (auto const& error : program.errors()) {
-			errorTotal += error + "\n";
-		}
-		fileErrors[std::u8string((char8_t const*)pathStr.c_str())] = errorTotal;
-	}
+	std::erase_if(mShadersPending, [&](PendingShader const& pending) { return pending.target.lock() == program; });
+	mShadersPending.push_back({ .path = pathStr, .target = program, .program = {{ .source = shader.value(), .origin = pathStr }} });
 }
 
-std::shared_ptr<hyperengine::ShaderProgram> ResourceManager::getShaderProgram(std::string_view path, std::unordered_map<std::u8string, std::string>& fileErrors) {
+std::shared_ptr<hyperengine::ShaderProgram> ResourceManager::getShaderProgram(std::string_view path) {
 	auto it = mShaders.find(path);
 
 	if (it != mShaders.end())
@@ -102,10 +116,130 @@ std::shared_ptr<hyperengine::ShaderProgram> ResourceManager::getShaderProgram(st
 
 	std::string pathStr(path);
 
-	hyperengine::ShaderProgram program;
-	reloadShader(pathStr, program, fileErrors);
+	std::shared_ptr<hyperengine::ShaderProgram> obj = std::make_shared<hyperengine::ShaderProgram>();
+	reloadShader(pathStr, obj);
 
-	std::shared_ptr<hyperengine::ShaderProgram> obj = std::make_shared<hyperengine::ShaderProgram>(std::move(program));
 	mShaders[std::move(pathStr)] = obj;
 	return obj;
+}
+
+// Material files are lua scripts returning a table, parameters resolve once the shader finished compiling
+std::shared_ptr<hyperengine::Material> ResourceManager::getMaterial(std::string_view path) {
+	auto it = mMaterials.find(path);
+
+	if (it != mMaterials.end())
+		if (std::shared_ptr<hyperengine::Material> ptr = it->second.lock())
+			return ptr;
+
+	std::string pathStr(path);
+	lua_State* L = luaL_newstate();
+
+	if (luaL_dofile(L, pathStr.c_str()) != LUA_OK || !lua_istable(L, -1)) {
+		spdlog::error("Failed to load material {}: {}", pathStr, lua_isstring(L, -1) ? lua_tostring(L, -1) : "expected a table");
+		lua_close(L);
+		return nullptr;
+	}
+
+	std::shared_ptr<hyperengine::Material> material = std::make_shared<hyperengine::Material>(hyperengine::Material::CreateInfo{ .origin = pathStr });
+	readMaterial(L, *material);
+	lua_close(L);
+
+	mMaterials[std::move(pathStr)] = material;
+	return material;
+}
+
+void ResourceManager::readMaterial(lua_State* L, hyperengine::Material& material) {
+	lua_getfield(L, -1, "shader");
+	if (lua_isstring(L, -1))
+		material.shader(getShaderProgram(lua_tostring(L, -1)));
+	lua_pop(L, 1);
+
+	lua_getfield(L, -1, "textures");
+	if (lua_istable(L, -1)) {
+		int textureTable = lua_gettop(L);
+		lua_pushnil(L);
+		while (lua_next(L, textureTable) != 0) {
+			if (lua_type(L, -2) == LUA_TSTRING && lua_isstring(L, -1))
+				material.texture(std::string_view(lua_tostring(L, -2)), getTexture(lua_tostring(L, -1)));
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+
+	// Scenes name the parameter table `material`, material files `parameters`
+	for (char const* field : { "parameters", "material" }) {
+		lua_getfield(L, -1, field);
+		if (lua_istable(L, -1)) {
+			int parameterTable = lua_gettop(L);
+			lua_pushnil(L);
+			while (lua_next(L, parameterTable) != 0) {
+				std::array<float, 4> values{};
+				size_t count = 0;
+
+				if (lua_isnumber(L, -1)) {
+					values[0] = static_cast<float>(lua_tonumber(L, -1));
+					count = 1;
+				}
+				else if (lua_istable(L, -1)) {
+					for (; count < values.size(); ++count) {
+						lua_pushinteger(L, count + 1);
+						lua_gettable(L, -2);
+						bool number = lua_isnumber(L, -1);
+						if (number) values[count] = static_cast<float>(lua_tonumber(L, -1));
+						lua_pop(L, 1);
+						if (!number) break;
+					}
+				}
+
+				if (lua_type(L, -2) == LUA_TSTRING && count > 0)
+					material.parameter(lua_tostring(L, -2), std::span(values.data(), count));
+				else
+					spdlog::warn("Unsupported uniform type");
+
+				lua_pop(L, 1);
+			}
+		}
+		lua_pop(L, 1);
+	}
+}
+
+namespace {
+	void completeShader(ResourceManager::PendingShader& pending, std::unordered_map<std::u8string, std::string>& fileErrors) {
+		std::shared_ptr<hyperengine::ShaderProgram> target = pending.target.lock();
+		if (!target) return;
+
+		if (!pending.program.errors().empty()) {
+			std::string errorTotal;
+			for (auto const& error : pending.program.errors()) {
+				errorTotal += error + "\n";
+			}
+			fileErrors[std::u8string((char8_t const*)pending.path.c_str())] = errorTotal;
+		}
+
+		*target = std::move(pending.program);
+	}
+}
+
+void ResourceManager::pollShaders(std::unordered_map<std::u8string, std::string>& fileErrors) {
+	for (auto it = mShadersPending.begin(); it != mShadersPending.end();) {
+		if (it->target.expired()) {
+			it = mShadersPending.erase(it);
+		}
+		else if (it->program.poll()) {
+			completeShader(*it, fileErrors);
+			it = mShadersPending.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+// Blocks until every submitted program is done, the driver still gets to compile them all concurrently
+void ResourceManager::waitShaders(std::unordered_map<std::u8string, std::string>& fileErrors) {
+	for (auto& pending : mShadersPending) {
+		pending.program.wait();
+		completeShader(pending, fileErrors);
+	}
+
+	mShadersPending.clear();
 }
\ No newline at end of file
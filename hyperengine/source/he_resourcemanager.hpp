@@ -3,21 +3,44 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <vector>
 #include "he_util.hpp"
 #include "graphics/he_texture.hpp"
+#include "graphics/he_texturearray.hpp"
 #include "graphics/he_mesh.hpp"
+#include "graphics/he_meshpool.hpp"
 #include "graphics/he_shader.hpp"
+#include "graphics/he_material.hpp"
+
+struct lua_State;
 
 struct ResourceManager final {
+	struct PendingShader final {
+		std::string path;
+		std::weak_ptr<hyperengine::ShaderProgram> target;
+		hyperengine::ShaderProgram program;
+	};
+
 	std::unordered_map<std::shared_ptr<hyperengine::Texture>, int> mTexturesAsserted;
 	hyperengine::UnorderedStringMap<std::weak_ptr<hyperengine::Mesh>> mMeshes;
+	std::shared_ptr<hyperengine::MeshPool> mMeshPool;
 	hyperengine::UnorderedStringMap<std::weak_ptr<hyperengine::Texture>> mTextures;
+	// Loaded textures are also copied in here while packing, `TextureArrays = true` in config.lua
+	hyperengine::TextureArrayPool mTextureArrays;
+	bool mPackTextures = false;
 	hyperengine::UnorderedStringMap<std::weak_ptr<hyperengine::ShaderProgram>> mShaders;
+	hyperengine::UnorderedStringMap<std::weak_ptr<hyperengine::Material>> mMaterials;
+	std::vector<PendingShader> mShadersPending;
 
 	void update();
 	std::shared_ptr<hyperengine::Texture> assertTextureLifetime(std::shared_ptr<hyperengine::Texture> const& texture, int frames = 360);
 	std::shared_ptr<hyperengine::Mesh> getMesh(std::string_view path);
 	std::shared_ptr<hyperengine::Texture> getTexture(std::string_view path);
-	void reloadShader(std::string const& pathStr, hyperengine::ShaderProgram& program, std::unordered_map<std::u8string, std::string>& fileErrors);
-	std::shared_ptr<hyperengine::ShaderProgram> getShaderProgram(std::string_view path, std::unordered_map<std::u8string, std::string>& fileErrors);
+	void reloadShader(std::string const& pathStr, std::shared_ptr<hyperengine::ShaderProgram> const& program);
+	std::shared_ptr<hyperengine::ShaderProgram> getShaderProgram(std::string_view path);
+	std::shared_ptr<hyperengine::Material> getMaterial(std::string_view path);
+	// Applies the shader, textures and parameters of the table on top of the stack, the layout of material files
+	void readMaterial(lua_State* L, hyperengine::Material& material);
+	void pollShaders(std::unordered_map<std::u8string, std::string>& fileErrors);
+	void waitShaders(std::unordered_map<std::u8string, std::string>& fileErrors);
 };
\ No newline at end of file
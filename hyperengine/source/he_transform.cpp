@@ -0,0 +1,109 @@
+#include "he_transform.hpp"
+
+#include <cassert>
+#include <glm/gtx/matrix_decompose.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define HE_TRANSFORM_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace hyperengine {
+	namespace {
+		// Same as glm::recompose without skew and perspective, the quaternion is used as is like glm::mat4_cast
+		glm::mat4 compose(Transform const& transform) {
+			glm::quat const& q = transform.orientation;
+			float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+			float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+			float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+			glm::mat4 matrix;
+			matrix[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * transform.scale.x;
+			matrix[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * transform.scale.y;
+			matrix[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * transform.scale.z;
+			matrix[3] = glm::vec4(transform.translation, 1.0f);
+			return matrix;
+		}
+	}
+
+	glm::mat4 Transform::get() const {
+		return compose(*this);
+	}
+
+	void Transform::set(glm::mat4 const& mat) {
+		glm::vec3 skew;
+		glm::vec4 perspective;
+		glm::decompose(mat, scale, orientation, translation, skew, perspective);
+	}
+
+	void Transform::translate(glm::vec3 direction) {
+		translation += orientation * (scale * direction);
+	}
+
+	// Structure of arrays over four transforms, the quaternions are transposed in and the columns transposed out
+	void composeTransforms(std::span<Transform const> transforms, std::span<glm::mat4> matrices) {
+		assert(matrices.size() >= transforms.size());
+
+		size_t i = 0;
+
+#ifdef HE_TRANSFORM_SSE2
+		static_assert(sizeof(glm::quat) == sizeof(__m128) && sizeof(glm::mat4) == 4 * sizeof(__m128));
+
+		__m128 const one = _mm_set1_ps(1.0f);
+		__m128 const two = _mm_set1_ps(2.0f);
+		__m128 const zero = _mm_setzero_ps();
+
+		for (; i + 4 <= transforms.size(); i += 4) {
+			Transform const* t = transforms.data() + i;
+
+			// glm stores quaternions as x, y, z, w
+			__m128 x = _mm_loadu_ps(&t[0].orientation.x);
+			__m128 y = _mm_loadu_ps(&t[1].orientation.x);
+			__m128 z = _mm_loadu_ps(&t[2].orientation.x);
+			__m128 w = _mm_loadu_ps(&t[3].orientation.x);
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+
+			__m128 sx = _mm_setr_ps(t[0].scale.x, t[1].scale.x, t[2].scale.x, t[3].scale.x);
+			__m128 sy = _mm_setr_ps(t[0].scale.y, t[1].scale.y, t[2].scale.y, t[3].scale.y);
+			__m128 sz = _mm_setr_ps(t[0].scale.z, t[1].scale.z, t[2].scale.z, t[3].scale.z);
+			__m128 tx = _mm_setr_ps(t[0].translation.x, t[1].translation.x, t[2].translation.x, t[3].translation.x);
+			__m128 ty = _mm_setr_ps(t[0].translation.y, t[1].translation.y, t[2].translation.y, t[3].translation.y);
+			__m128 tz = _mm_setr_ps(t[0].translation.z, t[1].translation.z, t[2].translation.z, t[3].translation.z);
+
+			__m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+			__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+			__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+			__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+			__m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+			__m128 c0y = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+			__m128 c0z = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+			__m128 c0w = zero;
+			__m128 c1x = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+			__m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+			__m128 c1z = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+			__m128 c1w = zero;
+			__m128 c2x = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+			__m128 c2y = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+			__m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+			__m128 c2w = zero;
+			__m128 c3w = one;
+
+			// After transposing, register n holds the column of transform n
+			_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+			_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+			_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+			_MM_TRANSPOSE4_PS(tx, ty, tz, c3w);
+
+			float* m = &matrices[i][0][0];
+			_mm_storeu_ps(m + 0, c0x);  _mm_storeu_ps(m + 4, c1x);  _mm_storeu_ps(m + 8, c2x);  _mm_storeu_ps(m + 12, tx);
+			_mm_storeu_ps(m + 16, c0y); _mm_storeu_ps(m + 20, c1y); _mm_storeu_ps(m + 24, c2y); _mm_storeu_ps(m + 28, ty);
+			_mm_storeu_ps(m + 32, c0z); _mm_storeu_ps(m + 36, c1z); _mm_storeu_ps(m + 40, c2z); _mm_storeu_ps(m + 44, tz);
+			_mm_storeu_ps(m + 48, c0w); _mm_storeu_ps(m + 52, c1w); _mm_storeu_ps(m + 56, c2w); _mm_storeu_ps(m + 60, c3w);
+		}
+#endif
+
+		for (; i < transforms.size(); ++i)
+			matrices[i] = compose(transforms[i]);
+	}
+}
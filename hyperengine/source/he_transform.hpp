@@ -0,0 +1,22 @@
+#pragma once
+
+#include <span>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace hyperengine {
+	struct Transform final {
+		glm::vec3 translation{};
+		glm::quat orientation = glm::identity<glm::quat>();
+		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+
+		// Translation * rotation * scale, entities read the cached matrix of their world transform instead
+		glm::mat4 get() const;
+		void set(glm::mat4 const& mat);
+		// Moves along the local axes
+		void translate(glm::vec3 direction);
+	};
+
+	// Composes `transforms.size()` matrices four at a time, `matrices` must be at least as large
+	void composeTransforms(std::span<Transform const> transforms, std::span<glm::mat4> matrices);
+}
@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <string_view>
 #include <utility>
+#include <cstdint>
 
 #include <lua.hpp>
 #include <glm/glm.hpp>
@@ -55,6 +56,15 @@ namespace hyperengine {
 	template<class V>
 	using UnorderedStringMap = std::unordered_map<std::string, V, Hash, std::equal_to<>>;
 
+	// 64 bit FNV-1a, usable at compile time
+	constexpr uint64_t fnv1a(std::string_view str, uint64_t hash = 0xcbf29ce484222325ull) {
+		for (char c : str) {
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
 	size_t split(std::string const& txt, std::vector<std::string>& strs, char ch);
 	void luaDumpstack(lua_State* L);
 	glm::vec2 luaToVec2(lua_State* L);
@@ -1 +1,10 @@
-RunVulkanDemo = false
\ No newline at end of file
+RunVulkanDemo = false
+
+-- Frames per second the render scale and shader quality adapt to, 0 renders at full quality always
+TargetFrameRate = 60
+
+-- Pack loaded textures into shared array textures, see Materials in the readme
+TextureArrays = true
+
+-- Gpu milliseconds per pass, rows over budget are highlighted in the Passes window
+GpuBudgets = { shadow = 2.0, opaque = 6.0, tonemap = 0.5, ui = 1.0 }
@@ -0,0 +1,7 @@
+-- Shared by every pine in the scene
+return {
+	shader = "shaders/cutout.glsl",
+	textures = {
+		tAlbedo = "pine.png",
+	},
+}
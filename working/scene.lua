@@ -1,4 +1,16 @@
 local objects = {
+	{
+		GameObject = {
+			name = "camera",
+			uuid = 0x3d5e8a1f0c7b9264,
+			translation = { 0, 12, 40 },
+			orientation = { -0.130526, 0, 0, 0.991445 },
+		},
+		Camera = {
+			fov = 70,
+			clippingPlanes = { 0.1, 500 },
+		},
+	},
 	{
 		GameObject = {
 			name = "sun",
@@ -220,10 +232,7 @@ for z=-3,3 do
 					resource = "pine.obj",
 				},
 				MeshRenderer = {
-					shader = "shaders/cutout.glsl",
-					textures = {
-						tAlbedo = "pine.png",
-					},
+					material = "materials/pine.lua",
 				},
 			})
 			uuidIdx = uuidIdx + 1
@@ -231,4 +240,44 @@ for z=-3,3 do
 	end
 end
 
-return objects
\ No newline at end of file
+-- Small lights, binned into clusters every frame
+local lampColors = {
+	{ 1.0, 0.6, 0.3 },
+	{ 0.3, 0.6, 1.0 },
+	{ 0.4, 1.0, 0.5 },
+}
+local lampUuids = { 0x8b5e4f7804ce89ec, 0x86ae92fe975c89ca, 0xdfcc694e42c15b08 }
+
+for i=1,3 do
+	table.insert(objects, {
+		GameObject = {
+			name = "lamp " .. i,
+			uuid = lampUuids[i],
+			translation = { -20 + i * 10, 2, 10 },
+		},
+		Light = {
+			type = "point",
+			color = lampColors[i],
+			strength = 20.0,
+			range = 12.0,
+		},
+	})
+end
+
+table.insert(objects, {
+	GameObject = {
+		name = "spot",
+		uuid = 0xcd7caeb299601f7c,
+		translation = { -10, 10, 0 },
+		orientation = { -0.707107, 0, 0, 0.707107 },
+	},
+	Light = {
+		type = "spot",
+		color = { 1.0, 0.95, 0.8 },
+		strength = 60.0,
+		range = 20.0,
+		angles = { 15, 25 },
+	},
+})
+
+return objects
@@ -2,6 +2,9 @@
 #	define INPUT(type, name, index) layout(location = index) in type name
 #	define OUTPUT(type, name, index)
 #	define VARYING(type, name) out type name
+
+// The opaque pass tests for equal depth against the prepass, positions must come out bit identical
+invariant gl_Position;
 #endif
 #ifdef FRAG
 #	define INPUT(type, name, index)
@@ -9,15 +12,41 @@
 #	define VARYING(type, name) in type name
 #endif
 
+// World matrix, a per instance attribute with the INSTANCING variant and `uTransform` otherwise
+#ifdef INSTANCING
+INPUT(mat4, iInstanceTransform, 4);
+#	define TRANSFORM iInstanceTransform
+#else
+#	define TRANSFORM uTransform
+#endif
+
+// Material textures are layers of shared arrays with the TEXTURE_ARRAYS variant, the
+// layer comes from the `<sampler>Layer` parameter the engine fills in
+#ifdef TEXTURE_ARRAYS
+#	define MATERIAL_SAMPLER sampler2DArray
+#	define MATERIAL_TEXTURE(samp, layer, uv) texture(samp, vec3(uv, layer))
+#	define MATERIAL_TEXTURE_GRAD(samp, layer, uv, dx, dy) textureGrad(samp, vec3(uv, layer), dx, dy)
+#else
+#	define MATERIAL_SAMPLER sampler2D
+#	define MATERIAL_TEXTURE(samp, layer, uv) texture(samp, uv)
+#	define MATERIAL_TEXTURE_GRAD(samp, layer, uv, dx, dy) textureGrad(samp, uv, dx, dy)
+#endif
+
+#define SHADOW_CASCADES 4
+
 layout(std140) uniform EngineData {
 	mat4 gProjection;
 	mat4 gView;
-	mat4 gLightMat;
+	mat4 gLightMats[SHADOW_CASCADES];
 	vec3 gSkyColor;
 	float gFarPlane;
 	vec3 gSunDirection;
 	float gTime;
 	vec3 gSunColor;
+	int gCascade;
+	vec4 gCascadeSplits;
+	uvec4 gClusterGrid; // Clusters along x, y and z, visible light count in w
+	vec4 gClusterScale; // Pixel to tile in xy, view depth to slice is log(depth) * z + w
 };
 
 float saturate(float value) { return clamp(value, 0.0, 1.0); }
@@ -42,7 +71,7 @@ vec4 hash4(vec2 p) {
 
 #ifdef FRAG
 // See: https://iquilezles.org/articles/texturerepetition/
-vec4 textureNoTile(sampler2D samp, in vec2 uv) {
+vec4 textureNoTile(MATERIAL_SAMPLER samp, float layer, in vec2 uv) {
 	ivec2 iuv = ivec2(floor(uv));
 	vec2 fuv = fract(uv);
 	
@@ -70,10 +99,10 @@ vec4 textureNoTile(sampler2D samp, in vec2 uv) {
 	// fetch and blend
 	vec2 b = smoothstep(0.25, 0.75, fuv);
 	
-	return mix(mix(textureGrad(samp, uva, ddxa, ddya),
-	               textureGrad(samp, uvb, ddxb, ddyb), b.x),
-	           mix(textureGrad(samp, uvc, ddxc, ddyc),
-	               textureGrad(samp, uvd, ddxd, ddyd), b.x), b.y);
+	return mix(mix(MATERIAL_TEXTURE_GRAD(samp, layer, uva, ddxa, ddya),
+	               MATERIAL_TEXTURE_GRAD(samp, layer, uvb, ddxb, ddyb), b.x),
+	           mix(MATERIAL_TEXTURE_GRAD(samp, layer, uvc, ddxc, ddyc),
+	               MATERIAL_TEXTURE_GRAD(samp, layer, uvd, ddxd, ddyd), b.x), b.y);
 }
 #endif
 
@@ -158,21 +187,31 @@ vec2 samplePoisson(int index) {
 
 #ifdef FRAG
 
-float _shadowCalculation(sampler2D samp, vec4 fragPosLightSpace, vec3 normal, vec3 sunDirection) {
+float _shadowCalculation(sampler2DArray samp, vec3 worldPosition, vec3 normal, vec3 sunDirection) {
+#ifndef SHADOWS
+	return 0.0;
+#else
+	// Pick the first cascade whose far split lies beyond the fragment
+	float viewDepth = -(gView * vec4(worldPosition, 1.0)).z;
+	int cascade = 0;
+	for (int i = 0; i < SHADOW_CASCADES - 1; ++i)
+		if (viewDepth > gCascadeSplits[i]) cascade = i + 1;
+
+	vec4 fragPosLightSpace = gLightMats[cascade] * vec4(worldPosition, 1.0);
 	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
 	projCoords = projCoords * 0.5 + 0.5;
 	
-	if(projCoords.z > 1.0)
+	if(projCoords.z > 1.0 || viewDepth > gCascadeSplits[SHADOW_CASCADES - 1])
 		return 0.0;
 	
 	float currentDepth = projCoords.z;
 	float bias = max(0.002 * (1.0 - dot(normal, -sunDirection)), 0.0);
 
 #ifdef FAST
-	float pcfDepth = texture(samp, projCoords.xy).r;
+	float pcfDepth = texture(samp, vec3(projCoords.xy, cascade)).r;
 	return currentDepth - bias > pcfDepth ? 1.0 : 0.0;
 #else
-	vec2 texelSize = 1.0 / textureSize(samp, 0);
+	vec2 texelSize = 1.0 / vec2(textureSize(samp, 0).xy);
 	float shadow = 0.0;
 
 	int offset = 3;
@@ -183,12 +222,53 @@ float _shadowCalculation(sampler2D samp, vec4 fragPosLightSpace, vec3 normal, ve
 		offset += samplePoisson(i);
 		//offset += vec2(random((gl_FragCoord.xy) + gTime * 0.0199814), random(gl_FragCoord.yx - gTime * 0.074115)) * 1.0 - 0.5;
 		
-		float pcfDepth = texture(samp, projCoords.xy + offset * texelSize).r;
+		float pcfDepth = texture(samp, vec3(projCoords.xy + offset * texelSize, cascade)).r;
 		shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
 	}
 	
 	return shadow / float(sampleCount);
 #endif
+#endif
+}
+
+// Bound once per frame to fixed units by the engine, three texels per light:
+// position and range, color and inner cone cosine, direction and outer cone cosine
+uniform samplerBuffer tLightData;
+uniform usamplerBuffer tLightGrid; // Offset and count per cluster
+uniform usamplerBuffer tLightIndices;
+
+// Point and spot lights of the fragment's cluster, added on top of the sun
+void _clusteredLights(vec3 worldPosition, vec3 normal, vec3 toCamera, out vec3 diffuse, out vec3 specular) {
+	diffuse = vec3(0.0);
+	specular = vec3(0.0);
+	if (gClusterGrid.w == 0u) return;
+
+	float viewDepth = -(gView * vec4(worldPosition, 1.0)).z;
+	ivec3 grid = ivec3(gClusterGrid.xyz);
+	ivec2 tile = clamp(ivec2(gl_FragCoord.xy * gClusterScale.xy), ivec2(0), grid.xy - 1);
+	int slice = clamp(int(log(max(viewDepth, 1e-4)) * gClusterScale.z + gClusterScale.w), 0, grid.z - 1);
+
+	uvec2 cell = texelFetch(tLightGrid, (slice * grid.y + tile.y) * grid.x + tile.x).xy;
+	for (uint i = 0u; i < cell.y; ++i) {
+		int light = int(texelFetch(tLightIndices, int(cell.x + i)).r) * 3;
+		vec4 positionRange = texelFetch(tLightData, light);
+		vec4 colorInner = texelFetch(tLightData, light + 1);
+		vec4 directionOuter = texelFetch(tLightData, light + 2);
+
+		vec3 toLight = positionRange.xyz - worldPosition;
+		float distance2 = dot(toLight, toLight);
+		vec3 unitToLight = toLight * inversesqrt(max(distance2, 1e-8));
+
+		// Windowed inverse square, reaches zero at the range
+		float ratio = distance2 / (positionRange.w * positionRange.w);
+		float falloff = saturate(1.0 - ratio * ratio);
+		float attenuation = falloff * falloff / (distance2 + 1.0);
+		attenuation *= smoothstep(directionOuter.w, colorInner.w, dot(-unitToLight, directionOuter.xyz));
+
+		vec3 radiance = colorInner.rgb * attenuation;
+		diffuse += radiance * max(dot(normal, unitToLight), 0.0);
+		specular += radiance * pow(max(dot(reflect(-unitToLight, normal), toCamera), 0.0), 10.0);
+	}
 }
 
 #endif
\ No newline at end of file
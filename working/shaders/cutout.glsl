@@ -1,7 +1,17 @@
 #inject
 #include "common.glsl"
+@variant FAST
+@variant SHADOWS
+@variant ALPHA_TEST
+@variant INSTANCING
+@variant TEXTURE_ARRAYS
 @property cull = 0
 
+@edithint tAlbedoLayer = hidden
+uniform Material {
+	float tAlbedoLayer;
+};
+
 INPUT(vec3, iPosition, 0);
 INPUT(vec3, iNormal, 1);
 INPUT(vec2, iTexCoord, 2);
@@ -9,43 +19,48 @@ VARYING(vec3, vNormal);
 VARYING(vec3, vToCamera);
 VARYING(vec2, vTexCoord);
 VARYING(float, vDistance);
-VARYING(vec4, vFragPosLightSpace);
+VARYING(vec3, vWorldPosition);
 OUTPUT(vec4, oColor, 0);
 
 uniform mat4 uTransform;
-uniform sampler2D tAlbedo;
+uniform MATERIAL_SAMPLER tAlbedo;
 
 @edithint tShadowMap = hidden
-uniform sampler2D tShadowMap;
+uniform sampler2DArray tShadowMap;
 
 const float kGamma = 2.2;
 
 #ifdef VERT
 void main(void) {
-	vec4 worldSpace = uTransform * vec4(iPosition, 1.0);
+	vec4 worldSpace = TRANSFORM * vec4(iPosition, 1.0);
 	vec4 viewSpace = gView * worldSpace;
 	gl_Position = gProjection * viewSpace;
 	vTexCoord = iTexCoord;
-	vNormal = nonUniformScale(uTransform, iNormal);
+	vNormal = nonUniformScale(TRANSFORM, iNormal);
 	vToCamera = (inverse(gView) * vec4(0.0, 0.0, 0.0, 1.0)).xyz - worldSpace.xyz;
 	vDistance = length(viewSpace);
-	vFragPosLightSpace = gLightMat * worldSpace;
+	vWorldPosition = worldSpace.xyz;
 }
 #endif
 
 #ifdef FRAG
 void main(void) {
-	oColor = texture(tAlbedo, vTexCoord);
+	oColor = MATERIAL_TEXTURE(tAlbedo, tAlbedoLayer, vTexCoord);
 	oColor.rgb *= pow(oColor.rgb, vec3(kGamma));
+#ifdef ALPHA_TEST
 	if (oColor.a < 0.5) discard;
+#endif
 	oColor.a = 1.0;
 	vec3 unitNormal = normalize(vNormal);
 	if (!gl_FrontFacing) unitNormal *= -1.0;
 	
-	float shadow = 1.0 - _shadowCalculation(tShadowMap, vFragPosLightSpace, unitNormal, -gSunDirection);
+	float shadow = 1.0 - _shadowCalculation(tShadowMap, vWorldPosition, unitNormal, -gSunDirection);
 	vec3 unitToCamera = normalize(vToCamera);
 	
-	oColor.rgb *= max(gSunColor * dot(unitNormal, -gSunDirection) * shadow, 0.2);
+	vec3 lightDiffuse, lightSpecular;
+	_clusteredLights(vWorldPosition, unitNormal, unitToCamera, lightDiffuse, lightSpecular);
+	
+	oColor.rgb *= max(gSunColor * dot(unitNormal, -gSunDirection) * shadow, 0.2) + lightDiffuse;
 	oColor.rgb = mix(oColor.rgb, gSkyColor, smoothstep(gFarPlane * 0.6, gFarPlane, vDistance));
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+#inject
+#include "common.glsl"
+
+// Drawn in place of programs that are still compiling, keep this cheap to build
+
+@property cull = 0
+
+INPUT(vec3, iPosition, 0);
+INPUT(vec3, iNormal, 1);
+VARYING(vec3, vNormal);
+OUTPUT(vec4, oColor, 0);
+
+uniform mat4 uTransform;
+
+#ifdef VERT
+void main(void) {
+	// Same order of operations as the depth prepass so the depths match under GL_EQUAL
+	vec4 worldSpace = TRANSFORM * vec4(iPosition, 1.0);
+	gl_Position = gProjection * (gView * worldSpace);
+	vNormal = mat3(TRANSFORM) * iNormal;
+}
+#endif
+
+#ifdef FRAG
+void main(void) {
+	float lambert = max(dot(normalize(vNormal), -gSunDirection), 0.0);
+	oColor = vec4(vec3(0.5) * max(lambert, 0.2), 1.0);
+}
+#endif
\ No newline at end of file
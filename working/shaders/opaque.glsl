@@ -1,9 +1,18 @@
 #inject
 #include "common.glsl"
 
+@variant FAST
+@variant SHADOWS
+@variant INSTANCING
+@variant TEXTURE_ARRAYS
+
 @edithint uColor = color
+@edithint tAlbedoLayer = hidden
+@edithint tSpecularLayer = hidden
 uniform Material {
 	vec3 uColor;
+	float tAlbedoLayer;
+	float tSpecularLayer;
 };
 
 INPUT(vec3, iPosition, 0);
@@ -13,45 +22,48 @@ VARYING(vec3, vNormal);
 VARYING(vec3, vToCamera);
 VARYING(vec2, vTexCoord);
 VARYING(float, vDistance);
-VARYING(vec4, vFragPosLightSpace);
+VARYING(vec3, vWorldPosition);
 OUTPUT(vec4, oColor, 0);
 
 uniform mat4 uTransform;
-uniform sampler2D tAlbedo;
-uniform sampler2D tSpecular;
+uniform MATERIAL_SAMPLER tAlbedo;
+uniform MATERIAL_SAMPLER tSpecular;
 
 @edithint tShadowMap = hidden
-uniform sampler2D tShadowMap;
+uniform sampler2DArray tShadowMap;
 
 const float kGamma = 2.2;
 
 #ifdef VERT
 void main(void) {
-	vec4 worldSpace = uTransform * vec4(iPosition, 1.0);
+	vec4 worldSpace = TRANSFORM * vec4(iPosition, 1.0);
 	vec4 viewSpace = gView * worldSpace;
 	gl_Position = gProjection * viewSpace;
 	vTexCoord = iTexCoord;
-	vNormal = nonUniformScale(uTransform, iNormal);
+	vNormal = nonUniformScale(TRANSFORM, iNormal);
 	vToCamera = (inverse(gView) * vec4(0.0, 0.0, 0.0, 1.0)).xyz - worldSpace.xyz;
 	vDistance = length(viewSpace.xyz);
-	vFragPosLightSpace = gLightMat * worldSpace;
+	vWorldPosition = worldSpace.xyz;
 }
 #endif
 
 #ifdef FRAG
 void main(void) {
-	oColor = texture(tAlbedo, vTexCoord);
+	oColor = MATERIAL_TEXTURE(tAlbedo, tAlbedoLayer, vTexCoord);
 	oColor.rgb *= pow(oColor.rgb, vec3(kGamma));
 	oColor.rgb *= uColor;
-	float specularStrength = texture(tSpecular, vTexCoord).r;
+	float specularStrength = MATERIAL_TEXTURE(tSpecular, tSpecularLayer, vTexCoord).r;
 	vec3 unitNormal = normalize(vNormal);
 	vec3 unitToCamera = normalize(vToCamera);
 	
-	float shadow = 1.0 - _shadowCalculation(tShadowMap, vFragPosLightSpace, unitNormal, -gSunDirection);
+	float shadow = 1.0 - _shadowCalculation(tShadowMap, vWorldPosition, unitNormal, -gSunDirection);
+	
+	vec3 lightDiffuse, lightSpecular;
+	_clusteredLights(vWorldPosition, unitNormal, unitToCamera, lightDiffuse, lightSpecular);
 	
-	oColor.rgb *= max(gSunColor * dot(unitNormal, -gSunDirection) * shadow, 0.2);
+	oColor.rgb *= max(gSunColor * dot(unitNormal, -gSunDirection) * shadow, 0.2) + lightDiffuse;
 	vec3 reflectedLight = reflect(gSunDirection, unitNormal);
-	oColor.rgb += gSunColor * pow(max(dot(reflectedLight, unitToCamera) * shadow, 0.0), 10.0) * specularStrength;
+	oColor.rgb += (gSunColor * pow(max(dot(reflectedLight, unitToCamera) * shadow, 0.0), 10.0) + lightSpecular) * specularStrength;
 	oColor.rgb = mix(oColor.rgb, gSkyColor, smoothstep(gFarPlane * 0.6, gFarPlane, vDistance));
 }
 #endif
\ No newline at end of file
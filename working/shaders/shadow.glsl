@@ -2,6 +2,8 @@
 #include "common.glsl"
 
 @property cull = 0
+@variant ALPHA_TEST
+@variant INSTANCING
 
 INPUT(vec3, iPosition, 0);
 INPUT(vec2, iTexCoord, 2);
@@ -12,14 +14,23 @@ uniform sampler2D tAlbedo;
 
 #ifdef VERT
 void main(void) {
-	gl_Position = gLightMat * uTransform * vec4(iPosition, 1.0);
+	vec4 worldSpace = TRANSFORM * vec4(iPosition, 1.0);
+
+	// A negative cascade is the camera depth prepass, computed like the opaque shaders so depths compare equal
+	if (gCascade < 0)
+		gl_Position = gProjection * (gView * worldSpace);
+	else
+		gl_Position = gLightMats[gCascade] * worldSpace;
+
 	vTexCoord = iTexCoord;
 }
 #endif
 
 #ifdef FRAG
 void main(void) {
+#ifdef ALPHA_TEST
 	vec4 color = texture(tAlbedo, vTexCoord);
 	if (color.a < 0.5) discard;
+#endif
 }
 #endif
\ No newline at end of file
@@ -1,8 +1,23 @@
 #inject
 #include "common.glsl"
 
+@variant FAST
+@variant SHADOWS
+@variant INSTANCING
+@variant TEXTURE_ARRAYS
+
+@edithint tAlbedo0Layer = hidden
+@edithint tAlbedo1Layer = hidden
+@edithint tAlbedo2Layer = hidden
+@edithint tAlbedo3Layer = hidden
+@edithint tBlendmapLayer = hidden
 uniform Material {
 	vec4 uTiling;
+	float tAlbedo0Layer;
+	float tAlbedo1Layer;
+	float tAlbedo2Layer;
+	float tAlbedo3Layer;
+	float tBlendmapLayer;
 };
 
 INPUT(vec3, iPosition, 0);
@@ -12,49 +27,49 @@ VARYING(vec3, vNormal);
 VARYING(vec3, vToCamera);
 VARYING(vec2, vTexCoord);
 VARYING(vec3, vPosition);
-VARYING(vec4, vFragPosLightSpace);
+VARYING(vec3, vWorldPosition);
 OUTPUT(vec4, oColor, 0);
 
 uniform mat4 uTransform;
-uniform sampler2D tAlbedo0;
-uniform sampler2D tAlbedo1;
-uniform sampler2D tAlbedo2;
-uniform sampler2D tAlbedo3;
-uniform sampler2D tBlendmap;
+uniform MATERIAL_SAMPLER tAlbedo0;
+uniform MATERIAL_SAMPLER tAlbedo1;
+uniform MATERIAL_SAMPLER tAlbedo2;
+uniform MATERIAL_SAMPLER tAlbedo3;
+uniform MATERIAL_SAMPLER tBlendmap;
 
 @edithint tShadowMap = hidden
-uniform sampler2D tShadowMap;
+uniform sampler2DArray tShadowMap;
 
 const float kGamma = 2.2;
 
 #ifdef VERT
 void main(void) {
-	vec4 worldSpace = uTransform * vec4(iPosition, 1.0);
+	vec4 worldSpace = TRANSFORM * vec4(iPosition, 1.0);
 	vec4 viewSpace = gView * worldSpace;
 	gl_Position = gProjection * viewSpace;
 	vTexCoord = iTexCoord;
-	vNormal = nonUniformScale(uTransform, iNormal);
+	vNormal = nonUniformScale(TRANSFORM, iNormal);
 	vToCamera = (inverse(gView) * vec4(0.0, 0.0, 0.0, 1.0)).xyz - worldSpace.xyz;
 	vPosition = viewSpace.xyz;
-	vFragPosLightSpace = gLightMat * worldSpace;
+	vWorldPosition = worldSpace.xyz;
 }
 #endif
 
 #ifdef FAST
-#	define optimialTextureLookup texture
+#	define optimialTextureLookup MATERIAL_TEXTURE
 #else
 #	define optimialTextureLookup textureNoTile
 #endif
 
 #ifdef FRAG
 void main(void) {
-	vec3 blendmapColor = texture(tBlendmap, vTexCoord).rgb;
+	vec3 blendmapColor = MATERIAL_TEXTURE(tBlendmap, tBlendmapLayer, vTexCoord).rgb;
 	vec4 bias = vec4(1.0 - (blendmapColor.r + blendmapColor.g + blendmapColor.b), blendmapColor);
 	
-	vec4 color0 = pow(optimialTextureLookup(tAlbedo0, vTexCoord * uTiling.x), vec4(kGamma));
-	vec4 color1 = pow(optimialTextureLookup(tAlbedo1, vTexCoord * uTiling.y), vec4(kGamma));
-	vec4 color2 = pow(optimialTextureLookup(tAlbedo2, vTexCoord * uTiling.z), vec4(kGamma));
-	vec4 color3 = pow(optimialTextureLookup(tAlbedo3, vTexCoord * uTiling.w), vec4(kGamma));
+	vec4 color0 = pow(optimialTextureLookup(tAlbedo0, tAlbedo0Layer, vTexCoord * uTiling.x), vec4(kGamma));
+	vec4 color1 = pow(optimialTextureLookup(tAlbedo1, tAlbedo1Layer, vTexCoord * uTiling.y), vec4(kGamma));
+	vec4 color2 = pow(optimialTextureLookup(tAlbedo2, tAlbedo2Layer, vTexCoord * uTiling.z), vec4(kGamma));
+	vec4 color3 = pow(optimialTextureLookup(tAlbedo3, tAlbedo3Layer, vTexCoord * uTiling.w), vec4(kGamma));
 	
 #ifdef FAST
 	oColor = vec4(color0.rgb * bias.x + color1.rgb * bias.y + color2.rgb * bias.z + color3.rgb * bias.w, 1.0);
@@ -79,14 +94,17 @@ void main(void) {
 	
 	float dist = length(vPosition);
 	
-	float shadow =  _shadowCalculation(tShadowMap, vFragPosLightSpace, unitNormal, -gSunDirection);
+	float shadow =  _shadowCalculation(tShadowMap, vWorldPosition, unitNormal, -gSunDirection);
 	
 	float transStart = 50.0 * 0.9;
 	float transLen = 50.0 - transStart;
 	//shadow *= 1.0 - saturate((dist - transStart) / transLen);
 	shadow = 1.0 - shadow;
 	
-	oColor.rgb *= max(gSunColor * dot(unitNormal, -gSunDirection) * shadow, 0.2);
+	vec3 lightDiffuse, lightSpecular;
+	_clusteredLights(vWorldPosition, unitNormal, unitToCamera, lightDiffuse, lightSpecular);
+	
+	oColor.rgb *= max(gSunColor * dot(unitNormal, -gSunDirection) * shadow, 0.2) + lightDiffuse;
 	oColor.rgb = mix(oColor.rgb, gSkyColor, smoothstep(gFarPlane * 0.6, gFarPlane, length(vPosition)));
 }
 #endif
\ No newline at end of file